@@ -0,0 +1,241 @@
+# Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+# ==============================================================================
+"""Runs the models of model_status.md with vx_delegate_benchmark.
+
+Each model listed in model_status.md is looked up in --model_dir by the name
+of its download archive, e.g. mobilenet_v1_1.0_224_quant.tflite, and run on
+the delegate. model_status.md, or --output_status if given, is then written
+with the status, delegation coverage, partition count, compile, first invoke
+and steady-state latency of every model found, and the numbers are written to
+a JSON baseline. Given the
+baseline of an earlier run, models that fail, delegate fewer nodes or got
+slower than --threshold percent are reported as regressions.
+"""
+
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+COLUMNS = ['model name', 'status', 'delegated nodes', 'partitions',
+           'compile ms', 'first invoke ms', 'p50 ms', 'p90 ms', 'model file']
+# Timings compared with the baseline.
+TIMINGS = ['compile_ms', 'first_invoke_ms', 'p50_ms']
+
+
+def parse_status(path):
+  """Splits model_status.md into text lines and table rows.
+
+  Returns a list of lines, where each model row is a dict with the name,
+  status, numbers of an earlier run, if any, and model file cells instead of
+  a string. Table headers become None and separator rows are dropped, both
+  are rewritten with the columns above.
+  """
+  lines = []
+  with open(path, 'r') as f:
+    for line in f.read().splitlines():
+      cells = [cell.strip() for cell in line.split('|')]
+      if len(cells) < 3:
+        lines.append(line)
+      elif cells[0] == 'model name':
+        lines.append(None)  # The header of a table.
+      elif cells[0].startswith(':--'):
+        continue
+      else:
+        lines.append({'name': cells[0], 'status': cells[1],
+                      'numbers': cells[2:-1], 'model_file': cells[-1]})
+  return lines
+
+
+def candidate_names(row):
+  """Lower case names the .tflite file of a row may have."""
+  names = [row['name'].lower()]
+  url = re.search(r'\((.*?)\)', row['model_file'])
+  if url:
+    archive = os.path.basename(url.group(1))
+    archive = re.sub(r'\.(tgz|tar\.gz|zip)$', '', archive).lower()
+    names.append(archive)
+    # Archives are often dated, e.g. densenet_2018_04_27 or
+    # inception_v1_224_quant_20181026, the models inside are not.
+    names.append(re.sub(r'(_\d{2,8})+$', '', archive))
+  return names
+
+
+def find_models(model_dir):
+  """Maps the lower case names of the .tflite files in model_dir to paths.
+
+  A model extracted to a directory of its own is known by that name too.
+  """
+  models = {}
+  for root, _, files in os.walk(model_dir):
+    tflite_files = [f for f in files if f.endswith('.tflite')]
+    for f in tflite_files:
+      models.setdefault(f[:-len('.tflite')].lower(), os.path.join(root, f))
+    if len(tflite_files) == 1:
+      models.setdefault(os.path.basename(root).lower(),
+                        os.path.join(root, tflite_files[0]))
+  return models
+
+
+def run_model(args, model):
+  """Benchmarks model on the delegate, returns the result dict or None."""
+  fd, output_json = tempfile.mkstemp(suffix='.json')
+  os.close(fd)
+  command = [args.benchmark, '--model=' + model, '--delegate=' + args.delegate,
+             '--warmup_runs=%d' % args.warmup_runs, '--runs=%d' % args.runs,
+             '--output_json=' + output_json]
+  if args.delegate_options:
+    command.append('--delegate_options=' + args.delegate_options)
+  try:
+    subprocess.run(command, check=True, timeout=args.timeout,
+                   stdout=subprocess.DEVNULL)
+    with open(output_json, 'r') as f:
+      result = json.load(f)
+  except (subprocess.SubprocessError, OSError, ValueError) as e:
+    print('  failed: %s' % e, file=sys.stderr)
+    return None
+  finally:
+    os.remove(output_json)
+  return {
+      'delegated_nodes': result.get('delegated_nodes', 0),
+      'total_nodes': result.get('total_nodes', 0),
+      'partitions': result.get('partitions', 0),
+      'compile_ms': result.get('compile_ms', 0.0),
+      'first_invoke_ms': result['first_invoke_ms'],
+      'mean_ms': result['steady_state']['mean_ms'],
+      'p50_ms': result['steady_state']['p50_ms'],
+      'p90_ms': result['steady_state']['p90_ms'],
+  }
+
+
+def table_row(row, result):
+  if result is None:
+    # Keep the numbers of a model that wasn't found in model_dir.
+    numbers = row['numbers']
+    if len(numbers) != len(COLUMNS) - 3 or row['status'] != 'pass':
+      numbers = ['-'] * (len(COLUMNS) - 3)
+    cells = [row['name'], row['status']] + numbers
+  else:
+    cells = [row['name'], row['status'],
+             '%d/%d' % (result['delegated_nodes'], result['total_nodes']),
+             str(result['partitions']), '%.1f' % result['compile_ms'],
+             '%.2f' % result['first_invoke_ms'], '%.2f' % result['p50_ms'],
+             '%.2f' % result['p90_ms']]
+  return '|'.join(cells + [row['model_file']])
+
+
+def regressions(baseline, results, threshold):
+  """Describes how results got worse than baseline."""
+  found = []
+  for name, old in sorted(baseline.items()):
+    new = results.get(name)
+    if new is None:
+      continue
+    if old['status'] == 'pass' and new['status'] != 'pass':
+      found.append('%s: now fails' % name)
+      continue
+    if new['status'] != 'pass' or old['status'] != 'pass':
+      continue
+    if new['delegated_nodes'] < old['delegated_nodes']:
+      found.append('%s: delegates %d nodes, was %d' %
+                   (name, new['delegated_nodes'], old['delegated_nodes']))
+    for timing in TIMINGS:
+      if old[timing] > 0 and (
+          new[timing] > old[timing] * (1 + threshold / 100)):
+        found.append('%s: %s %.2f, was %.2f (+%.0f%%)' %
+                     (name, timing, new[timing], old[timing],
+                      (new[timing] / old[timing] - 1) * 100))
+  return found
+
+
+if __name__ == '__main__':
+  parser = argparse.ArgumentParser()
+  parser.add_argument(
+      '--model_dir', required=True,
+      help='directory with the .tflite models, searched recursively')
+  parser.add_argument(
+      '--benchmark', default='vx_delegate_benchmark',
+      help='vx_delegate_benchmark executable')
+  parser.add_argument(
+      '--delegate', default='libvx_delegate.so', help='delegate library')
+  parser.add_argument(
+      '--delegate_options', default='',
+      help='delegate options as key:value;key:value')
+  parser.add_argument(
+      '--status',
+      default=os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                           os.pardir, 'model_status.md'),
+      help='model_status.md to read the models from and rewrite')
+  parser.add_argument(
+      '--output_status',
+      help='write the updated model_status.md here instead of over --status')
+  parser.add_argument(
+      '--output_baseline', default='model_zoo_baseline.json',
+      help='JSON file to write the results to')
+  parser.add_argument(
+      '--baseline', help='JSON results of an earlier run to compare with')
+  parser.add_argument(
+      '--threshold', type=float, default=10,
+      help='percent a timing may grow before it is a regression')
+  parser.add_argument('--warmup_runs', type=int, default=5)
+  parser.add_argument('--runs', type=int, default=20)
+  parser.add_argument(
+      '--timeout', type=int, default=1800,
+      help='seconds a model may take, the simulator is slow')
+  args = parser.parse_args()
+
+  models = find_models(args.model_dir)
+  lines = parse_status(args.status)
+  results = {}
+  output = []
+  for line in lines:
+    if line is None:
+      output.append('|'.join(COLUMNS))
+      output.append('|'.join([':---------'] * len(COLUMNS)))
+      continue
+    if not isinstance(line, dict):
+      output.append(line)
+      continue
+    model = next((models[name] for name in candidate_names(line)
+                  if name in models), None)
+    result = None
+    if model is not None:
+      print('%s: %s' % (line['name'], model))
+      result = run_model(args, model)
+      line['status'] = 'pass' if result is not None else 'fail'
+      results[line['name']] = dict(result or {}, status=line['status'])
+    output.append(table_row(line, result))
+
+  output_status = args.output_status or args.status
+  with open(output_status, 'w') as f:
+    f.write('\n'.join(output) + '\n')
+  with open(args.output_baseline, 'w') as f:
+    json.dump(results, f, indent=2, sort_keys=True)
+  print('ran %d models, wrote %s and %s' %
+        (len(results), output_status, args.output_baseline))
+
+  if args.baseline:
+    with open(args.baseline, 'r') as f:
+      found = regressions(json.load(f), results, args.threshold)
+    for regression in found:
+      print('regression: ' + regression, file=sys.stderr)
+    sys.exit(1 if found else 0)
@@ -0,0 +1,539 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Per-op microbenchmarks: single-op models of the ops covered by
+// delegate_test.cc, at the sizes they have in real models, run with the vx
+// delegate and with the TfLite CPU kernels. Besides the invoke time measured
+// by the benchmark loop, each run reports as counters:
+//   build_model_ms: creating the single-op interpreter
+//   prepare_ms:     applying the delegate and allocating the tensors
+//   graph_build_ms: mapping the op to a TIM-VX graph, part of prepare_ms
+//   compile_ms:     compiling that graph, part of prepare_ms
+//   first_invoke_ms
+//
+// Two more benchmarks time the delegate's per-invoke work rather than ops:
+//   InvokeOverhead: independent tiny Adds, so the time is spent binding and
+//                   copying the partition's many inputs and outputs
+//   Streaming:      frames through an `async_invoke` partition per
+//                   `pipeline_depth`, each frame's outputs in their own buffer
+//
+// Usage: vx_delegate_op_benchmark [--benchmark_filter=<regex>]
+//            [--benchmark_format=<console|json|csv>]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "delegate_main.h"
+#include "tensorflow/lite/builtin_op_data.h"
+#include "tensorflow/lite/interpreter.h"
+#include "tensorflow/lite/kernels/register.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double ElapsedMs(Clock::time_point begin) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - begin)
+      .count();
+}
+
+TfLiteQuantization Quantization(TfLiteType type, float scale, int zero_point) {
+  TfLiteQuantization quantization;
+  quantization.type = kTfLiteNoQuantization;
+  quantization.params = nullptr;
+  if (type == kTfLiteFloat32) {
+    return quantization;
+  }
+  // Owned by the interpreter from SetTensorParameters*.
+  auto* affine = static_cast<TfLiteAffineQuantization*>(
+      malloc(sizeof(TfLiteAffineQuantization)));
+  affine->scale = TfLiteFloatArrayCreate(1);
+  affine->scale->data[0] = scale;
+  affine->zero_point = TfLiteIntArrayCreate(1);
+  affine->zero_point->data[0] = zero_point;
+  affine->quantized_dimension = 0;
+  quantization.type = kTfLiteAffineQuantization;
+  quantization.params = affine;
+  return quantization;
+}
+
+// Builder of a single-op interpreter with random constant weights, in float32
+// or in asymmetric uint8.
+class OpModel {
+ public:
+  explicit OpModel(TfLiteType type)
+      : type_(type), interpreter_(new tflite::Interpreter) {}
+
+  // Input or output of the op.
+  int AddTensor(const std::vector<int>& dims,
+                float scale = 1.f / 128,
+                int zero_point = 128) {
+    int index;
+    interpreter_->AddTensors(1, &index);
+    interpreter_->SetTensorParametersReadWrite(
+        index, type_, "", dims, Quantization(type_, scale, zero_point));
+    return index;
+  }
+
+  int AddWeights(const std::vector<int>& dims) {
+    return AddConstTensor(type_, dims, 1.f / 256, 128);
+  }
+
+  // Bias of an op with weights, int32 with the input times weight scale when
+  // quantized.
+  int AddBias(int size) {
+    return type_ == kTfLiteFloat32
+               ? AddConstTensor(kTfLiteFloat32, {size}, 0, 0)
+               : AddConstTensor(kTfLiteInt32, {size}, 1.f / 128 / 256, 0);
+  }
+
+  // Add the op with `params`, allocated with malloc as the interpreter frees
+  // them, and make its inputs and outputs the model's.
+  bool AddOp(tflite::BuiltinOperator op,
+             void* params,
+             const std::vector<int>& inputs,
+             const std::vector<int>& outputs) {
+    const TfLiteRegistration* registration = resolver_.FindOp(op, 1);
+    if (registration == nullptr) {
+      return false;
+    }
+    std::vector<int> model_inputs;
+    for (int input : inputs) {
+      if (interpreter_->tensor(input)->allocation_type != kTfLiteMmapRo) {
+        model_inputs.push_back(input);
+      }
+    }
+    return interpreter_->SetInputs(model_inputs) == kTfLiteOk &&
+           interpreter_->SetOutputs(outputs) == kTfLiteOk &&
+           interpreter_->AddNodeWithParameters(inputs, outputs, nullptr, 0,
+                                               params, registration) ==
+               kTfLiteOk;
+  }
+
+  tflite::Interpreter* interpreter() { return interpreter_.get(); }
+
+ private:
+  int AddConstTensor(TfLiteType type,
+                     const std::vector<int>& dims,
+                     float scale,
+                     int zero_point) {
+    int elements = 1;
+    for (int dim : dims) {
+      elements *= dim;
+    }
+    buffers_.emplace_back(new std::vector<char>(
+        elements * (type == kTfLiteUInt8 ? 1 : sizeof(float))));
+    std::vector<char>& buffer = *buffers_.back();
+    if (type == kTfLiteFloat32) {
+      std::uniform_real_distribution<float> distribution(-0.1f, 0.1f);
+      auto* data = reinterpret_cast<float*>(buffer.data());
+      for (int i = 0; i < elements; i++) {
+        data[i] = distribution(generator_);
+      }
+    } else if (type == kTfLiteUInt8) {
+      std::uniform_int_distribution<int> distribution(0, 255);
+      for (char& byte : buffer) {
+        byte = static_cast<char>(distribution(generator_));
+      }
+    }
+    int index;
+    interpreter_->AddTensors(1, &index);
+    interpreter_->SetTensorParametersReadOnly(
+        index, type, "", dims, Quantization(type, scale, zero_point),
+        buffer.data(), buffer.size());
+    return index;
+  }
+
+  TfLiteType type_;
+  std::mt19937 generator_;
+  tflite::ops::builtin::BuiltinOpResolver resolver_;
+  // Constant tensor data, which must outlive the interpreter.
+  std::vector<std::unique_ptr<std::vector<char>>> buffers_;
+  std::unique_ptr<tflite::Interpreter> interpreter_;
+};
+
+template <typename Params>
+Params* NewParams() {
+  auto* params = static_cast<Params*>(malloc(sizeof(Params)));
+  memset(params, 0, sizeof(Params));
+  return params;
+}
+
+// Args: size, input channels, output channels, kernel size.
+bool BuildConv2d(const benchmark::State& state, OpModel* model) {
+  const int size = state.range(0);
+  const int in_channels = state.range(1);
+  const int out_channels = state.range(2);
+  const int kernel = state.range(3);
+  auto* params = NewParams<TfLiteConvParams>();
+  params->padding = kTfLitePaddingSame;
+  params->stride_width = params->stride_height = 1;
+  params->dilation_width_factor = params->dilation_height_factor = 1;
+  params->activation = kTfLiteActNone;
+  return model->AddOp(
+      tflite::BuiltinOperator_CONV_2D, params,
+      {model->AddTensor({1, size, size, in_channels}),
+       model->AddWeights({out_channels, kernel, kernel, in_channels}),
+       model->AddBias(out_channels)},
+      {model->AddTensor({1, size, size, out_channels}, 1.f / 16)});
+}
+
+// Args: size, channels, kernel size.
+bool BuildDepthwiseConv2d(const benchmark::State& state, OpModel* model) {
+  const int size = state.range(0);
+  const int channels = state.range(1);
+  const int kernel = state.range(2);
+  auto* params = NewParams<TfLiteDepthwiseConvParams>();
+  params->padding = kTfLitePaddingSame;
+  params->stride_width = params->stride_height = 1;
+  params->dilation_width_factor = params->dilation_height_factor = 1;
+  params->depth_multiplier = 1;
+  params->activation = kTfLiteActNone;
+  return model->AddOp(
+      tflite::BuiltinOperator_DEPTHWISE_CONV_2D, params,
+      {model->AddTensor({1, size, size, channels}),
+       model->AddWeights({1, kernel, kernel, channels}),
+       model->AddBias(channels)},
+      {model->AddTensor({1, size, size, channels}, 1.f / 16)});
+}
+
+// Args: input units, output units.
+bool BuildFullyConnected(const benchmark::State& state, OpModel* model) {
+  const int in_units = state.range(0);
+  const int out_units = state.range(1);
+  auto* params = NewParams<TfLiteFullyConnectedParams>();
+  params->activation = kTfLiteActNone;
+  params->weights_format = kTfLiteFullyConnectedWeightsFormatDefault;
+  return model->AddOp(tflite::BuiltinOperator_FULLY_CONNECTED, params,
+                      {model->AddTensor({1, in_units}),
+                       model->AddWeights({out_units, in_units}),
+                       model->AddBias(out_units)},
+                      {model->AddTensor({1, out_units}, 1.f / 16)});
+}
+
+// Args: size, channels, filter size and stride.
+bool BuildPool(tflite::BuiltinOperator op,
+               const benchmark::State& state,
+               OpModel* model) {
+  const int size = state.range(0);
+  const int channels = state.range(1);
+  const int filter = state.range(2);
+  auto* params = NewParams<TfLitePoolParams>();
+  params->padding = kTfLitePaddingValid;
+  params->stride_width = params->stride_height = filter;
+  params->filter_width = params->filter_height = filter;
+  params->activation = kTfLiteActNone;
+  // Pooling keeps the quantization of its input.
+  return model->AddOp(
+      op, params, {model->AddTensor({1, size, size, channels})},
+      {model->AddTensor({1, size / filter, size / filter, channels})});
+}
+
+bool BuildMaxPool2d(const benchmark::State& state, OpModel* model) {
+  return BuildPool(tflite::BuiltinOperator_MAX_POOL_2D, state, model);
+}
+
+bool BuildAveragePool2d(const benchmark::State& state, OpModel* model) {
+  return BuildPool(tflite::BuiltinOperator_AVERAGE_POOL_2D, state, model);
+}
+
+// Args: batch, classes.
+bool BuildSoftmax(const benchmark::State& state, OpModel* model) {
+  const int batch = state.range(0);
+  const int classes = state.range(1);
+  auto* params = NewParams<TfLiteSoftmaxParams>();
+  params->beta = 1.f;
+  // Quantized softmax outputs have a fixed 1/256 scale.
+  return model->AddOp(tflite::BuiltinOperator_SOFTMAX, params,
+                      {model->AddTensor({batch, classes}, 1.f / 16)},
+                      {model->AddTensor({batch, classes}, 1.f / 256, 0)});
+}
+
+// Args: size, channels.
+bool BuildAdd(const benchmark::State& state, OpModel* model) {
+  const int size = state.range(0);
+  const int channels = state.range(1);
+  auto* params = NewParams<TfLiteAddParams>();
+  params->activation = kTfLiteActNone;
+  return model->AddOp(tflite::BuiltinOperator_ADD, params,
+                      {model->AddTensor({1, size, size, channels}),
+                       model->AddTensor({1, size, size, channels})},
+                      {model->AddTensor({1, size, size, channels}, 1.f / 64)});
+}
+
+using BuildFn = bool (*)(const benchmark::State& state, OpModel* model);
+
+void FillInputs(tflite::Interpreter* interpreter) {
+  std::mt19937 generator;
+  std::uniform_int_distribution<int> distribution(0, 255);
+  for (int input : interpreter->inputs()) {
+    TfLiteTensor* tensor = interpreter->tensor(input);
+    if (tensor->type == kTfLiteFloat32) {
+      for (size_t i = 0; i < tensor->bytes / sizeof(float); i++) {
+        tensor->data.f[i] = distribution(generator) / 128.f - 1.f;
+      }
+    } else {
+      for (size_t i = 0; i < tensor->bytes; i++) {
+        tensor->data.uint8[i] = distribution(generator);
+      }
+    }
+  }
+}
+
+struct DelegateDeleter {
+  void operator()(TfLiteDelegate* delegate) {
+    vx::delegate::VxDelegateDelete(delegate);
+  }
+};
+
+void RunOp(benchmark::State& state,
+           BuildFn build,
+           TfLiteType type,
+           bool use_delegate) {
+  // Declared before the model so that it outlives the interpreter.
+  std::unique_ptr<TfLiteDelegate, DelegateDeleter> delegate;
+  if (use_delegate) {
+    vx::delegate::VxDelegateOptions options =
+        vx::delegate::VxDelegateOptionsDefault();
+    delegate.reset(vx::delegate::VxDelegateCreate(&options));
+  }
+
+  Clock::time_point begin = Clock::now();
+  OpModel model(type);
+  if (!build(state, &model)) {
+    state.SkipWithError("failed to build the model");
+    return;
+  }
+  const double build_model_ms = ElapsedMs(begin);
+  tflite::Interpreter* interpreter = model.interpreter();
+
+  begin = Clock::now();
+  if ((delegate &&
+       interpreter->ModifyGraphWithDelegate(delegate.get()) != kTfLiteOk) ||
+      interpreter->AllocateTensors() != kTfLiteOk) {
+    state.SkipWithError("failed to prepare the model");
+    return;
+  }
+  const double prepare_ms = ElapsedMs(begin);
+
+  FillInputs(interpreter);
+  begin = Clock::now();
+  if (interpreter->Invoke() != kTfLiteOk) {
+    state.SkipWithError("failed to invoke the model");
+    return;
+  }
+  const double first_invoke_ms = ElapsedMs(begin);
+
+  for (auto _ : state) {
+    if (interpreter->Invoke() != kTfLiteOk) {
+      state.SkipWithError("failed to invoke the model");
+      break;
+    }
+  }
+
+  state.counters["build_model_ms"] = build_model_ms;
+  state.counters["prepare_ms"] = prepare_ms;
+  state.counters["first_invoke_ms"] = first_invoke_ms;
+  if (delegate) {
+    vx::delegate::VxDelegateStats stats;
+    vx::delegate::VxDelegateGetStats(delegate.get(), &stats);
+    // 0 when the op stayed on the CPU kernel.
+    state.counters["delegated_nodes"] = stats.delegated_nodes;
+    vx::delegate::VxDelegatePartitionStats partition;
+    if (stats.compiled_partitions > 0 &&
+        vx::delegate::VxDelegateGetPartitionStats(delegate.get(), 0,
+                                                  &partition) == kTfLiteOk) {
+      state.counters["graph_build_ms"] = partition.build_ms;
+      state.counters["compile_ms"] = partition.compile_ms - partition.build_ms;
+    }
+  }
+}
+
+// Builds `num_adds` independent float Adds of `size` elements on `delegate`.
+// Inputs are a_0, b_0, a_1, ..., the outputs are tensors 2, 5, 8, ...
+std::unique_ptr<tflite::Interpreter> BuildAdds(TfLiteDelegate* delegate,
+                                               int num_adds,
+                                               int size) {
+  tflite::ops::builtin::BuiltinOpResolver resolver;
+  std::unique_ptr<tflite::Interpreter> interpreter(new tflite::Interpreter);
+  std::vector<int> inputs;
+  std::vector<int> outputs;
+  for (int i = 0; i < num_adds; i++) {
+    inputs.push_back(3 * i);
+    inputs.push_back(3 * i + 1);
+    outputs.push_back(3 * i + 2);
+  }
+  if (interpreter->AddTensors(3 * num_adds) != kTfLiteOk ||
+      interpreter->SetInputs(inputs) != kTfLiteOk ||
+      interpreter->SetOutputs(outputs) != kTfLiteOk) {
+    return nullptr;
+  }
+  for (int i = 0; i < 3 * num_adds; i++) {
+    if (interpreter->SetTensorParametersReadWrite(
+            i, kTfLiteFloat32, "", {1, size},
+            Quantization(kTfLiteFloat32, 0, 0)) != kTfLiteOk) {
+      return nullptr;
+    }
+  }
+  for (int i = 0; i < num_adds; i++) {
+    if (interpreter->AddNodeWithParameters(
+            {3 * i, 3 * i + 1}, {3 * i + 2}, nullptr, 0,
+            NewParams<TfLiteAddParams>(),
+            resolver.FindOp(tflite::BuiltinOperator_ADD, 1)) != kTfLiteOk) {
+      return nullptr;
+    }
+  }
+  if (interpreter->ModifyGraphWithDelegate(delegate) != kTfLiteOk ||
+      interpreter->AllocateTensors() != kTfLiteOk) {
+    return nullptr;
+  }
+  return interpreter;
+}
+
+// Args: number of Adds, each with two inputs and one output of 16 floats.
+void RunInvokeOverhead(benchmark::State& state) {
+  vx::delegate::VxDelegateOptions options =
+      vx::delegate::VxDelegateOptionsDefault();
+  std::unique_ptr<TfLiteDelegate, DelegateDeleter> delegate(
+      vx::delegate::VxDelegateCreate(&options));
+  auto interpreter = BuildAdds(delegate.get(), state.range(0), 16);
+  if (!interpreter) {
+    state.SkipWithError("failed to prepare the model");
+    return;
+  }
+  FillInputs(interpreter.get());
+  if (interpreter->Invoke() != kTfLiteOk) {
+    state.SkipWithError("failed to invoke the model");
+    return;
+  }
+  for (auto _ : state) {
+    if (interpreter->Invoke() != kTfLiteOk) {
+      state.SkipWithError("failed to invoke the model");
+      break;
+    }
+  }
+  state.counters["inputs"] = 2 * state.range(0);
+  state.counters["outputs"] = state.range(0);
+}
+
+// Args: pipeline depth. Each iteration is one frame of 256K floats, the
+// frames per second are reported as items.
+void RunStreaming(benchmark::State& state) {
+  constexpr int kFrameSize = 256 * 1024;
+  const int depth = state.range(0);
+  vx::delegate::VxDelegateOptions options =
+      vx::delegate::VxDelegateOptionsDefault();
+  options.async_invoke = true;
+  options.pipeline_depth = depth;
+  std::unique_ptr<TfLiteDelegate, DelegateDeleter> delegate(
+      vx::delegate::VxDelegateCreate(&options));
+  auto interpreter = BuildAdds(delegate.get(), 1, kFrameSize);
+  if (!interpreter) {
+    state.SkipWithError("failed to prepare the model");
+    return;
+  }
+  // Otherwise Invoke reads the output back, waiting for each run.
+  interpreter->SetAllowBufferHandleOutput(true);
+  std::vector<std::vector<float>> outputs(depth,
+                                          std::vector<float>(kFrameSize));
+  int frame = 0;
+  for (auto _ : state) {
+    // Stands in for preprocessing the next camera frame.
+    float* a = interpreter->typed_input_tensor<float>(0);
+    float* b = interpreter->typed_input_tensor<float>(1);
+    std::fill(a, a + kFrameSize, static_cast<float>(frame));
+    std::fill(b, b + kFrameSize, 1.0f);
+    // Rebinding releases the previous frame's handle, not its memory.
+    std::vector<float>& output = outputs[frame++ % depth];
+    TfLiteBufferHandle handle = vx::delegate::VxDelegateRegisterBufferHandle(
+        delegate.get(), output.data(), output.size() * sizeof(float));
+    if (interpreter->SetBufferHandle(2, handle, delegate.get()) !=
+            kTfLiteOk ||
+        interpreter->Invoke() != kTfLiteOk) {
+      state.SkipWithError("failed to invoke the model");
+      break;
+    }
+  }
+  if (vx::delegate::VxDelegateWaitForCompletion(delegate.get()) !=
+      kTfLiteOk) {
+    state.SkipWithError("asynchronous run failed");
+  }
+  state.SetItemsProcessed(frame);
+}
+
+// Registers `name` on the CPU kernels and on the delegate, in float32 and
+// uint8, for each of `args`.
+void Register(const std::string& name,
+              BuildFn build,
+              const std::vector<std::vector<int64_t>>& args) {
+  const struct {
+    const char* name;
+    TfLiteType type;
+  } types[] = {{"float32", kTfLiteFloat32}, {"uint8", kTfLiteUInt8}};
+  for (const auto& type : types) {
+    for (bool use_delegate : {false, true}) {
+      benchmark::internal::Benchmark* benchmark = benchmark::RegisterBenchmark(
+          (name + "/" + type.name + (use_delegate ? "/vx" : "/cpu")).c_str(),
+          RunOp, build, type.type, use_delegate);
+      for (const std::vector<int64_t>& arg : args) {
+        benchmark->Args(arg);
+      }
+      benchmark->Unit(benchmark::kMillisecond)->UseRealTime();
+    }
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  // Sizes of these ops in MobileNet, ResNet and Inception style models.
+  Register("Conv2d", BuildConv2d,
+           {{224, 3, 32, 3}, {112, 32, 64, 1}, {56, 64, 64, 3}});
+  Register("DepthwiseConv2d", BuildDepthwiseConv2d,
+           {{112, 32, 3}, {56, 128, 3}, {14, 512, 3}});
+  Register("FullyConnected", BuildFullyConnected,
+           {{1024, 1000}, {2048, 1000}});
+  Register("MaxPool2d", BuildMaxPool2d, {{112, 64, 2}, {56, 128, 2}});
+  Register("AveragePool2d", BuildAveragePool2d, {{7, 1024, 7}});
+  Register("Softmax", BuildSoftmax, {{1, 1001}});
+  Register("Add", BuildAdd, {{56, 256}, {28, 512}});
+  benchmark::RegisterBenchmark("InvokeOverhead/vx", RunInvokeOverhead)
+      ->Arg(1)
+      ->Arg(8)
+      ->Arg(32)
+      ->Unit(benchmark::kMicrosecond);
+  // Waits for the last runs after the timed loop, so uses real time.
+  benchmark::RegisterBenchmark("Streaming/vx", RunStreaming)
+      ->Arg(1)
+      ->Arg(2)
+      ->Arg(4)
+      ->Unit(benchmark::kMillisecond)
+      ->UseRealTime();
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -0,0 +1,452 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Measures a model with and without the vx delegate: interpreter creation,
+// delegate application (which compiles the graphs), the first invoke,
+// steady-state latency, and throughput of interpreters invoking concurrently
+// on one delegate.
+//
+// Usage: vx_delegate_benchmark --model=<tflite model>
+//            [--delegate=<libvx_delegate.so>] [--delegate_options=k:v;k:v]
+//            [--input_files=<a.bin>,<b.bin>] [--warmup_runs=N] [--runs=N]
+//            [--num_interpreters=N] [--output_csv=<path>]
+//            [--output_json=<path>]
+
+#include <dlfcn.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "delegate_main.h"
+#include "tensorflow/lite/interpreter.h"
+#include "tensorflow/lite/kernels/register.h"
+#include "tensorflow/lite/model.h"
+#include "tensorflow/lite/tools/command_line_flags.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double ElapsedMs(Clock::time_point begin) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - begin)
+      .count();
+}
+
+std::vector<std::string> Split(const std::string& text, char separator) {
+  std::vector<std::string> parts;
+  std::stringstream stream(text);
+  std::string part;
+  while (std::getline(stream, part, separator)) {
+    if (!part.empty()) {
+      parts.push_back(part);
+    }
+  }
+  return parts;
+}
+
+// The vx delegate plugin, loaded directly rather than through TfLite's
+// external delegate wrapper so its statistics API can be reached.
+class DelegateLibrary {
+ public:
+  ~DelegateLibrary() {
+    if (delegate_ != nullptr) {
+      destroy_(delegate_);
+    }
+    if (handle_ != nullptr) {
+      dlclose(handle_);
+    }
+  }
+
+  // Load `path` and create a delegate from "key:value;key:value" options.
+  bool Load(const std::string& path, const std::string& options) {
+    handle_ = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (handle_ == nullptr) {
+      fprintf(stderr, "Failed to load %s: %s\n", path.c_str(), dlerror());
+      return false;
+    }
+    using CreateFn = TfLiteDelegate* (*)(char**, char**, size_t,
+                                         void (*)(const char*));
+    auto create = reinterpret_cast<CreateFn>(
+        dlsym(handle_, "tflite_plugin_create_delegate"));
+    destroy_ = reinterpret_cast<void (*)(TfLiteDelegate*)>(
+        dlsym(handle_, "tflite_plugin_destroy_delegate"));
+    get_stats_ = reinterpret_cast<GetStatsFn>(
+        dlsym(handle_, "vx_delegate_get_stats"));
+    if (create == nullptr || destroy_ == nullptr) {
+      fprintf(stderr, "%s is not a TfLite external delegate\n", path.c_str());
+      return false;
+    }
+
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    for (const std::string& option : Split(options, ';')) {
+      size_t colon = option.find(':');
+      if (colon == std::string::npos) {
+        fprintf(stderr, "Malformed delegate option %s\n", option.c_str());
+        return false;
+      }
+      keys.push_back(option.substr(0, colon));
+      values.push_back(option.substr(colon + 1));
+    }
+    std::vector<char*> key_ptrs;
+    std::vector<char*> value_ptrs;
+    for (size_t i = 0; i < keys.size(); i++) {
+      key_ptrs.push_back(&keys[i][0]);
+      value_ptrs.push_back(&values[i][0]);
+    }
+    delegate_ = create(key_ptrs.data(), value_ptrs.data(), keys.size(),
+                       nullptr);
+    return delegate_ != nullptr;
+  }
+
+  TfLiteDelegate* delegate() const { return delegate_; }
+
+  // Returns false if the library has no statistics API.
+  bool GetStats(vx::delegate::VxDelegateStats* stats) const {
+    return get_stats_ != nullptr && get_stats_(delegate_, stats) == kTfLiteOk;
+  }
+
+ private:
+  using GetStatsFn = TfLiteStatus (*)(const TfLiteDelegate*,
+                                      vx::delegate::VxDelegateStats*);
+
+  void* handle_ = nullptr;
+  TfLiteDelegate* delegate_ = nullptr;
+  void (*destroy_)(TfLiteDelegate*) = nullptr;
+  GetStatsFn get_stats_ = nullptr;
+};
+
+// Fill the inputs of `interpreter` from `files`, one per input, or with
+// random data if there are none.
+bool SetupInputs(tflite::Interpreter* interpreter,
+                 const std::vector<std::string>& files) {
+  if (!files.empty() && files.size() != interpreter->inputs().size()) {
+    fprintf(stderr, "Model has %zu inputs, got %zu input files\n",
+            interpreter->inputs().size(), files.size());
+    return false;
+  }
+  std::mt19937 generator(0);
+  for (size_t i = 0; i < interpreter->inputs().size(); i++) {
+    TfLiteTensor* tensor = interpreter->input_tensor(i);
+    if (!files.empty()) {
+      std::ifstream file(files[i], std::ios::binary | std::ios::ate);
+      if (!file || static_cast<size_t>(file.tellg()) != tensor->bytes) {
+        fprintf(stderr, "%s doesn't hold the %zu bytes of input %zu\n",
+                files[i].c_str(), tensor->bytes, i);
+        return false;
+      }
+      file.seekg(0);
+      file.read(tensor->data.raw, tensor->bytes);
+      continue;
+    }
+    if (tensor->type == kTfLiteFloat32) {
+      std::uniform_real_distribution<float> distribution(0.f, 1.f);
+      float* data = reinterpret_cast<float*>(tensor->data.raw);
+      for (size_t j = 0; j < tensor->bytes / sizeof(float); j++) {
+        data[j] = distribution(generator);
+      }
+    } else {
+      for (size_t j = 0; j < tensor->bytes; j++) {
+        tensor->data.raw[j] = static_cast<char>(generator());
+      }
+    }
+  }
+  return true;
+}
+
+struct LatencySummary {
+  int count = 0;
+  double min_ms = 0;
+  double mean_ms = 0;
+  double p50_ms = 0;
+  double p90_ms = 0;
+  double p99_ms = 0;
+  double max_ms = 0;
+};
+
+LatencySummary Summarize(std::vector<double> samples) {
+  LatencySummary summary;
+  if (samples.empty()) {
+    return summary;
+  }
+  std::sort(samples.begin(), samples.end());
+  auto percentile = [&samples](double p) {
+    size_t rank = static_cast<size_t>(std::ceil(p / 100 * samples.size()));
+    return samples[std::min(std::max<size_t>(rank, 1), samples.size()) - 1];
+  };
+  summary.count = samples.size();
+  summary.min_ms = samples.front();
+  summary.max_ms = samples.back();
+  for (double sample : samples) {
+    summary.mean_ms += sample / samples.size();
+  }
+  summary.p50_ms = percentile(50);
+  summary.p90_ms = percentile(90);
+  summary.p99_ms = percentile(99);
+  return summary;
+}
+
+struct Result {
+  std::string model;
+  std::string delegate;
+  double init_ms = 0;
+  double apply_delegate_ms = 0;
+  double first_invoke_ms = 0;
+  LatencySummary steady;
+  int num_interpreters = 1;
+  double throughput = 0;
+  // From the delegate's statistics API, if available.
+  bool has_stats = false;
+  vx::delegate::VxDelegateStats stats;
+};
+
+// Build an interpreter for `model`, applying `delegate` if not null.
+std::unique_ptr<tflite::Interpreter> BuildInterpreter(
+    const tflite::FlatBufferModel& model,
+    TfLiteDelegate* delegate,
+    double* init_ms,
+    double* apply_delegate_ms) {
+  auto begin = Clock::now();
+  tflite::ops::builtin::BuiltinOpResolver resolver;
+  std::unique_ptr<tflite::Interpreter> interpreter;
+  if (tflite::InterpreterBuilder(model, resolver)(&interpreter) != kTfLiteOk) {
+    return nullptr;
+  }
+  *init_ms = ElapsedMs(begin);
+
+  begin = Clock::now();
+  if (delegate != nullptr &&
+      interpreter->ModifyGraphWithDelegate(delegate) != kTfLiteOk) {
+    fprintf(stderr, "Failed to apply the delegate\n");
+    return nullptr;
+  }
+  if (interpreter->AllocateTensors() != kTfLiteOk) {
+    return nullptr;
+  }
+  *apply_delegate_ms = ElapsedMs(begin);
+  return interpreter;
+}
+
+void WriteCsv(const std::string& path, const Result& result) {
+  std::ofstream file(path);
+  file << "model,delegate,init_ms,apply_delegate_ms,first_invoke_ms,runs,"
+          "min_ms,mean_ms,p50_ms,p90_ms,p99_ms,max_ms,num_interpreters,"
+          "throughput_ips,partitions,delegated_nodes,total_nodes,"
+          "compile_ms\n";
+  file << result.model << "," << result.delegate << "," << result.init_ms
+       << "," << result.apply_delegate_ms << "," << result.first_invoke_ms
+       << "," << result.steady.count << "," << result.steady.min_ms << ","
+       << result.steady.mean_ms << "," << result.steady.p50_ms << ","
+       << result.steady.p90_ms << "," << result.steady.p99_ms << ","
+       << result.steady.max_ms << "," << result.num_interpreters << ","
+       << result.throughput;
+  if (result.has_stats) {
+    file << "," << result.stats.partitions << ","
+         << result.stats.delegated_nodes << "," << result.stats.total_nodes
+         << "," << result.stats.compile_ms;
+  } else {
+    file << ",,,,";
+  }
+  file << "\n";
+}
+
+void WriteJson(const std::string& path, const Result& result) {
+  std::ofstream file(path);
+  file << "{\n  \"model\": \"" << result.model << "\",\n  \"delegate\": \""
+       << result.delegate << "\",\n  \"init_ms\": " << result.init_ms
+       << ",\n  \"apply_delegate_ms\": " << result.apply_delegate_ms
+       << ",\n  \"first_invoke_ms\": " << result.first_invoke_ms
+       << ",\n  \"steady_state\": {\"runs\": " << result.steady.count
+       << ", \"min_ms\": " << result.steady.min_ms
+       << ", \"mean_ms\": " << result.steady.mean_ms
+       << ", \"p50_ms\": " << result.steady.p50_ms
+       << ", \"p90_ms\": " << result.steady.p90_ms
+       << ", \"p99_ms\": " << result.steady.p99_ms
+       << ", \"max_ms\": " << result.steady.max_ms
+       << "},\n  \"num_interpreters\": " << result.num_interpreters
+       << ",\n  \"throughput_ips\": " << result.throughput;
+  if (result.has_stats) {
+    file << ",\n  \"partitions\": " << result.stats.partitions
+         << ",\n  \"delegated_nodes\": " << result.stats.delegated_nodes
+         << ",\n  \"total_nodes\": " << result.stats.total_nodes
+         << ",\n  \"compile_ms\": " << result.stats.compile_ms;
+  }
+  file << "\n}\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::string model_path;
+  std::string delegate_path;
+  std::string delegate_options;
+  std::string input_files;
+  int warmup_runs = 5;
+  int runs = 50;
+  int num_interpreters = 1;
+  std::string output_csv;
+  std::string output_json;
+  std::vector<tflite::Flag> flag_list = {
+      tflite::Flag::CreateFlag("model", &model_path, "TfLite model to run."),
+      tflite::Flag::CreateFlag("delegate",
+                               &delegate_path,
+                               "vx delegate library, runs on the CPU "
+                               "kernels if empty."),
+      tflite::Flag::CreateFlag("delegate_options",
+                               &delegate_options,
+                               "Delegate options as key:value;key:value."),
+      tflite::Flag::CreateFlag("input_files",
+                               &input_files,
+                               "Comma separated raw input files, random "
+                               "inputs if empty."),
+      tflite::Flag::CreateFlag("warmup_runs",
+                               &warmup_runs,
+                               "Invokes before measuring."),
+      tflite::Flag::CreateFlag("runs", &runs, "Measured invokes."),
+      tflite::Flag::CreateFlag("num_interpreters",
+                               &num_interpreters,
+                               "Interpreters invoking concurrently for the "
+                               "throughput measurement, 0 to skip it."),
+      tflite::Flag::CreateFlag("output_csv",
+                               &output_csv,
+                               "CSV file to write the results to."),
+      tflite::Flag::CreateFlag("output_json",
+                               &output_json,
+                               "JSON file to write the results to."),
+  };
+  if (!tflite::Flags::Parse(&argc, const_cast<const char**>(argv), flag_list) ||
+      model_path.empty()) {
+    fprintf(stderr, "%s", tflite::Flags::Usage(argv[0], flag_list).c_str());
+    return 1;
+  }
+
+  Result result;
+  result.model = model_path;
+  result.delegate = delegate_path.empty() ? "cpu" : delegate_path;
+  const std::vector<std::string> inputs = Split(input_files, ',');
+
+  auto begin = Clock::now();
+  std::unique_ptr<tflite::FlatBufferModel> model =
+      tflite::FlatBufferModel::BuildFromFile(model_path.c_str());
+  if (model == nullptr) {
+    return 1;
+  }
+  double load_ms = ElapsedMs(begin);
+
+  DelegateLibrary library;
+  if (!delegate_path.empty() &&
+      !library.Load(delegate_path, delegate_options)) {
+    return 1;
+  }
+
+  auto interpreter = BuildInterpreter(*model,
+                                      library.delegate(),
+                                      &result.init_ms,
+                                      &result.apply_delegate_ms);
+  if (interpreter == nullptr || !SetupInputs(interpreter.get(), inputs)) {
+    return 1;
+  }
+  result.init_ms += load_ms;
+
+  begin = Clock::now();
+  if (interpreter->Invoke() != kTfLiteOk) {
+    fprintf(stderr, "Invoke failed\n");
+    return 1;
+  }
+  result.first_invoke_ms = ElapsedMs(begin);
+
+  for (int i = 0; i < warmup_runs; i++) {
+    interpreter->Invoke();
+  }
+  std::vector<double> samples;
+  for (int i = 0; i < runs; i++) {
+    begin = Clock::now();
+    if (interpreter->Invoke() != kTfLiteOk) {
+      fprintf(stderr, "Invoke failed\n");
+      return 1;
+    }
+    samples.push_back(ElapsedMs(begin));
+  }
+  result.steady = Summarize(samples);
+  // Before the other interpreters add their compiles and invokes.
+  result.has_stats = library.GetStats(&result.stats);
+
+  // Every interpreter shares the delegate, as a multi-stream application
+  // would.
+  result.num_interpreters = num_interpreters;
+  if (num_interpreters > 0) {
+    std::vector<std::unique_ptr<tflite::Interpreter>> interpreters;
+    for (int i = 0; i < num_interpreters; i++) {
+      double init_ms, apply_delegate_ms;
+      interpreters.push_back(BuildInterpreter(
+          *model, library.delegate(), &init_ms, &apply_delegate_ms));
+      if (interpreters.back() == nullptr ||
+          !SetupInputs(interpreters.back().get(), inputs) ||
+          interpreters.back()->Invoke() != kTfLiteOk) {
+        return 1;
+      }
+    }
+    begin = Clock::now();
+    std::vector<std::thread> threads;
+    for (auto& each : interpreters) {
+      tflite::Interpreter* instance = each.get();
+      threads.emplace_back([instance, runs]() {
+        for (int i = 0; i < runs; i++) {
+          instance->Invoke();
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    result.throughput = num_interpreters * runs / (ElapsedMs(begin) / 1000);
+  }
+
+  printf("model: %s\ndelegate: %s\n", result.model.c_str(),
+         result.delegate.c_str());
+  printf("init: %.3f ms, apply delegate: %.3f ms, first invoke: %.3f ms\n",
+         result.init_ms, result.apply_delegate_ms, result.first_invoke_ms);
+  printf("steady state over %d runs: min %.3f, mean %.3f, p50 %.3f, "
+         "p90 %.3f, p99 %.3f, max %.3f ms\n",
+         result.steady.count, result.steady.min_ms, result.steady.mean_ms,
+         result.steady.p50_ms, result.steady.p90_ms, result.steady.p99_ms,
+         result.steady.max_ms);
+  if (num_interpreters > 0) {
+    printf("throughput with %d interpreters: %.1f invokes/s\n",
+           num_interpreters, result.throughput);
+  }
+  if (result.has_stats) {
+    printf("delegated %d/%d nodes in %d partitions, compiled in %.3f ms\n",
+           result.stats.delegated_nodes, result.stats.total_nodes,
+           result.stats.partitions, result.stats.compile_ms);
+  }
+  if (!output_csv.empty()) {
+    WriteCsv(output_csv, result);
+  }
+  if (!output_json.empty()) {
+    WriteJson(output_json, result);
+  }
+  return 0;
+}
@@ -0,0 +1,191 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "coverage.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+
+#include "tensorflow/lite/schema/schema_generated.h"
+
+namespace {
+
+std::string JsonString(const std::string& text) {
+  std::string json = "\"";
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      json += '\\';
+      json += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      json += escaped;
+    } else {
+      json += c;
+    }
+  }
+  return json + "\"";
+}
+
+std::string JsonTensor(TfLiteContext* context, int tensor_idx) {
+  const TfLiteTensor& tensor = context->tensors[tensor_idx];
+  std::string json = "{\"index\": " + std::to_string(tensor_idx) +
+                     ", \"name\": " +
+                     JsonString(tensor.name ? tensor.name : "") +
+                     ", \"type\": " +
+                     JsonString(TfLiteTypeGetName(tensor.type)) +
+                     ", \"shape\": [";
+  if (tensor.dims != nullptr) {
+    for (int i = 0; i < tensor.dims->size; i++) {
+      json += (i == 0 ? "" : ", ") + std::to_string(tensor.dims->data[i]);
+    }
+  }
+  return json + "], \"bytes\": " + std::to_string(tensor.bytes) + "}";
+}
+
+std::string JsonTensors(TfLiteContext* context,
+                        const std::vector<int>& tensors) {
+  std::string json = "[";
+  for (size_t i = 0; i < tensors.size(); i++) {
+    json += (i == 0 ? "" : ", ") + JsonTensor(context, tensors[i]);
+  }
+  return json + "]";
+}
+
+}  // namespace
+
+namespace vx {
+namespace delegate {
+
+std::string OpName(const TfLiteRegistration* registration) {
+  if (registration->custom_name != nullptr) {
+    return registration->custom_name;
+  }
+  return tflite::EnumNameBuiltinOperator(
+      static_cast<tflite::BuiltinOperator>(registration->builtin_code));
+}
+
+std::string CoverageReport(
+    TfLiteContext* context,
+    const std::vector<NodeSupport>& nodes,
+    const std::vector<PartitionEstimate>& partitions,
+    const std::vector<KernelPasses>& kernel_passes) {
+  std::map<int, size_t> partition_of_node;
+  int delegated_nodes = 0;
+  int delegated_partitions = 0;
+  for (size_t i = 0; i < partitions.size(); i++) {
+    for (int node_index : partitions[i].nodes) {
+      partition_of_node[node_index] = i;
+    }
+    if (partitions[i].delegated) {
+      delegated_nodes += partitions[i].nodes.size();
+      delegated_partitions++;
+    }
+  }
+
+  // Each kernel's counts go to one partition, so none are counted twice.
+  std::map<size_t, GraphPassCounts> partition_passes;
+  for (const KernelPasses& kernel : kernel_passes) {
+    if (kernel.nodes.empty()) {
+      continue;
+    }
+    auto it = partition_of_node.find(
+        *std::min_element(kernel.nodes.begin(), kernel.nodes.end()));
+    if (it == partition_of_node.end() || !partitions[it->second].delegated) {
+      continue;
+    }
+    GraphPassCounts& counts = partition_passes[it->second];
+    counts.folded_ops += kernel.counts.folded_ops;
+    counts.fused_activations += kernel.counts.fused_activations;
+    counts.removed_converts += kernel.counts.removed_converts;
+    counts.removed_reshapes += kernel.counts.removed_reshapes;
+  }
+
+  int supported_nodes = 0;
+  std::string nodes_json;
+  for (const NodeSupport& node : nodes) {
+    supported_nodes += node.supported;
+    auto it = partition_of_node.find(node.node_index);
+    const PartitionEstimate* partition =
+        it == partition_of_node.end() ? nullptr : &partitions[it->second];
+    const bool delegated = partition != nullptr && partition->delegated;
+    nodes_json += nodes_json.empty() ? "\n" : ",\n";
+    nodes_json += "    {\"index\": " + std::to_string(node.node_index) +
+                  ", \"op\": " + JsonString(node.op) +
+                  ", \"delegated\": " + (delegated ? "true" : "false");
+    if (partition != nullptr) {
+      nodes_json += ", \"partition\": " + std::to_string(it->second);
+    }
+    if (!delegated) {
+      // Supported nodes stay on the CPU because of their partition.
+      nodes_json += ", \"reason\": " +
+                    JsonString(node.supported && partition != nullptr
+                                   ? partition->reason
+                                   : node.reason);
+    }
+    nodes_json += "}";
+  }
+
+  std::string partitions_json;
+  int removed_reshapes = 0;
+  for (size_t i = 0; i < partitions.size(); i++) {
+    const PartitionEstimate& partition = partitions[i];
+    auto passes = partition_passes.find(i);
+    partitions_json += partitions_json.empty() ? "\n" : ",\n";
+    partitions_json += "    {\"index\": " + std::to_string(i) +
+                       ", \"nodes\": [";
+    for (size_t j = 0; j < partition.nodes.size(); j++) {
+      partitions_json +=
+          (j == 0 ? "" : ", ") + std::to_string(partition.nodes[j]);
+    }
+    partitions_json +=
+        "], \"delegated\": " +
+        std::string(partition.delegated ? "true" : "false") +
+        ", \"reason\": " + JsonString(partition.reason) +
+        ", \"compute\": " + std::to_string(partition.compute) +
+        ", \"transfer_bytes\": " + std::to_string(partition.transfer_bytes);
+    if (passes != partition_passes.end()) {
+      const GraphPassCounts& counts = passes->second;
+      partitions_json +=
+          ",\n     \"graph_passes\": {\"folded_ops\": " +
+          std::to_string(counts.folded_ops) + ", \"fused_activations\": " +
+          std::to_string(counts.fused_activations) +
+          ", \"removed_converts\": " +
+          std::to_string(counts.removed_converts) +
+          ", \"removed_reshapes\": " +
+          std::to_string(counts.removed_reshapes) + "}";
+      removed_reshapes += counts.removed_reshapes;
+    }
+    partitions_json +=
+        ",\n     \"inputs\": " + JsonTensors(context, partition.inputs) +
+        ",\n     \"outputs\": " + JsonTensors(context, partition.outputs) +
+        "}";
+  }
+
+  return "{\n  \"summary\": {\"nodes\": " + std::to_string(nodes.size()) +
+         ", \"supported_nodes\": " + std::to_string(supported_nodes) +
+         ", \"delegated_nodes\": " + std::to_string(delegated_nodes) +
+         ", \"partitions\": " + std::to_string(partitions.size()) +
+         ", \"delegated_partitions\": " +
+         std::to_string(delegated_partitions) +
+         ", \"removed_reshapes\": " + std::to_string(removed_reshapes) +
+         "},\n  \"nodes\": [" +
+         nodes_json + "\n  ],\n  \"partitions\": [" + partitions_json +
+         "\n  ]\n}\n";
+}
+
+}  // namespace delegate
+}  // namespace vx
@@ -0,0 +1,53 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_LITE_DELEGATES_VX_DELEGAGE_COVERAGE_H_
+#define TENSORFLOW_LITE_DELEGATES_VX_DELEGAGE_COVERAGE_H_
+
+#include <string>
+#include <vector>
+
+#include "partitioner.h"
+
+namespace vx {
+namespace delegate {
+
+/// Name of the op of `registration`, e.g. "CONV_2D", or its custom name.
+std::string OpName(const TfLiteRegistration* registration);
+
+/// Whether a node of the execution plan has an op mapper accepting it.
+struct NodeSupport {
+  int node_index;
+  std::string op;
+  bool supported;
+  // The rule that rejected the node, if it isn't supported.
+  std::string reason;
+};
+
+/// JSON report of the nodes in `nodes`, each delegated or with the reason it
+/// stays on the CPU, and of the `partitions` planned from the supported ones
+/// with their boundary tensors. Delegated partitions list what the graph
+/// passes did to the `kernel_passes` whose first node they hold, since
+/// TfLite may split the nodes into kernels differently.
+std::string CoverageReport(
+    TfLiteContext* context,
+    const std::vector<NodeSupport>& nodes,
+    const std::vector<PartitionEstimate>& partitions,
+    const std::vector<KernelPasses>& kernel_passes);
+
+}  // namespace delegate
+}  // namespace vx
+
+#endif /* TENSORFLOW_LITE_DELEGATES_VX_DELEGAGE_COVERAGE_H_ */
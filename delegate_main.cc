@@ -16,20 +16,36 @@ limitations under the License.
 #include "delegate_main.h"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdarg>
+#include <cstdio>
 #include <cstring>
 #include <iostream>
+#include <iterator>
 #include <limits>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <vector>
 
+#include "coverage.h"
+#include "executor.h"
+#include "graph_passes.h"
+#include "kernel_runner.h"
 #include "op_map.h"
+#include "partitioner.h"
+#include "trace.h"
 #include "utils.h"
 #include "tensorflow/lite/tools/logging.h"
 #include "tensorflow/lite/context_util.h"
+#include "tensorflow/lite/core/api/profiler.h"
 #include "tensorflow/lite/kernels/internal/reference/reference_ops.h"
 #include "tensorflow/lite/kernels/internal/tensor_ctypes.h"
 #include "tensorflow/lite/kernels/internal/types.h"
 #include "tim/transform/layout_inference.h"
+#include "tim/vx/ops/nbg.h"
 
 namespace {
 
@@ -66,13 +82,60 @@ TfLiteRegistration DelegateNodeRegistration() {
     return op_data->delegate->Invoke(*op_data, context, node);
   };
 
-  r.profiling_string = nullptr;
+  r.profiling_string = [](const TfLiteContext* context,
+                          const TfLiteNode* node) -> const char* {
+    auto op_data = reinterpret_cast<vx::delegate::OpData*>(node->user_data);
+    return op_data->profiling_string.c_str();
+  };
   r.builtin_code = kTfLiteBuiltinDelegate;
   r.version = 1;
 
   return r;
 }
 
+// TfLite's profiler of `context`, or nullptr if profiling is off.
+tflite::Profiler* GetProfiler(const TfLiteContext* context) {
+  return reinterpret_cast<tflite::Profiler*>(context->profiler);
+}
+
+// Label of a delegate node in profiles: the ranges of the nodes it replaced
+// and their ops, e.g. "Vx Delegate nodes 0-3,5 (CONV_2D, ADD)".
+std::string PartitionLabel(TfLiteContext* context,
+                           const TfLiteIntArray* nodes) {
+  std::string ranges;
+  int begin = 0;
+  for (int i = 0; i < nodes->size; i++) {
+    const int node_index = nodes->data[i];
+    if (i + 1 < nodes->size && nodes->data[i + 1] == node_index + 1) {
+      continue;
+    }
+    // nodes->data[begin..i] are consecutive nodes.
+    ranges += (ranges.empty() ? "" : ",") + std::to_string(nodes->data[begin]);
+    if (i > begin) {
+      ranges += "-" + std::to_string(node_index);
+    }
+    begin = i + 1;
+  }
+  std::vector<std::string> ops;
+  for (int node_index : tflite::TfLiteIntArrayView(nodes)) {
+    TfLiteNode* node;
+    TfLiteRegistration* registration;
+    if (context->GetNodeAndRegistration(
+            context, node_index, &node, &registration) != kTfLiteOk) {
+      continue;
+    }
+    std::string op = vx::delegate::OpName(registration);
+    if (std::find(ops.begin(), ops.end(), op) == ops.end()) {
+      ops.push_back(op);
+    }
+  }
+  std::string label = "Vx Delegate nodes " + ranges + " (";
+  for (size_t i = 0; i < ops.size(); i++) {
+    label += (i == 0 ? "" : ", ") + ops[i];
+  }
+  return label + ")";
+}
+
 TfLiteStatus PrepareDelegate(TfLiteContext* context, TfLiteDelegate* delegate) {
   TfLiteIntArray* plan;
   TfLiteNode* node;
@@ -81,23 +144,84 @@ TfLiteStatus PrepareDelegate(TfLiteContext* context, TfLiteDelegate* delegate) {
 
   // Get a list of supported nodes.
   std::vector<int> supported_nodes = {0};
+  std::vector<vx::delegate::NodeSupport> node_support;
   for (int node_index : tflite::TfLiteIntArrayView(plan)) {
     TF_LITE_ENSURE_STATUS(context->GetNodeAndRegistration(
         context, node_index, &node, &registration));
-    if (vx::delegate::Delegate::SupportedOp(context, node, registration)) {
+    vx::delegate::NodeSupport support;
+    support.node_index = node_index;
+    support.op = vx::delegate::OpName(registration);
+    support.supported = vx::delegate::Delegate::SupportedOp(
+        context, node, registration, &support.reason);
+    if (support.supported) {
       supported_nodes.push_back(node_index);
+    } else {
+      TFLITE_LOG(INFO) << "Node " << node_index << " (" << support.op
+                       << ") stays on the CPU: " << support.reason;
     }
+    node_support.push_back(std::move(support));
   }
 
-  // Set first element to the number of nodes to replace.
-  supported_nodes[0] = supported_nodes.size() - 1;
+  // Leave partitions that aren't worth their transfers on the CPU.
+  auto* delegate_data =
+      reinterpret_cast<vx::delegate::DelegateData*>(delegate->data_);
+  std::vector<vx::delegate::PartitionEstimate> partitions;
+  TF_LITE_ENSURE_STATUS(vx::delegate::PlanPartitions(
+      context,
+      std::vector<int>(supported_nodes.begin() + 1, supported_nodes.end()),
+      delegate_data->options,
+      &delegate_data->profile,
+      &partitions));
+  std::vector<int> delegated_nodes = {0};
+  int delegated_partitions = 0;
+  for (const auto& partition : partitions) {
+    if (partition.delegated) {
+      delegated_nodes.insert(delegated_nodes.end(),
+                             partition.nodes.begin(),
+                             partition.nodes.end());
+      delegated_partitions++;
+    }
+  }
 
-  // Replace supported subgraphs.
-  return context->ReplaceNodeSubsetsWithDelegateKernels(
+  // Set first element to the number of nodes to replace.
+  delegated_nodes[0] = delegated_nodes.size() - 1;
+
+  vx::delegate::DelegateStats& stats = delegate_data->stats;
+  stats.partitions = delegated_partitions;
+  stats.delegated_nodes = delegated_nodes[0];
+  stats.total_nodes = plan->size;
+
+  // Replace supported subgraphs. Their kernels' Init runs the graph passes,
+  // whose counts go into the report.
+  {
+    std::lock_guard<std::mutex> lock(delegate_data->coverage_mutex);
+    delegate_data->kernel_passes.clear();
+  }
+  TfLiteStatus status = context->ReplaceNodeSubsetsWithDelegateKernels(
       context,
       DelegateNodeRegistration(),
-      reinterpret_cast<TfLiteIntArray*>(supported_nodes.data()),
+      reinterpret_cast<TfLiteIntArray*>(delegated_nodes.data()),
       delegate);
+
+  std::vector<vx::delegate::KernelPasses> kernel_passes;
+  {
+    std::lock_guard<std::mutex> lock(delegate_data->coverage_mutex);
+    kernel_passes = delegate_data->kernel_passes;
+  }
+  std::string report = vx::delegate::CoverageReport(
+      context, node_support, partitions, kernel_passes);
+  if (!delegate_data->coverage_file.empty() &&
+      !vx::delegate::utils::WriteFileAtomic(
+          delegate_data->coverage_file,
+          std::vector<char>(report.begin(), report.end()))) {
+    TFLITE_LOG(ERROR) << "Failed to write coverage report "
+                      << delegate_data->coverage_file;
+  }
+  {
+    std::lock_guard<std::mutex> lock(delegate_data->coverage_mutex);
+    delegate_data->coverage_report = std::move(report);
+  }
+  return status;
 }
 
 TfLiteStatus CopyFromBufferHandle(TfLiteContext* context,
@@ -105,8 +229,22 @@ TfLiteStatus CopyFromBufferHandle(TfLiteContext* context,
                                   TfLiteBufferHandle buffer_handle,
                                   TfLiteTensor* tensor) {
   // Copies the data from delegate buffer into the tensor raw memory.
-  TFLITE_LOG(INFO) << "CopyFromBufferHandle handle:" << buffer_handle
-            << " tensor:" << tensor->name;
+  VX_TRACE(vx::delegate::trace::kVerbose,
+           "invoke",
+           "CopyFromBufferHandle",
+           buffer_handle);
+  auto* delegate_data =
+      reinterpret_cast<vx::delegate::DelegateData*>(delegate->data_);
+  // The buffer may still be written by an asynchronous run.
+  TF_LITE_ENSURE_STATUS(delegate_data->WaitForBuffer(buffer_handle));
+  vx::delegate::DelegateData::Buffer buffer;
+  if (!delegate_data->LookupBuffer(buffer_handle, &buffer) ||
+      buffer.bytes < tensor->bytes) {
+    TFLITE_LOG(ERROR) << "Invalid buffer handle " << buffer_handle
+                      << " for tensor " << tensor->name;
+    return kTfLiteError;
+  }
+  memcpy(tensor->data.raw, buffer.data, tensor->bytes);
   return kTfLiteOk;
 }
 
@@ -114,7 +252,11 @@ void FreeBufferHandle(TfLiteContext* context,
                       TfLiteDelegate* delegate,
                       TfLiteBufferHandle* handle) {
   // Do any cleanups.
-  TFLITE_LOG(INFO) << "FreeBufferHandle handle:" << *handle;
+  VX_TRACE(
+      vx::delegate::trace::kVerbose, "invoke", "FreeBufferHandle", *handle);
+  reinterpret_cast<vx::delegate::DelegateData*>(delegate->data_)
+      ->ReleaseBuffer(*handle);
+  *handle = kTfLiteNullBufferHandle;
 }
 
 std::vector<uint32_t> TfLiteTensorDims(const TfLiteTensor* tensor) {
@@ -150,9 +292,11 @@ tim::vx::DataType TfLiteDtypeToVsiDtype(TfLiteType type) {
 }
 
 bool IsConstTensor(const TfLiteTensor* tensor) {
-  const uint8_t* tensor_data =
-      reinterpret_cast<const uint8_t*>(tensor->data.raw_const);
-  return tensor_data != nullptr;
+  // Graphs are rebuilt from Prepare when shapes change, by which time arena
+  // tensors may still carry data pointers from the previous allocation.
+  // Everything else with data is a constant, whatever allocated it.
+  return tensor->allocation_type != kTfLiteArenaRw &&
+         tensor->data.raw_const != nullptr;
 }
 
 bool IsVariableTensor(const TfLiteTensor* tensor) {
@@ -315,39 +459,592 @@ std::vector<std::shared_ptr<tim::vx::Tensor>> MapIndexesToTensors(
   return out_tensors;
 }
 
+std::atomic<int64_t> live_contexts{0};
+std::atomic<int64_t> live_graphs{0};
+// Process-unique ids of partition kernels, for trace events.
+std::atomic<int32_t> next_partition_id{0};
+
+// Wraps `object` so that `counter` tracks how many are alive.
+template <typename T>
+std::shared_ptr<T> TrackLive(std::shared_ptr<T> object,
+                             std::atomic<int64_t>& counter) {
+  counter++;
+  T* raw = object.get();
+  return std::shared_ptr<T>(raw, [object, &counter](T*) mutable {
+    object.reset();
+    counter--;
+  });
+}
+
+// Bump whenever the graph building changes in a way that invalidates
+// previously cached NBG files.
+constexpr char kCompiledGraphCacheVersion[] = "vx_delegate_nbg_v2";
+constexpr char kCompiledGraphCacheMagic[8] = {'V', 'X', 'N', 'B', 'G', 0, 0, 1};
+
+// Timed invokes per partition for `calibrate`, after one to warm up. Later
+// invokes only run on the NPU.
+constexpr uint64_t kCalibrationSamples = 16;
+
+uint64_t HashDims(const TfLiteTensor& tensor, uint64_t seed) {
+  return vx::delegate::utils::Fnv1aHash(
+      tensor.dims->data, tensor.dims->size * sizeof(int), seed);
+}
+
+// Hash of constant data for a graph signature. Signatures of graphs saved
+// to `cache_dir` must stay the same across builds and use the byte-wise
+// FNV-1a; in memory ones use the much faster word-wise checksum.
+uint64_t HashData(const void* data,
+                  size_t bytes,
+                  bool persistent,
+                  uint64_t seed) {
+  if (persistent) {
+    return vx::delegate::utils::Fnv1aHash(data, bytes, seed);
+  }
+  return vx::delegate::utils::Fnv1aHashValue(
+      vx::delegate::utils::Checksum(data, bytes), seed);
+}
+
+// Hashes what a compiled graph depends on besides the dims of non-constant
+// tensors, which are hashed per shape by HashDims.
+uint64_t HashTensor(const TfLiteTensor& tensor,
+                    bool persistent,
+                    uint64_t seed) {
+  using vx::delegate::utils::Fnv1aHash;
+  using vx::delegate::utils::Fnv1aHashValue;
+  uint64_t hash = Fnv1aHashValue(tensor.type, seed);
+  hash = Fnv1aHashValue(tensor.allocation_type == kTfLiteMmapRo, hash);
+  hash = Fnv1aHashValue(tensor.is_variable, hash);
+  hash = Fnv1aHashValue(tensor.quantization.type, hash);
+  if (tensor.quantization.type == kTfLiteAffineQuantization) {
+    const TfLiteAffineQuantization* params =
+        reinterpret_cast<const TfLiteAffineQuantization*>(
+            tensor.quantization.params);
+    hash = Fnv1aHash(
+        params->scale->data, params->scale->size * sizeof(float), hash);
+    hash = Fnv1aHash(params->zero_point->data,
+                     params->zero_point->size * sizeof(int),
+                     hash);
+    hash = Fnv1aHashValue(params->quantized_dimension, hash);
+  }
+  if (tensor.allocation_type == kTfLiteMmapRo) {
+    hash = HashDims(tensor, hash);
+    if (tensor.data.raw_const != nullptr) {
+      hash = HashData(tensor.data.raw_const, tensor.bytes, persistent, hash);
+    }
+  }
+  return hash;
+}
+
+// Layout of a cached compiled graph file:
+//   magic, uint32 input count, int32 input tensor indexes,
+//   uint32 output count, int32 output tensor indexes, NBG binary.
+// The tensor indexes record the NBG port order of the compiled graph.
+void AppendIndexes(std::vector<char>& data,
+                   const std::vector<int32_t>& indexes) {
+  uint32_t count = indexes.size();
+  const char* count_bytes = reinterpret_cast<const char*>(&count);
+  data.insert(data.end(), count_bytes, count_bytes + sizeof(count));
+  const char* index_bytes = reinterpret_cast<const char*>(indexes.data());
+  data.insert(
+      data.end(), index_bytes, index_bytes + count * sizeof(int32_t));
+}
+
+bool ReadIndexes(const std::vector<char>& data,
+                 size_t& offset,
+                 std::vector<int32_t>& indexes) {
+  uint32_t count = 0;
+  if (offset + sizeof(count) > data.size()) {
+    return false;
+  }
+  memcpy(&count, data.data() + offset, sizeof(count));
+  offset += sizeof(count);
+  if (offset + count * sizeof(int32_t) > data.size()) {
+    return false;
+  }
+  indexes.resize(count);
+  memcpy(indexes.data(), data.data() + offset, count * sizeof(int32_t));
+  offset += count * sizeof(int32_t);
+  return true;
+}
+
+// True if `indexes` holds exactly the tensors of `expected`, in any order.
+bool SameTensorSet(std::vector<int32_t> indexes, std::vector<int> expected) {
+  std::sort(indexes.begin(), indexes.end());
+  std::sort(expected.begin(), expected.end());
+  return std::equal(
+      indexes.begin(), indexes.end(), expected.begin(), expected.end());
+}
+
+// What a background compile sees of the interpreter: its tensors, execution
+// plan, and the plan's nodes and registrations, copied on the interpreter
+// thread. The snapshot's context serves them without reaching the live
+// subgraph and leaves every other callback null.
+class ContextSnapshot {
+ public:
+  explicit ContextSnapshot(TfLiteContext* context)
+      : tensors_(context->tensors, context->tensors + context->tensors_size),
+        plan_(nullptr) {
+    for (auto& tensor : tensors_) {
+      tensor.dims = TfLiteIntArrayCopy(tensor.dims);
+    }
+    TfLiteIntArray* plan;
+    if (context->GetExecutionPlan(context, &plan) == kTfLiteOk) {
+      plan_ = TfLiteIntArrayCopy(plan);
+      for (int node_index : tflite::TfLiteIntArrayView(plan)) {
+        TfLiteNode* node;
+        TfLiteRegistration* registration;
+        if (context->GetNodeAndRegistration(
+                context, node_index, &node, &registration) != kTfLiteOk) {
+          continue;
+        }
+        NodeAndRegistration& copy = nodes_[node_index];
+        copy.first = *node;
+        copy.first.inputs = TfLiteIntArrayCopy(node->inputs);
+        copy.first.outputs = TfLiteIntArrayCopy(node->outputs);
+        copy.first.intermediates = TfLiteIntArrayCopy(node->intermediates);
+        copy.first.temporaries = TfLiteIntArrayCopy(node->temporaries);
+        copy.second = *registration;
+      }
+    }
+    memset(&context_, 0, sizeof(context_));
+    context_.tensors_size = tensors_.size();
+    context_.tensors = tensors_.data();
+    context_.impl_ = this;
+    context_.recommended_num_threads = context->recommended_num_threads;
+    context_.allow_fp32_relax_to_fp16 = context->allow_fp32_relax_to_fp16;
+    context_.GetExecutionPlan = GetExecutionPlan;
+    context_.GetNodeAndRegistration = GetNodeAndRegistration;
+    context_.ReportError = ReportError;
+  }
+
+  ~ContextSnapshot() {
+    for (auto& tensor : tensors_) {
+      TfLiteIntArrayFree(tensor.dims);
+    }
+    TfLiteIntArrayFree(plan_);
+    for (auto& node : nodes_) {
+      TfLiteIntArrayFree(node.second.first.inputs);
+      TfLiteIntArrayFree(node.second.first.outputs);
+      TfLiteIntArrayFree(node.second.first.intermediates);
+      TfLiteIntArrayFree(node.second.first.temporaries);
+    }
+  }
+
+  TfLiteContext* context() { return &context_; }
+
+ private:
+  using NodeAndRegistration = std::pair<TfLiteNode, TfLiteRegistration>;
+
+  static TfLiteStatus GetExecutionPlan(TfLiteContext* context,
+                                       TfLiteIntArray** plan) {
+    auto* snapshot = static_cast<ContextSnapshot*>(context->impl_);
+    if (snapshot->plan_ == nullptr) {
+      return kTfLiteError;
+    }
+    *plan = snapshot->plan_;
+    return kTfLiteOk;
+  }
+
+  static TfLiteStatus GetNodeAndRegistration(
+      TfLiteContext* context,
+      int node_index,
+      TfLiteNode** node,
+      TfLiteRegistration** registration) {
+    auto* snapshot = static_cast<ContextSnapshot*>(context->impl_);
+    auto it = snapshot->nodes_.find(node_index);
+    if (it == snapshot->nodes_.end()) {
+      return kTfLiteError;
+    }
+    *node = &it->second.first;
+    *registration = &it->second.second;
+    return kTfLiteOk;
+  }
+
+  static void ReportError(TfLiteContext* context, const char* format, ...) {
+    char message[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    TFLITE_LOG(ERROR) << message;
+  }
+
+  TfLiteContext context_;
+  std::vector<TfLiteTensor> tensors_;
+  TfLiteIntArray* plan_;
+  std::map<int, NodeAndRegistration> nodes_;
+};
+
 }  // namespace
 
 namespace vx {
 namespace delegate {
 VxDelegateOptions VxDelegateOptionsDefault() {
   VxDelegateOptions options = {0};
+  options.max_cached_graphs = 4;
+  options.pipeline_depth = 1;
   return options;
 }
 
+std::unique_ptr<CompiledGraph> CompiledGraphCache::Take(uint64_t key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto it = graphs_.begin(); it != graphs_.end(); ++it) {
+    if (it->first == key) {
+      std::unique_ptr<CompiledGraph> graph = std::move(it->second);
+      graphs_.erase(it);
+      return graph;
+    }
+  }
+  return nullptr;
+}
+
+void CompiledGraphCache::Put(uint64_t key,
+                             std::unique_ptr<CompiledGraph> graph) {
+  std::unique_ptr<CompiledGraph> evicted;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    graphs_.emplace_front(key, std::move(graph));
+    if (graphs_.size() > capacity_) {
+      evicted = std::move(graphs_.back().second);
+      graphs_.pop_back();
+    }
+  }
+  // Release the evicted graph outside the lock.
+}
+
+CompiledGraph::~CompiledGraph() {
+  if (context_mutex == nullptr) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(*context_mutex);
+  ops.clear();
+  state_tensors.clear();
+  tensors.clear();
+  layout_infered.second.clear();
+  layout_infered.first.reset();
+  graph.reset();
+  context.reset();
+}
+
+std::shared_ptr<tim::vx::Context> DelegateData::GetContext() {
+  if (!vx_context) {
+    vx_context = TrackLive(tim::vx::Context::Create(), live_contexts);
+  }
+  return vx_context;
+}
+
+TfLiteBufferHandle DelegateData::RegisterBuffer(void* data, size_t bytes) {
+  std::lock_guard<std::mutex> lock(buffers_mutex);
+  TfLiteBufferHandle handle = next_buffer_handle++;
+  buffers[handle] = {data, bytes};
+  return handle;
+}
+
+bool DelegateData::LookupBuffer(TfLiteBufferHandle handle, Buffer* buffer) {
+  std::lock_guard<std::mutex> lock(buffers_mutex);
+  auto it = buffers.find(handle);
+  if (it == buffers.end()) {
+    return false;
+  }
+  *buffer = it->second;
+  return true;
+}
+
+void DelegateData::ReleaseBuffer(TfLiteBufferHandle handle) {
+  {
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    buffers.erase(handle);
+  }
+  std::lock_guard<std::mutex> lock(async_mutex);
+  auto it = async_writes.find(handle);
+  if (it != async_writes.end() && it->second.pending == 0) {
+    async_writes.erase(it);
+  }
+}
+
+void DelegateData::BeginAsyncRun(
+    const std::vector<TfLiteBufferHandle>& handles) {
+  std::lock_guard<std::mutex> lock(async_mutex);
+  for (TfLiteBufferHandle handle : handles) {
+    async_writes[handle].pending++;
+  }
+  pending_async_runs++;
+}
+
+void DelegateData::EndAsyncRun(const std::vector<TfLiteBufferHandle>& handles,
+                               TfLiteStatus status) {
+  VxDelegateCompletionCallback callback;
+  void* user_data;
+  {
+    std::lock_guard<std::mutex> lock(async_mutex);
+    callback = completion_callback;
+    user_data = completion_user_data;
+  }
+  // Before the run stops counting as pending, so that waiters also wait for
+  // the callback.
+  if (callback != nullptr) {
+    callback(user_data, status);
+  }
+  std::lock_guard<std::mutex> lock(async_mutex);
+  for (TfLiteBufferHandle handle : handles) {
+    AsyncWrites& writes = async_writes[handle];
+    writes.pending--;
+    writes.status = status;
+  }
+  pending_async_runs--;
+  async_cv.notify_all();
+}
+
+TfLiteStatus DelegateData::WaitForBuffer(TfLiteBufferHandle handle) {
+  std::unique_lock<std::mutex> lock(async_mutex);
+  // The handle may be released while waiting, which erases its entry.
+  async_cv.wait(lock, [this, handle]() {
+    auto it = async_writes.find(handle);
+    return it == async_writes.end() || it->second.pending == 0;
+  });
+  auto it = async_writes.find(handle);
+  return it == async_writes.end() ? kTfLiteOk : it->second.status;
+}
+
+TfLiteStatus DelegateData::WaitForAsyncRuns() {
+  std::unique_lock<std::mutex> lock(async_mutex);
+  async_cv.wait(lock, [this]() { return pending_async_runs == 0; });
+  for (const auto& handle_and_writes : async_writes) {
+    if (handle_and_writes.second.status != kTfLiteOk) {
+      return handle_and_writes.second.status;
+    }
+  }
+  return kTfLiteOk;
+}
+
+void DelegateData::SetCompletionCallback(
+    VxDelegateCompletionCallback callback, void* user_data) {
+  std::lock_guard<std::mutex> lock(async_mutex);
+  completion_callback = callback;
+  completion_user_data = user_data;
+}
+
+DelegateData::DelegateData(const VxDelegateOptions& options)
+    : options(options),
+      cache_dir(options.cache_dir ? options.cache_dir : ""),
+      profile_path(options.profile_path ? options.profile_path : ""),
+      trace_file(options.trace_file ? options.trace_file : ""),
+      coverage_file(options.coverage_file ? options.coverage_file : ""),
+      graph_cache(std::max(options.max_cached_graphs, 0)) {
+  this->options.cache_dir = cache_dir.c_str();
+  this->options.profile_path = profile_path.c_str();
+  this->options.trace_file = trace_file.c_str();
+  this->options.coverage_file = coverage_file.c_str();
+  if (!profile_path.empty()) {
+    if (profile.Load(profile_path)) {
+      TFLITE_LOG(INFO) << "Loaded partition profile " << profile_path;
+    } else if (!options.calibrate) {
+      TFLITE_LOG(WARN) << "Failed to read partition profile " << profile_path;
+    }
+  }
+}
+
+// The delegate VxDelegate() returns, which lives as long as the process.
+static std::atomic<TfLiteDelegate*> shared_delegate{nullptr};
+
 TfLiteDelegate* VxDelegate() {
-  static TfLiteDelegate* delegate = vx::delegate::Delegate::Create();
+  static TfLiteDelegate* delegate =
+      vx::delegate::Delegate::Create(VxDelegateOptionsDefault());
+  shared_delegate = delegate;
   return delegate;
 }
 
 TfLiteDelegate* VxDelegateCreate(const VxDelegateOptions* options) {
-  return VxDelegate();
+  if (options == nullptr) {
+    return Delegate::Create(VxDelegateOptionsDefault());
+  }
+  return Delegate::Create(*options);
 }
 
 void VxDelegateDelete(TfLiteDelegate* delegate) {
   if (delegate == nullptr) return;
+  if (delegate == shared_delegate) {
+    TFLITE_LOG(ERROR) << "Not deleting the delegate of VxDelegate(), which "
+                         "lives as long as the process";
+    return;
+  }
 
+  auto* delegate_data = reinterpret_cast<DelegateData*>(delegate->data_);
+  if (delegate_data->options.calibrate &&
+      !delegate_data->profile_path.empty()) {
+    if (delegate_data->profile.Save(delegate_data->profile_path)) {
+      TFLITE_LOG(INFO) << "Saved partition profile "
+                       << delegate_data->profile_path;
+    } else {
+      TFLITE_LOG(ERROR) << "Failed to save partition profile "
+                        << delegate_data->profile_path;
+    }
+  }
+  if (!delegate_data->trace_file.empty()) {
+    if (trace::DumpChromeTrace(delegate_data->trace_file)) {
+      TFLITE_LOG(INFO) << "Wrote trace to " << delegate_data->trace_file;
+    }
+  }
+  delete delegate_data;
   delete delegate;
   delegate = nullptr;
 }
 
+TfLiteBufferHandle VxDelegateRegisterBufferHandle(TfLiteDelegate* delegate,
+                                                  void* data,
+                                                  size_t bytes) {
+  if (delegate == nullptr || delegate->data_ == nullptr || data == nullptr) {
+    return kTfLiteNullBufferHandle;
+  }
+  return reinterpret_cast<DelegateData*>(delegate->data_)
+      ->RegisterBuffer(data, bytes);
+}
+
+uint64_t VxDelegateGetSkippedInputBytes(const TfLiteDelegate* delegate) {
+  if (delegate == nullptr || delegate->data_ == nullptr) return 0;
+
+  return reinterpret_cast<const DelegateData*>(delegate->data_)
+      ->skipped_input_bytes.load();
+}
+
+void VxDelegateSetCompletionCallback(TfLiteDelegate* delegate,
+                                     VxDelegateCompletionCallback callback,
+                                     void* user_data) {
+  if (delegate == nullptr || delegate->data_ == nullptr) return;
+
+  reinterpret_cast<DelegateData*>(delegate->data_)
+      ->SetCompletionCallback(callback, user_data);
+}
+
+TfLiteStatus VxDelegateWaitForCompletion(TfLiteDelegate* delegate) {
+  if (delegate == nullptr || delegate->data_ == nullptr) return kTfLiteError;
+
+  return reinterpret_cast<DelegateData*>(delegate->data_)->WaitForAsyncRuns();
+}
+
+bool VxDelegateDumpTrace(const char* path) {
+  if (path == nullptr) return false;
+
+  return trace::DumpToFile(path);
+}
+
+bool VxDelegateDumpChromeTrace(const char* path) {
+  if (path == nullptr) return false;
+
+  return trace::DumpChromeTrace(path);
+}
+
+TfLiteStatus VxDelegateGetStats(const TfLiteDelegate* delegate,
+                                VxDelegateStats* stats) {
+  if (delegate == nullptr || delegate->data_ == nullptr || stats == nullptr) {
+    return kTfLiteError;
+  }
+
+  auto* delegate_data = reinterpret_cast<DelegateData*>(delegate->data_);
+  DelegateStats& source = delegate_data->stats;
+  auto latency = [](const LatencyHistogram& histogram) {
+    VxDelegateLatencyStats latency;
+    latency.count = histogram.count();
+    latency.total_us = histogram.total_ns() / 1000.0;
+    latency.p50_us = histogram.Percentile(50) / 1000.0;
+    latency.p90_us = histogram.Percentile(90) / 1000.0;
+    latency.p99_us = histogram.Percentile(99) / 1000.0;
+    return latency;
+  };
+  stats->invokes = source.invokes.load(std::memory_order_relaxed);
+  stats->fallback_invokes = delegate_data->fallback_invokes.load();
+  stats->copy_in = latency(source.copy_in);
+  stats->run = latency(source.run);
+  stats->copy_out = latency(source.copy_out);
+  stats->bytes_in = source.bytes_in.load(std::memory_order_relaxed);
+  stats->bytes_out = source.bytes_out.load(std::memory_order_relaxed);
+  stats->skipped_input_bytes = delegate_data->skipped_input_bytes.load();
+  stats->partitions = source.partitions.load();
+  stats->delegated_nodes = source.delegated_nodes.load();
+  stats->total_nodes = source.total_nodes.load();
+  std::lock_guard<std::mutex> lock(source.compile_mutex);
+  stats->compiled_partitions = source.compiles.size();
+  uint64_t compile_ns = 0;
+  for (const auto& kv : source.compiles) {
+    compile_ns += kv.second.compile_ns;
+  }
+  stats->compile_ms = compile_ns / 1e6;
+  stats->failed_compiles = source.failed_compiles.load();
+  return kTfLiteOk;
+}
+
+TfLiteStatus VxDelegateGetPartitionStats(const TfLiteDelegate* delegate,
+                                         int index,
+                                         VxDelegatePartitionStats* stats) {
+  if (delegate == nullptr || delegate->data_ == nullptr || stats == nullptr) {
+    return kTfLiteError;
+  }
+
+  DelegateStats& source =
+      reinterpret_cast<DelegateData*>(delegate->data_)->stats;
+  std::lock_guard<std::mutex> lock(source.compile_mutex);
+  if (index < 0 || index >= static_cast<int>(source.compiles.size())) {
+    return kTfLiteError;
+  }
+  auto it = std::next(source.compiles.begin(), index);
+  stats->partition_id = it->first;
+  stats->nodes = it->second.nodes;
+  stats->folded_ops = it->second.passes.folded_ops;
+  stats->fused_activations = it->second.passes.fused_activations;
+  stats->removed_converts = it->second.passes.removed_converts;
+  stats->removed_reshapes = it->second.passes.removed_reshapes;
+  stats->aliased_reshapes = it->second.aliased_reshapes;
+  stats->compiles = it->second.compiles;
+  stats->compile_ms = it->second.compile_ns / 1e6;
+  stats->build_ms = it->second.build_ns / 1e6;
+  return kTfLiteOk;
+}
+
+void VxDelegateResetStats(TfLiteDelegate* delegate) {
+  if (delegate == nullptr || delegate->data_ == nullptr) return;
+
+  auto* delegate_data = reinterpret_cast<DelegateData*>(delegate->data_);
+  delegate_data->stats.Reset();
+  delegate_data->fallback_invokes = 0;
+  delegate_data->skipped_input_bytes = 0;
+}
+
+bool VxDelegateWriteCoverageReport(const TfLiteDelegate* delegate,
+                                   const char* path) {
+  if (delegate == nullptr || delegate->data_ == nullptr || path == nullptr) {
+    return false;
+  }
+
+  auto* delegate_data = reinterpret_cast<DelegateData*>(delegate->data_);
+  std::vector<char> report;
+  {
+    std::lock_guard<std::mutex> lock(delegate_data->coverage_mutex);
+    report.assign(delegate_data->coverage_report.begin(),
+                  delegate_data->coverage_report.end());
+  }
+  return !report.empty() && utils::WriteFileAtomic(path, report);
+}
+
+int64_t VxDelegateGetLiveContextCount() { return live_contexts.load(); }
+
+int64_t VxDelegateGetLiveGraphCount() { return live_graphs.load(); }
+
+uint64_t VxDelegateGetFallbackInvokeCount(const TfLiteDelegate* delegate) {
+  if (delegate == nullptr || delegate->data_ == nullptr) return 0;
+
+  return reinterpret_cast<const DelegateData*>(delegate->data_)
+      ->fallback_invokes.load();
+}
+
 bool Delegate::SupportedOp(TfLiteContext* context,
                            TfLiteNode* node,
-                           const TfLiteRegistration* registration) {
+                           const TfLiteRegistration* registration,
+                           std::string* reason) {
   if (registration->custom_name != nullptr) {
     const auto& supported_custom_ops = vx::op_map::SupportedBuiltinCustomOps();
     const auto& it = supported_custom_ops.find(registration->custom_name);
     if (supported_custom_ops.end() != it) {
-      return it->second->IsSupported(context, node, registration);
+      return it->second->IsSupported(context, node, registration, reason);
     }
   }
 
@@ -355,19 +1052,25 @@ bool Delegate::SupportedOp(TfLiteContext* context,
   const auto& it = supported_builtins.find(
       static_cast<TfLiteBuiltinOperator>(registration->builtin_code));
   if (supported_builtins.end() != it) {
-    return it->second->IsSupported(context, node, registration);
+    return it->second->IsSupported(context, node, registration, reason);
   }
 
-  TFLITE_LOG(ERROR) << "Fallback unsupported op " << registration->builtin_code
-             << " to TfLite";
-
+  *reason = "no op mapper";
   return false;
 }
 
-TfLiteDelegate* Delegate::Create() {
+TfLiteDelegate* Delegate::Create(const VxDelegateOptions& options) {
   TfLiteDelegate* delegate = new TfLiteDelegate();
 
   std::memset(delegate, 0, sizeof(TfLiteDelegate));
+  delegate->data_ = new DelegateData(options);
+  if (options.trace_level > 0) {
+    trace::SetLevel(options.trace_level);
+  }
+  if (options.trace_file != nullptr && options.trace_file[0] != '\0' &&
+      !trace::Enabled(trace::kVerbose)) {
+    trace::SetLevel(trace::kVerbose);
+  }
   delegate->flags = kTfLiteDelegateFlagsNone;
   delegate->Prepare = &PrepareDelegate;
   delegate->CopyFromBufferHandle = &CopyFromBufferHandle;
@@ -379,10 +1082,20 @@ TfLiteDelegate* Delegate::Create() {
 std::unique_ptr<vx::delegate::OpData> Delegate::Init(
     TfLiteContext* context, const TfLiteDelegateParams* params) {
   TFLITE_LOG(INFO) << "vx_delegate Delegate::Init";
+  partition_id_ = next_partition_id++;
+  VX_TRACE_PARTITION(partition_id_);
+  VX_TRACE_SCOPE(trace::kInvoke,
+                 "init",
+                 "Delegate::Init",
+                 params->nodes_to_replace->size);
 
   compiled_ = false;
-  tensors_.resize(context->tensors_size + 1 /* for placeholder*/);
-  state_tensors_.resize(context->tensors_size + 1 /* for placeholder*/);
+  fallback_invokes_ = 0;
+  delegate_data_ = reinterpret_cast<DelegateData*>(params->delegate->data_);
+  profile_key_ = PartitionProfileKey(context, *params);
+  first_node_ = params->nodes_to_replace->data[0];
+  calibration_runner_.reset();
+  calibration_invokes_ = 0;
 
   std::unique_ptr<vx::delegate::OpData> op_data(new OpData());
   // Get the list of input and output tensors. This isn't for a single op, it's
@@ -399,6 +1112,8 @@ std::unique_ptr<vx::delegate::OpData> Delegate::Init(
   std::copy(output_tensors.begin(),
             output_tensors.end(),
             std::back_inserter(op_data->subgraph_outputs));
+  op_data->profiling_string =
+      PartitionLabel(context, params->nodes_to_replace);
 
   const auto& supported_customs = vx::op_map::SupportedBuiltinCustomOps();
   const auto& supported_builtins = vx::op_map::SupportedBuiltinOps();
@@ -417,6 +1132,10 @@ std::unique_ptr<vx::delegate::OpData> Delegate::Init(
       operation.custom_name = reg->custom_name;
     }
     operation.builtin_code = reg->builtin_code;
+    operation.registration = *reg;
+    operation.custom_initial_data =
+        reinterpret_cast<const char*>(node->custom_initial_data);
+    operation.custom_initial_data_size = node->custom_initial_data_size;
     bool isbuiltinOp = operation.custom_name.empty();
     std::copy(
         inputs.begin(), inputs.end(), std::back_inserter(operation.inputs));
@@ -452,177 +1171,994 @@ std::unique_ptr<vx::delegate::OpData> Delegate::Init(
     }
   }
 
+  graph_passes_ =
+      RunGraphPasses(context, *op_data, &operations_, &folded_constants_);
+  {
+    std::lock_guard<std::mutex> lock(delegate_data_->coverage_mutex);
+    auto nodes = tflite::TfLiteIntArrayView(params->nodes_to_replace);
+    delegate_data_->kernel_passes.push_back(
+        {std::vector<int>(nodes.begin(), nodes.end()), graph_passes_});
+  }
+  if (graph_passes_.folded_ops > 0) {
+    TFLITE_LOG(INFO) << "Folded " << graph_passes_.folded_ops
+                     << " ops with constant inputs in "
+                     << op_data->profiling_string;
+  }
+  if (graph_passes_.removed_reshapes > 0) {
+    TFLITE_LOG(INFO) << "Removed " << graph_passes_.removed_reshapes
+                     << " Reshape/Squeeze/ExpandDims ops from "
+                     << op_data->profiling_string;
+  }
+  if (graph_passes_.removed_converts > 0) {
+    TFLITE_LOG(INFO) << "Removed " << graph_passes_.removed_converts
+                     << " Quantize/Dequantize ops from "
+                     << op_data->profiling_string;
+  }
+  if (graph_passes_.fused_activations > 0) {
+    TFLITE_LOG(INFO) << "Folded " << graph_passes_.fused_activations
+                     << " fused activations into the output quantization of "
+                     << op_data->profiling_string;
+  }
+
+  // Everything but the non-constant dims goes into the signature, so a
+  // resized partition can be matched against the graphs compiled before.
+  using vx::delegate::utils::Fnv1aHash;
+  using vx::delegate::utils::Fnv1aHashValue;
+  partition_signature_ = Fnv1aHash(kCompiledGraphCacheVersion,
+                                   strlen(kCompiledGraphCacheVersion));
+  const bool persistent = !delegate_data_->cache_dir.empty();
+  cacheable_ = op_data->subgraph_states.empty();
+  has_custom_ops_ = false;
+  shape_tensors_.clear();
+  auto hash_tensor_indexes = [&](const std::vector<int>& indexes) {
+    partition_signature_ =
+        Fnv1aHashValue(indexes.size(), partition_signature_);
+    for (int tensor_idx : indexes) {
+      partition_signature_ = Fnv1aHashValue(tensor_idx, partition_signature_);
+      if (tensor_idx < 0) {
+        continue;
+      }
+      const TfLiteTensor& tensor = context->tensors[tensor_idx];
+      cacheable_ = cacheable_ && !IsVariableTensor(&tensor);
+      partition_signature_ =
+          HashTensor(tensor, persistent, partition_signature_);
+      if (tensor.allocation_type != kTfLiteMmapRo) {
+        shape_tensors_.push_back(tensor_idx);
+      }
+    }
+  };
+  hash_tensor_indexes(op_data->subgraph_inputs);
+  hash_tensor_indexes(op_data->subgraph_outputs);
+  for (const auto& op_info : operations_) {
+    has_custom_ops_ = has_custom_ops_ || !op_info.custom_name.empty();
+    partition_signature_ =
+        Fnv1aHashValue(op_info.builtin_code, partition_signature_);
+    partition_signature_ = Fnv1aHash(op_info.custom_name.data(),
+                                     op_info.custom_name.size(),
+                                     partition_signature_);
+    partition_signature_ = Fnv1aHash(op_info.builtin_data.data(),
+                                     op_info.builtin_data.size(),
+                                     partition_signature_);
+    hash_tensor_indexes(op_info.inputs);
+    hash_tensor_indexes(op_info.outputs);
+  }
+  for (const auto& kv : folded_constants_) {
+    partition_signature_ = Fnv1aHashValue(kv.first, partition_signature_);
+    partition_signature_ = HashData(
+        kv.second.data(), kv.second.size(), persistent, partition_signature_);
+  }
+  std::sort(shape_tensors_.begin(), shape_tensors_.end());
+  shape_tensors_.erase(
+      std::unique(shape_tensors_.begin(), shape_tensors_.end()),
+      shape_tensors_.end());
+
   return op_data;
 }
 
 TfLiteStatus Delegate::Prepare(const OpData& op_data,
                                TfLiteContext* context,
                                TfLiteNode* node) {
-  TFLITE_LOG(INFO) << "Delegate::Prepare node:" << node->user_data;
+  VX_TRACE_PARTITION(partition_id_);
+  VX_TRACE_SCOPE(trace::kInvoke, "prepare", "Delegate::Prepare", 0);
+  feeds_delegate_kernels_ = FeedsDelegateKernels(op_data, context, node);
+  // A background compile still running owns current_ and graph_key_.
+  const bool compiling = !JoinCompile(false);
+  uint64_t graph_key = GraphKey(context);
+  if (!has_graph_key_ || graph_key != prepared_key_) {
+    // First Prepare, or the input shapes changed: put the graph for the old
+    // shapes aside and pick up one compiled earlier for the new shapes. A
+    // compile for the old shapes isn't waited for, the graph it produces is
+    // put aside when it is joined.
+    if (executor_) {
+      executor_->Wait();
+    }
+    kernel_runner_.reset();
+    replicas_.clear();
+    replicas_built_ = false;
+    prepared_key_ = graph_key;
+    has_graph_key_ = true;
+    compile_failed_ = false;
+    if (!compiling) {
+      UsePreparedGraph();
+    }
+  }
+
+  // Build and compile eagerly so that the first Invoke runs at steady-state
+  // latency and compile failures surface from ModifyGraphWithDelegate.
+  if (compiling || !compiled_) {
+    if (delegate_data_->options.async_compile) {
+      return CompileAsync(op_data, context);
+    }
+    TF_LITE_ENSURE_STATUS(Compile(op_data, context));
+  }
+  // Compile the pipeline's replicas here too rather than in the first
+  // asynchronous Invoke. Only partitions that may run asynchronously need
+  // them, the output buffer handles are checked when invoking.
+  const VxDelegateOptions& options = delegate_data_->options;
+  if (!replicas_built_ && options.async_invoke && options.pipeline_depth > 1 &&
+      !options.calibrate && !feeds_delegate_kernels_ &&
+      current_->state_bindings.empty()) {
+    BuildReplicas(op_data, context);
+  }
   return kTfLiteOk;
 }
 
-TfLiteStatus Delegate::Invoke(const OpData& op_data,
-                              TfLiteContext* context,
-                              TfLiteNode* node) {
-  TFLITE_LOG(INFO) << "Delegate::Invoke node:" << node->user_data;
-  if (!compiled_) {
-    // TODO(bo): Handling multi-thread use case
-    context_ = tim::vx::Context::Create();
-    graph_ = context_->CreateGraph();
+TfLiteStatus Delegate::CompileAsync(const OpData& op_data,
+                                    TfLiteContext* context) {
+  if (!kernel_runner_) {
+    kernel_runner_ = KernelRunner::Create(context,
+                                          operations_,
+                                          op_data.subgraph_inputs,
+                                          op_data.subgraph_outputs,
+                                          &folded_constants_);
+    if (!kernel_runner_) {
+      TFLITE_LOG(WARN) << "CPU fallback unavailable, compiling synchronously";
+      JoinCompile(true);
+      return compiled_ ? kTfLiteOk : Compile(op_data, context);
+    }
+  }
+  if (compile_thread_.joinable() || compile_failed_) {
+    // Already compiling, for these shapes or for earlier ones that Invoke
+    // follows up on, or compilation failed and the partition stays on the
+    // CPU kernels.
+    return kTfLiteOk;
+  }
 
-    tensors_[tensors_.size() - 1] = graph_->CreateTensorPlaceHolder();
+  // The worker must not touch the interpreter, which may reallocate or
+  // The worker must not touch the interpreter, which may reallocate or
+  // resize its tensors meanwhile, nor op_data, which Prepare only lends. It
+  // compiles from a snapshot and its own copy of the partition's indexes.
+  auto snapshot = std::make_shared<ContextSnapshot>(context);
+  auto partition = std::make_shared<OpData>();
+  partition->subgraph_inputs = op_data.subgraph_inputs;
+  partition->subgraph_outputs = op_data.subgraph_outputs;
+  partition->subgraph_states = op_data.subgraph_states;
+  partition->profiling_string = op_data.profiling_string;
+  compile_done_ = false;
+  compile_thread_ = std::thread([this, snapshot, partition]() {
+    Compile(*partition, snapshot->context());
+    compile_done_ = true;
+  });
+  return kTfLiteOk;
+}
 
-    // Create input tensors
-    for (int tensor_idx : op_data.subgraph_inputs) {
-      if (-1 != tensor_idx && tensors_[tensor_idx].get() == nullptr) {
-        const auto tensor = &(context->tensors[tensor_idx]);
-        tensors_[tensor_idx] =
-            CreateTensor(graph_, tensor, tim::vx::TensorAttribute::INPUT, {});
-      }
+bool Delegate::JoinCompile(bool wait) {
+  if (!compile_thread_.joinable()) {
+    return true;
+  }
+  if (!wait && !compile_done_) {
+    return false;
+  }
+  compile_thread_.join();
+  if (graph_key_ != prepared_key_) {
+    // Compiled for shapes Prepare has moved on from since.
+    UsePreparedGraph();
+  } else if (!compiled_) {
+    compile_failed_ = true;
+    delegate_data_->stats.failed_compiles++;
+    TFLITE_LOG(WARN) << "Background compile of partition " << partition_id_
+                     << " failed, it stays on the CPU kernels for the "
+                     << "current input shapes";
+  }
+  return true;
+}
+
+void Delegate::UsePreparedGraph() {
+  ReleaseGraph();
+  graph_key_ = prepared_key_;
+  if (cacheable_) {
+    current_ = delegate_data_->graph_cache.Take(graph_key_);
+    if (current_) {
+      VX_TRACE(trace::kVerbose, "prepare", "ReuseCachedGraph", 0);
+      compiled_ = true;
     }
+  }
+}
 
-    // Create output tensors
-    for (int tensor_idx : op_data.subgraph_outputs) {
-      if (-1 != tensor_idx && tensors_[tensor_idx].get() == nullptr) {
-        const auto tensor = &(context->tensors[tensor_idx]);
-        tensors_[tensor_idx] =
-            CreateTensor(graph_, tensor, tim::vx::TensorAttribute::OUTPUT, {});
+void Delegate::ResetGraph(TfLiteContext* context) {
+  compiled_ = false;
+  current_.reset(new CompiledGraph());
+  current_->tensors.assign(context->tensors_size + 1 /* for placeholder*/,
+                           nullptr);
+  current_->state_tensors.assign(
+      context->tensors_size + 1 /* for placeholder*/, nullptr);
+}
+
+void Delegate::ReleaseGraph() {
+  if (compiled_ && cacheable_ && current_) {
+    delegate_data_->graph_cache.Put(graph_key_, std::move(current_));
+  }
+  current_.reset();
+  compiled_ = false;
+}
+
+TfLiteStatus Delegate::BufferHandleData(const TfLiteTensor& tensor,
+                                        void** data) {
+  *data = nullptr;
+  if (tensor.buffer_handle == kTfLiteNullBufferHandle ||
+      tensor.delegate == nullptr || tensor.delegate->data_ != delegate_data_) {
+    return kTfLiteOk;
+  }
+  DelegateData::Buffer buffer;
+  if (!delegate_data_->LookupBuffer(tensor.buffer_handle, &buffer) ||
+      buffer.bytes < tensor.bytes) {
+    TFLITE_LOG(ERROR) << "Invalid buffer handle " << tensor.buffer_handle
+                      << " for tensor " << tensor.name;
+    return kTfLiteError;
+  }
+  *data = buffer.data;
+  return kTfLiteOk;
+}
+
+bool Delegate::BuildBindings(const OpData& op_data, TfLiteContext* context) {
+  auto bind = [&](const std::vector<int>& indexes,
+                  const std::vector<std::shared_ptr<tim::vx::Tensor>>& tensors,
+                  std::vector<TensorBinding>& bindings) {
+    const auto& infered_tensors = current_->layout_infered.second;
+    bindings.clear();
+    for (int tensor_idx : indexes) {
+      auto it = infered_tensors.find(tensors[tensor_idx]);
+      if (!tensors[tensor_idx] || it == infered_tensors.end()) {
+        TFLITE_LOG(ERROR) << "No graph tensor for tensor " << tensor_idx;
+        return false;
       }
+      bindings.push_back({tensor_idx,
+                          it->second.get(),
+                          context->tensors[tensor_idx].bytes,
+                          false,
+                          0});
     }
+    return true;
+  };
+  return bind(op_data.subgraph_inputs,
+              current_->tensors,
+              current_->input_bindings) &&
+         bind(op_data.subgraph_outputs,
+              current_->tensors,
+              current_->output_bindings) &&
+         bind(op_data.subgraph_states,
+              current_->state_tensors,
+              current_->state_bindings);
+}
 
-    // create op
-    for (const auto& op_info : operations_) {
-      auto& builtin_code = op_info.builtin_code;
-      auto& custom_name = op_info.custom_name;
-      auto& inputs = op_info.inputs;
-      auto& outputs = op_info.outputs;
-      auto& states = op_info.states;
-      auto& builtin_data = op_info.builtin_data;
+uint64_t Delegate::GraphKey(TfLiteContext* context) const {
+  uint64_t key = vx::delegate::utils::Fnv1aHashValue(context->tensors_size,
+                                                     partition_signature_);
+  for (int tensor_idx : shape_tensors_) {
+    key = HashDims(context->tensors[tensor_idx], key);
+  }
+  return key;
+}
 
-      std::vector<int> inputs_outputs;
-      std::copy(
-          inputs.begin(), inputs.end(), std::back_inserter(inputs_outputs));
-      std::copy(
-          outputs.begin(), outputs.end(), std::back_inserter(inputs_outputs));
-
-      for (size_t port_idx = 0; port_idx < inputs_outputs.size(); port_idx++) {
-        int tensor_idx = inputs_outputs[port_idx];
-        if (-1 != tensor_idx && tensors_[tensor_idx].get() == nullptr) {
-          std::vector<uint32_t> perm;
-          auto tensor = &(context->tensors[tensor_idx]);
-          tim::vx::TensorAttribute attr = tim::vx::TensorAttribute::TRANSIENT;
-          if (IsConstTensor(tensor)) {
-            attr = tim::vx::TensorAttribute::CONSTANT;
-          } else if (IsVariableTensor(tensor)) {
-            attr = tim::vx::TensorAttribute::VARIABLE;
-          } else {
-            attr = tim::vx::TensorAttribute::TRANSIENT;
+std::string Delegate::CompiledGraphCachePath() const {
+  if (delegate_data_ == nullptr || delegate_data_->cache_dir.empty() ||
+      !cacheable_ || has_custom_ops_) {
+    return "";
+  }
+
+  char name[32];
+  snprintf(name, sizeof(name), "%016" PRIx64 ".nbg", graph_key_);
+  return delegate_data_->cache_dir + "/" + name;
+}
+
+bool Delegate::LoadCompiledGraph(const std::string& path,
+                                 const OpData& op_data,
+                                 TfLiteContext* context) {
+  std::vector<char> file_data;
+  if (!vx::delegate::utils::ReadFile(path, file_data)) {
+    return false;
+  }
+
+  size_t offset = sizeof(kCompiledGraphCacheMagic);
+  std::vector<int32_t> input_indexes;
+  std::vector<int32_t> output_indexes;
+  if (file_data.size() < offset ||
+      memcmp(file_data.data(), kCompiledGraphCacheMagic, offset) != 0 ||
+      !ReadIndexes(file_data, offset, input_indexes) ||
+      !ReadIndexes(file_data, offset, output_indexes) ||
+      offset == file_data.size() ||
+      !SameTensorSet(input_indexes, op_data.subgraph_inputs) ||
+      !SameTensorSet(output_indexes, op_data.subgraph_outputs)) {
+    TFLITE_LOG(WARN) << "Ignoring invalid compiled graph cache " << path;
+    return false;
+  }
+
+  ResetGraph(context);
+  {
+    std::lock_guard<std::mutex> lock(delegate_data_->context_mutex);
+    current_->context_mutex = &delegate_data_->context_mutex;
+    current_->context = delegate_data_->GetContext();
+    current_->graph = TrackLive(current_->context->CreateGraph(), live_graphs);
+  }
+  current_->nbg_binary.assign(file_data.begin() + offset, file_data.end());
+
+  std::vector<std::shared_ptr<tim::vx::Tensor>> inputs;
+  for (int tensor_idx : input_indexes) {
+    current_->tensors[tensor_idx] =
+        CreateTensor(current_->graph,
+                     &context->tensors[tensor_idx],
+                     tim::vx::TensorAttribute::INPUT,
+                     {});
+    inputs.push_back(current_->tensors[tensor_idx]);
+  }
+  std::vector<std::shared_ptr<tim::vx::Tensor>> outputs;
+  for (int tensor_idx : output_indexes) {
+    current_->tensors[tensor_idx] =
+        CreateTensor(current_->graph,
+                     &context->tensors[tensor_idx],
+                     tim::vx::TensorAttribute::OUTPUT,
+                     {});
+    outputs.push_back(current_->tensors[tensor_idx]);
+  }
+
+  auto op = current_->graph->CreateOperation<tim::vx::ops::NBG>(
+      current_->nbg_binary.data(), inputs.size(), outputs.size());
+  (*op).BindInputs(inputs).BindOutputs(outputs);
+  current_->ops.push_back(std::move(op));
+
+  // The NBG already has the inferred layout, so tensors map onto themselves.
+  current_->layout_infered.first = current_->graph;
+  for (const auto& tensor : inputs) {
+    current_->layout_infered.second[tensor] = tensor;
+  }
+  for (const auto& tensor : outputs) {
+    current_->layout_infered.second[tensor] = tensor;
+  }
+
+  bool compiled;
+  {
+    std::lock_guard<std::mutex> lock(delegate_data_->context_mutex);
+    compiled = current_->graph->Compile();
+  }
+  if (!compiled || !BuildBindings(op_data, context)) {
+    TFLITE_LOG(WARN) << "Failed to compile cached graph " << path;
+    ResetGraph(context);
+    return false;
+  }
+  compiled_ = true;
+  return true;
+}
+
+void Delegate::SaveCompiledGraph(const std::string& path,
+                                 const OpData& op_data) {
+  // Map the compiled graph's ports back to TfLite tensor indexes.
+  std::map<const tim::vx::Tensor*, int32_t> infered_to_index;
+  const auto& infered_tensors = current_->layout_infered.second;
+  for (const auto* indexes :
+       {&op_data.subgraph_inputs, &op_data.subgraph_outputs}) {
+    for (int tensor_idx : *indexes) {
+      auto it = infered_tensors.find(current_->tensors[tensor_idx]);
+      if (it != infered_tensors.end()) {
+        infered_to_index[it->second.get()] = tensor_idx;
+      }
+    }
+  }
+  auto port_indexes =
+      [&](const std::vector<std::shared_ptr<tim::vx::Tensor>>& ports,
+          std::vector<int32_t>& indexes) {
+        for (const auto& port : ports) {
+          auto it = infered_to_index.find(port.get());
+          if (it == infered_to_index.end()) {
+            return false;
           }
-          tensors_[tensor_idx] = CreateTensor(graph_, tensor, attr, perm);
+          indexes.push_back(it->second);
         }
-      }
+        return true;
+      };
+
+  auto& graph = current_->layout_infered.first;
+  std::vector<int32_t> input_indexes;
+  std::vector<int32_t> output_indexes;
+  if (!port_indexes(graph->InputsTensor(), input_indexes) ||
+      !port_indexes(graph->OutputsTensor(), output_indexes)) {
+    TFLITE_LOG(WARN) << "Graph ports don't match the partition, not caching";
+    return;
+  }
+
+  std::vector<char> nbg;
+  size_t nbg_size = 0;
+  {
+    std::lock_guard<std::mutex> lock(delegate_data_->context_mutex);
+    if (!graph->CompileToBinary(nullptr, &nbg_size) || nbg_size == 0) {
+      TFLITE_LOG(WARN) << "Failed to query NBG size, not caching";
+      return;
+    }
+    nbg.resize(nbg_size);
+    if (!graph->CompileToBinary(nbg.data(), &nbg_size)) {
+      TFLITE_LOG(WARN) << "Failed to export NBG, not caching";
+      return;
+    }
+  }
+
+  std::vector<char> file_data(std::begin(kCompiledGraphCacheMagic),
+                              std::end(kCompiledGraphCacheMagic));
+  AppendIndexes(file_data, input_indexes);
+  AppendIndexes(file_data, output_indexes);
+  file_data.insert(file_data.end(), nbg.begin(), nbg.begin() + nbg_size);
+  if (vx::delegate::utils::WriteFileAtomic(path, file_data)) {
+    VX_TRACE(trace::kVerbose, "prepare", "SaveCompiledGraph", nbg_size);
+  }
+}
+
+TfLiteStatus Delegate::Compile(const OpData& op_data, TfLiteContext* context) {
+  // Also runs on compile_thread_.
+  VX_TRACE_PARTITION(partition_id_);
+  VX_TRACE_SCOPE(trace::kInvoke, "prepare", "Delegate::Compile", 0);
+  const uint64_t begin_ns = DelegateStats::Now();
+  uint64_t build_ns = 0;
+  auto record_compile = [&]() {
+    delegate_data_->stats.RecordCompile(partition_id_,
+                                        operations_.size(),
+                                        graph_passes_,
+                                        current_->aliased_reshapes,
+                                        build_ns,
+                                        DelegateStats::Now() - begin_ns);
+  };
+  std::string cache_path = CompiledGraphCachePath();
+  if (!cache_path.empty() && LoadCompiledGraph(cache_path, op_data, context)) {
+    VX_TRACE(trace::kVerbose, "prepare", "LoadCompiledGraph", 0);
+    record_compile();
+    return kTfLiteOk;
+  }
+
+  tflite::Profiler* profiler = GetProfiler(context);
+  {
+    TFLITE_SCOPED_DELEGATE_OPERATOR_PROFILE(
+        profiler, "VxDelegate::BuildGraph", first_node_);
+    BuildGraph(op_data, context);
+  }
+
+  VX_TRACE(trace::kVerbose, "prepare", "VerifyGraph", 0);
+  // Do layout inference and get a new graph(first) and a tensor map(second).
+  {
+    TFLITE_SCOPED_DELEGATE_OPERATOR_PROFILE(
+        profiler, "VxDelegate::LayoutInference", first_node_);
+    VX_TRACE_SCOPE(trace::kInvoke, "prepare", "LayoutInference", 0);
+    // Layout inference creates its graph on the shared context too.
+    std::lock_guard<std::mutex> lock(delegate_data_->context_mutex);
+    current_->layout_infered =
+        tim::transform::LayoutInference(current_->graph, current_->context);
+  }
+  build_ns = DelegateStats::Now() - begin_ns;
+  {
+    TFLITE_SCOPED_DELEGATE_OPERATOR_PROFILE(
+        profiler, "VxDelegate::CompileGraph", first_node_);
+    VX_TRACE_SCOPE(trace::kInvoke, "prepare", "Graph::Compile", 0);
+    std::lock_guard<std::mutex> lock(delegate_data_->context_mutex);
+    if (!current_->layout_infered.first->Compile()) {
+      TFLITE_LOG(ERROR) << "Failed to verify graph";
+      return kTfLiteDelegateError;
+    }
+  }
+
+  if (!BuildBindings(op_data, context)) {
+    return kTfLiteDelegateError;
+  }
+
+  if (!cache_path.empty()) {
+    SaveCompiledGraph(cache_path, op_data);
+  }
+
+  record_compile();
+  compiled_ = true;
+  return kTfLiteOk;
+}
+
+void Delegate::BuildGraph(const OpData& op_data, TfLiteContext* context) {
+  ResetGraph(context);
+  {
+    std::lock_guard<std::mutex> lock(delegate_data_->context_mutex);
+    current_->context_mutex = &delegate_data_->context_mutex;
+    current_->context = delegate_data_->GetContext();
+    current_->graph = TrackLive(current_->context->CreateGraph(), live_graphs);
+  }
+  auto& graph = current_->graph;
+  auto& tensors = current_->tensors;
+  auto& state_tensors = current_->state_tensors;
+
+  tensors[tensors.size() - 1] = graph->CreateTensorPlaceHolder();
+
+  // Create input tensors
+  for (int tensor_idx : op_data.subgraph_inputs) {
+    if (-1 != tensor_idx && tensors[tensor_idx].get() == nullptr) {
+      const auto tensor = &(context->tensors[tensor_idx]);
+      tensors[tensor_idx] =
+          CreateTensor(graph, tensor, tim::vx::TensorAttribute::INPUT, {});
+    }
+  }
 
-      // create state output as graph output
-      for (auto tensor_idx : states) {
-        if (-1 != tensor_idx && state_tensors_[tensor_idx].get() == nullptr) {
-          const auto tensor = &(context->tensors[tensor_idx]);
-          state_tensors_[tensor_idx] = CreateTensor(
-              graph_, tensor, tim::vx::TensorAttribute::OUTPUT, {});
+  // Create output tensors
+  for (int tensor_idx : op_data.subgraph_outputs) {
+    if (-1 != tensor_idx && tensors[tensor_idx].get() == nullptr) {
+      const auto tensor = &(context->tensors[tensor_idx]);
+      tensors[tensor_idx] =
+          CreateTensor(graph, tensor, tim::vx::TensorAttribute::OUTPUT, {});
+    }
+  }
+
+  // create op
+  for (const auto& op_info : operations_) {
+    auto& builtin_code = op_info.builtin_code;
+    auto& custom_name = op_info.custom_name;
+    auto& inputs = op_info.inputs;
+    auto& outputs = op_info.outputs;
+    auto& states = op_info.states;
+    auto& builtin_data = op_info.builtin_data;
+
+    // A reshape to the dims its input already has emits no op, its readers
+    // use the input tensor. Partition outputs, created above, stay ops.
+    if (KeepsDims(context, op_info) && tensors[outputs[0]] == nullptr &&
+        tensors[inputs[0]] != nullptr) {
+      tensors[outputs[0]] = tensors[inputs[0]];
+      current_->aliased_reshapes++;
+      continue;
+    }
+
+    std::vector<int> inputs_outputs;
+    std::copy(
+        inputs.begin(), inputs.end(), std::back_inserter(inputs_outputs));
+    std::copy(
+        outputs.begin(), outputs.end(), std::back_inserter(inputs_outputs));
+
+    for (size_t port_idx = 0; port_idx < inputs_outputs.size(); port_idx++) {
+      int tensor_idx = inputs_outputs[port_idx];
+      if (-1 != tensor_idx && tensors[tensor_idx].get() == nullptr) {
+        std::vector<uint32_t> perm;
+        auto tensor = &(context->tensors[tensor_idx]);
+        auto folded = folded_constants_.find(tensor_idx);
+        if (folded != folded_constants_.end()) {
+          tensors[tensor_idx] = graph->CreateTensor(
+              CreateTensorSpec(
+                  tensor, perm, tim::vx::TensorAttribute::CONSTANT),
+              folded->second.data());
+          continue;
         }
+        tim::vx::TensorAttribute attr = tim::vx::TensorAttribute::TRANSIENT;
+        if (IsConstTensor(tensor)) {
+          attr = tim::vx::TensorAttribute::CONSTANT;
+        } else if (IsVariableTensor(tensor)) {
+          attr = tim::vx::TensorAttribute::VARIABLE;
+        } else {
+          attr = tim::vx::TensorAttribute::TRANSIENT;
+        }
+        tensors[tensor_idx] = CreateTensor(graph, tensor, attr, perm);
       }
+    }
 
-      std::vector<std::shared_ptr<tim::vx::Tensor>> inputs_tensors =
-          MapIndexesToTensors(tensors_, inputs);
-      std::vector<std::shared_ptr<tim::vx::Tensor>> outputs_tensors =
-          MapIndexesToTensors(tensors_, outputs);
-      std::vector<std::shared_ptr<tim::vx::Tensor>> states_tensors =
-          MapIndexesToTensors(state_tensors_, states);
-
-      if (!custom_name.empty()) {
-        vx::op_map::SupportedBuiltinCustomOps()
-            .at(custom_name)
-            ->MapOp(this,
-                    inputs_tensors,
-                    outputs_tensors,
-                    states_tensors,
-                    builtin_data.data());
-      } else {
-        vx::op_map::SupportedBuiltinOps()
-            .at(builtin_code)
-            ->MapOp(this,
-                    inputs_tensors,
-                    outputs_tensors,
-                    states_tensors,
-                    builtin_data.data());
+    // create state output as graph output
+    for (auto tensor_idx : states) {
+      if (-1 != tensor_idx && state_tensors[tensor_idx].get() == nullptr) {
+        const auto tensor = &(context->tensors[tensor_idx]);
+        state_tensors[tensor_idx] = CreateTensor(
+            graph, tensor, tim::vx::TensorAttribute::OUTPUT, {});
       }
     }
 
-    TFLITE_LOG(INFO) << "Verifying graph";
-    // Do layout inference and get a new graph(first) and a tensor map(second).
-    layout_infered_ = tim::transform::LayoutInference(graph_, context_);
-    compiled_ = layout_infered_.first->Compile();
-    if (!compiled_) {
-      TFLITE_LOG(FATAL) << "Failed to verify graph";
-      return kTfLiteDelegateError;
+    std::vector<std::shared_ptr<tim::vx::Tensor>> inputs_tensors =
+        MapIndexesToTensors(tensors, inputs);
+    std::vector<std::shared_ptr<tim::vx::Tensor>> outputs_tensors =
+        MapIndexesToTensors(tensors, outputs);
+    std::vector<std::shared_ptr<tim::vx::Tensor>> states_tensors =
+        MapIndexesToTensors(state_tensors, states);
+
+    // The mapper records the op it creates inside this span.
+    VX_TRACE_SCOPE(trace::kVerbose, "map_op", "MapOp", builtin_code);
+    if (!custom_name.empty()) {
+      vx::op_map::SupportedBuiltinCustomOps()
+          .at(custom_name)
+          ->MapOp(this,
+                  inputs_tensors,
+                  outputs_tensors,
+                  states_tensors,
+                  builtin_data.data());
+    } else {
+      vx::op_map::SupportedBuiltinOps()
+          .at(builtin_code)
+          ->MapOp(this,
+                  inputs_tensors,
+                  outputs_tensors,
+                  states_tensors,
+                  builtin_data.data());
     }
+  }
+}
 
-    TFLITE_LOG(INFO) << "Verified graph";
+TfLiteStatus Delegate::Invoke(const OpData& op_data,
+                              TfLiteContext* context,
+                              TfLiteNode* node) {
+  VX_TRACE_PARTITION(partition_id_);
+  VX_TRACE_SCOPE(trace::kInvoke, "invoke", "Delegate::Invoke", 0);
+  delegate_data_->stats.invokes.fetch_add(1, std::memory_order_relaxed);
+  if (JoinCompile(false) && !compiled_ && kernel_runner_ &&
+      !compile_failed_) {
+    // Joined a compile for input shapes resized since, start the one for
+    // the current shapes.
+    TF_LITE_ENSURE_STATUS(CompileAsync(op_data, context));
+  }
+  if (compile_thread_.joinable() || (!compiled_ && kernel_runner_)) {
+    fallback_invokes_++;
+    delegate_data_->fallback_invokes++;
+    VX_TRACE_SCOPE(trace::kInvoke, "invoke", "InvokeFallback", 0);
+    return InvokeFallback(op_data, context, kernel_runner_.get());
+  }
+  if (!compiled_) {
+    // Prepare normally compiles the graph, this only happens if it failed.
+    TF_LITE_ENSURE_STATUS(Compile(op_data, context));
+  }
+  if (kernel_runner_) {
+    // The background compile has published the graph, retire the fallback.
+    kernel_runner_.reset();
+    TFLITE_LOG(INFO) << "Switched to the NPU graph after " << fallback_invokes_
+                     << " CPU fallback invocations";
   }
 
-  // TODO(derekjchow): Return error if compilation failed.
-  for (int tensor_idx : op_data.subgraph_inputs) {
-    const TfLiteTensor& tf_tensor = context->tensors[tensor_idx];
-    TFLITE_LOG(INFO) << "Copying input " << tensor_idx << ":" << tf_tensor.name;
-    auto src_input_tensor = tensors_[tensor_idx];
-    if (!src_input_tensor.get()) {
-      TFLITE_LOG(FATAL) << "Failed to copy input tensor!";
-    }
+  if (delegate_data_->options.calibrate) {
+    return InvokeCalibrating(op_data, context);
+  }
+  return InvokeGraph(op_data, context);
+}
 
+TfLiteStatus Delegate::InvokeGraph(const OpData& op_data,
+                                   TfLiteContext* context) {
+  std::vector<TfLiteBufferHandle> async_handles;
+  std::vector<void*> async_outputs;
+  const bool async = delegate_data_->options.async_invoke &&
+                     !delegate_data_->options.calibrate &&
+                     AsyncOutputs(context, &async_handles, &async_outputs);
+  if (async && !replicas_built_) {
+    // Only after an `async_compile`, Prepare builds them otherwise.
+    BuildReplicas(op_data, context);
+  }
+  // Synchronous invokes always use current_, asynchronous ones rotate
+  // through the replicas.
+  size_t slot = 0;
+  if (async) {
+    slot = next_slot_;
+    next_slot_ = (slot + 1) % (replicas_.size() + 1);
+  }
+  CompiledGraph& graph = slot == 0 ? *current_ : *replicas_[slot - 1];
+  if (executor_) {
+    // A previous asynchronous run may still be using the graph's tensors.
+    if (async) {
+      executor_->WaitFor(slot_tickets_[slot]);
+    } else {
+      executor_->Wait();
+    }
+  }
+  tflite::Profiler* profiler = GetProfiler(context);
+  DelegateStats& stats = delegate_data_->stats;
+  const bool skip_unchanged = delegate_data_->options.skip_unchanged_inputs;
+  uint64_t skipped_bytes = 0;
+  uint64_t copied_bytes = 0;
+  uint64_t begin_ns = DelegateStats::Now();
+  for (TensorBinding& binding : graph.input_bindings) {
+    const TfLiteTensor& tf_tensor = context->tensors[binding.tensor_index];
+    void* handle_data = nullptr;
+    TF_LITE_ENSURE_STATUS(BufferHandleData(tf_tensor, &handle_data));
     const void* tensor_data =
-        reinterpret_cast<const void*>(tf_tensor.data.raw_const);
+        handle_data ? handle_data
+                    : reinterpret_cast<const void*>(tf_tensor.data.raw_const);
+    if (skip_unchanged) {
+      uint64_t checksum =
+          vx::delegate::utils::Checksum(tensor_data, binding.bytes);
+      if (binding.has_checksum && binding.checksum == checksum) {
+        VX_TRACE(trace::kVerbose, "invoke", "skip_input", binding.bytes);
+        skipped_bytes += binding.bytes;
+        continue;
+      }
+      binding.has_checksum = true;
+      binding.checksum = checksum;
+    }
+    VX_TRACE_SCOPE(trace::kVerbose, "invoke", "copy_input", binding.bytes);
+    TFLITE_SCOPED_DELEGATE_OPERATOR_PROFILE(
+        profiler, "VxDelegate::CopyIn", first_node_);
     // TODO(derekjchow): Check result
-    auto infered_input_tensor = layout_infered_.second[src_input_tensor];
-    infered_input_tensor->CopyDataToTensor(const_cast<void*>(tensor_data));
+    binding.tensor->CopyDataToTensor(const_cast<void*>(tensor_data));
+    copied_bytes += binding.bytes;
   }
 
-  TFLITE_LOG(INFO) << "Invoking graph";
-  if (!layout_infered_.first->Run()) {
-    TFLITE_LOG(FATAL) << "Failed to run graph";
+  if (skipped_bytes > 0) {
+    delegate_data_->skipped_input_bytes += skipped_bytes;
   }
+  uint64_t end_ns = DelegateStats::Now();
+  stats.copy_in.Record(end_ns - begin_ns);
+  stats.bytes_in.fetch_add(copied_bytes, std::memory_order_relaxed);
 
-  for (int tensor_idx : op_data.subgraph_outputs) {
-    TfLiteTensor& tf_tensor = context->tensors[tensor_idx];
-    TFLITE_LOG(INFO) << "Copying output " << tensor_idx << ":" << tf_tensor.name;
-    auto src_output_tensor = tensors_[tensor_idx];
-    if (!src_output_tensor.get()) {
-      TFLITE_LOG(FATAL) << "Failed to copy output tensor!";
+  if (async) {
+    SubmitAsyncRun(&graph, slot, async_handles, async_outputs);
+    return kTfLiteOk;
+  }
+
+  begin_ns = end_ns;
+  {
+    VX_TRACE_SCOPE(trace::kInvoke, "invoke", "Graph::Run", 0);
+    TFLITE_SCOPED_DELEGATE_OPERATOR_PROFILE(
+        profiler, "VxDelegate::Run", first_node_);
+    std::lock_guard<std::mutex> lock(delegate_data_->context_mutex);
+    if (!graph.layout_infered.first->Run()) {
+      TFLITE_LOG(ERROR) << "Failed to run graph";
+      return kTfLiteError;
     }
+  }
+  end_ns = DelegateStats::Now();
+  stats.run.Record(end_ns - begin_ns);
+  begin_ns = end_ns;
+  copied_bytes = 0;
 
+  for (const TensorBinding& binding : graph.output_bindings) {
+    TfLiteTensor& tf_tensor = context->tensors[binding.tensor_index];
     void* tensor_data = reinterpret_cast<void*>(tf_tensor.data.raw);
+    void* handle_data = nullptr;
+    TF_LITE_ENSURE_STATUS(BufferHandleData(tf_tensor, &handle_data));
+    if (handle_data) {
+      // Produced in place, CPU readers copy it out through
+      // CopyFromBufferHandle.
+      tensor_data = handle_data;
+      tf_tensor.data_is_stale = true;
+    }
+    VX_TRACE_SCOPE(trace::kVerbose, "invoke", "copy_output", binding.bytes);
+    TFLITE_SCOPED_DELEGATE_OPERATOR_PROFILE(
+        profiler, "VxDelegate::CopyOut", first_node_);
     // TODO(derekjchow): Check result
-    auto infered_output_tesnor = layout_infered_.second[src_output_tensor];
-    infered_output_tesnor->CopyDataFromTensor(tensor_data);
+    binding.tensor->CopyDataFromTensor(tensor_data);
+    copied_bytes += binding.bytes;
   }
 
   // Copy output states to input states
-  for (int tensor_idx : op_data.subgraph_states) {
-    TfLiteTensor& tf_tensor = context->tensors[tensor_idx];
-    TFLITE_LOG(INFO) << "Copying state " << tensor_idx << ":" << tf_tensor.name;
-    auto src_state_tensor = state_tensors_[tensor_idx];
-    if (!src_state_tensor.get()) {
-      TFLITE_LOG(FATAL) << "Disaster!";
+  for (const TensorBinding& binding : graph.state_bindings) {
+    TfLiteTensor& tf_tensor = context->tensors[binding.tensor_index];
+    VX_TRACE_SCOPE(trace::kVerbose, "invoke", "copy_state", binding.bytes);
+    TFLITE_SCOPED_DELEGATE_OPERATOR_PROFILE(
+        profiler, "VxDelegate::CopyState", first_node_);
+    binding.tensor->CopyDataFromTensor(
+        reinterpret_cast<void*>(tf_tensor.data.raw));
+    copied_bytes += binding.bytes;
+  }
+  stats.copy_out.Record(DelegateStats::Now() - begin_ns);
+  stats.bytes_out.fetch_add(copied_bytes, std::memory_order_relaxed);
+
+  return kTfLiteOk;
+}
+
+bool Delegate::AsyncOutputs(TfLiteContext* context,
+                            std::vector<TfLiteBufferHandle>* handles,
+                            std::vector<void*>* outputs) {
+  const CompiledGraph& graph = *current_;
+  // States are copied back for the next Invoke, and outputs without buffer
+  // handles may be read as soon as Invoke returns. TfLite doesn't make
+  // another partition of the delegate wait for our buffers before reading
+  // them either.
+  if (feeds_delegate_kernels_ || !graph.state_bindings.empty() ||
+      graph.output_bindings.empty()) {
+    return false;
+  }
+  for (const TensorBinding& binding : graph.output_bindings) {
+    const TfLiteTensor& tf_tensor = context->tensors[binding.tensor_index];
+    void* handle_data = nullptr;
+    if (BufferHandleData(tf_tensor, &handle_data) != kTfLiteOk ||
+        handle_data == nullptr) {
+      return false;
     }
+    handles->push_back(tf_tensor.buffer_handle);
+    outputs->push_back(handle_data);
+  }
+  for (const TensorBinding& binding : graph.output_bindings) {
+    context->tensors[binding.tensor_index].data_is_stale = true;
+  }
+  return true;
+}
 
-    void* tensor_data = reinterpret_cast<void*>(tf_tensor.data.raw);
-    auto infered_state_tensor = layout_infered_.second[src_state_tensor];
-    infered_state_tensor->CopyDataFromTensor(tensor_data);
+bool Delegate::FeedsDelegateKernels(const OpData& op_data,
+                                    TfLiteContext* context,
+                                    TfLiteNode* node) const {
+  TfLiteIntArray* plan;
+  if (context->GetExecutionPlan(context, &plan) != kTfLiteOk) {
+    return true;
+  }
+  for (int node_index : tflite::TfLiteIntArrayView(plan)) {
+    TfLiteNode* other;
+    TfLiteRegistration* registration;
+    if (context->GetNodeAndRegistration(
+            context, node_index, &other, &registration) != kTfLiteOk) {
+      return true;
+    }
+    if (other == node || other->delegate != node->delegate) {
+      continue;
+    }
+    for (int tensor_idx : tflite::TfLiteIntArrayView(other->inputs)) {
+      if (std::find(op_data.subgraph_outputs.begin(),
+                    op_data.subgraph_outputs.end(),
+                    tensor_idx) != op_data.subgraph_outputs.end()) {
+        return true;
+      }
+    }
   }
+  return false;
+}
+
+void Delegate::BuildReplicas(const OpData& op_data, TfLiteContext* context) {
+  replicas_built_ = true;
+  std::unique_ptr<CompiledGraph> primary = std::move(current_);
+  const int depth = delegate_data_->options.pipeline_depth;
+  while (static_cast<int>(replicas_.size()) + 1 < depth) {
+    if (Compile(op_data, context) != kTfLiteOk) {
+      TFLITE_LOG(WARN) << "Failed to compile graph replica, pipelining "
+                       << replicas_.size() + 1 << " deep";
+      break;
+    }
+    replicas_.push_back(std::move(current_));
+  }
+  current_ = std::move(primary);
+  compiled_ = true;
+  slot_tickets_.assign(replicas_.size() + 1, 0);
+  next_slot_ = 0;
+}
 
+void Delegate::SubmitAsyncRun(CompiledGraph* graph,
+                              size_t slot,
+                              const std::vector<TfLiteBufferHandle>& handles,
+                              const std::vector<void*>& outputs) {
+  if (!executor_) {
+    executor_.reset(new Executor());
+  }
+  DelegateData* delegate_data = delegate_data_;
+  const int32_t partition_id = partition_id_;
+  delegate_data->BeginAsyncRun(handles);
+  slot_tickets_[slot] = executor_->Submit([=]() {
+    VX_TRACE_PARTITION(partition_id);
+    VX_TRACE_SCOPE(trace::kInvoke, "invoke", "AsyncRun", 0);
+    TfLiteStatus status = kTfLiteOk;
+    DelegateStats& stats = delegate_data->stats;
+    uint64_t begin_ns = DelegateStats::Now();
+    bool ran;
+    {
+      std::lock_guard<std::mutex> lock(delegate_data->context_mutex);
+      ran = graph->layout_infered.first->Run();
+    }
+    if (ran) {
+      uint64_t end_ns = DelegateStats::Now();
+      stats.run.Record(end_ns - begin_ns);
+      uint64_t copied_bytes = 0;
+      for (size_t i = 0; i < outputs.size(); i++) {
+        graph->output_bindings[i].tensor->CopyDataFromTensor(outputs[i]);
+        copied_bytes += graph->output_bindings[i].bytes;
+      }
+      stats.copy_out.Record(DelegateStats::Now() - end_ns);
+      stats.bytes_out.fetch_add(copied_bytes, std::memory_order_relaxed);
+    } else {
+      TFLITE_LOG(ERROR) << "Failed to run graph";
+      status = kTfLiteError;
+    }
+    delegate_data->EndAsyncRun(handles, status);
+  });
+}
+
+TfLiteStatus Delegate::InvokeCalibrating(const OpData& op_data,
+                                         TfLiteContext* context) {
+  if (calibration_invokes_ > kCalibrationSamples) {
+    return InvokeGraph(op_data, context);
+  }
+  if (!calibration_runner_) {
+    calibration_runner_ = KernelRunner::Create(context,
+                                               operations_,
+                                               op_data.subgraph_inputs,
+                                               op_data.subgraph_outputs,
+                                               &folded_constants_);
+    if (!calibration_runner_) {
+      TFLITE_LOG(WARN) << "Partition can't run on the CPU kernels, only "
+                          "timing the NPU";
+    }
+  }
+  // The first invoke warms up both sides and isn't recorded.
+  const bool record = calibration_invokes_++ > 0;
+
+  if (calibration_runner_) {
+    auto begin = std::chrono::steady_clock::now();
+    TF_LITE_ENSURE_STATUS(
+        InvokeFallback(op_data, context, calibration_runner_.get()));
+    if (record) {
+      delegate_data_->profile.Record(
+          profile_key_,
+          false,
+          std::chrono::duration<double, std::micro>(
+              std::chrono::steady_clock::now() - begin)
+              .count());
+    }
+  }
+
+  // The NPU runs last, so its outputs are the ones the model sees.
+  auto begin = std::chrono::steady_clock::now();
+  TF_LITE_ENSURE_STATUS(InvokeGraph(op_data, context));
+  if (record) {
+    delegate_data_->profile.Record(
+        profile_key_,
+        true,
+        std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - begin)
+            .count());
+  }
+  if (calibration_invokes_ > kCalibrationSamples) {
+    calibration_runner_.reset();
+  }
+  return kTfLiteOk;
+}
+
+TfLiteStatus Delegate::InvokeFallback(const OpData& op_data,
+                                      TfLiteContext* context,
+                                      KernelRunner* runner) {
+  // The CPU kernels only see the TfLite buffers, so stage buffer handle
+  // memory through them.
+  for (int tensor_idx : op_data.subgraph_inputs) {
+    TfLiteTensor& tf_tensor = context->tensors[tensor_idx];
+    void* handle_data = nullptr;
+    TF_LITE_ENSURE_STATUS(BufferHandleData(tf_tensor, &handle_data));
+    if (handle_data) {
+      memcpy(tf_tensor.data.raw, handle_data, tf_tensor.bytes);
+    }
+  }
+  TF_LITE_ENSURE_STATUS(runner->Invoke(context));
+  for (int tensor_idx : op_data.subgraph_outputs) {
+    TfLiteTensor& tf_tensor = context->tensors[tensor_idx];
+    void* handle_data = nullptr;
+    TF_LITE_ENSURE_STATUS(BufferHandleData(tf_tensor, &handle_data));
+    if (handle_data) {
+      memcpy(handle_data, tf_tensor.data.raw_const, tf_tensor.bytes);
+      tf_tensor.data_is_stale = false;
+    }
+  }
   return kTfLiteOk;
 }
 
-Delegate::Delegate() {}
+Delegate::Delegate()
+    : delegate_data_(nullptr),
+      partition_signature_(0),
+      cacheable_(false),
+      has_custom_ops_(false),
+      graph_key_(0),
+      prepared_key_(0),
+      has_graph_key_(false),
+      compiled_(false),
+      compile_done_(false),
+      compile_failed_(false),
+      fallback_invokes_(0),
+      replicas_built_(false),
+      feeds_delegate_kernels_(false),
+      next_slot_(0),
+      profile_key_(0),
+      calibration_invokes_(0),
+      first_node_(0),
+      partition_id_(-1) {}
+
+Delegate::~Delegate() {
+  if (compile_thread_.joinable()) {
+    compile_thread_.join();
+  }
+  // Finishes any run still using current_.
+  executor_.reset();
+  if (delegate_data_ != nullptr) {
+    ReleaseGraph();
+  }
+}
 
 }  // namespace delegate
 }  // namespace vx
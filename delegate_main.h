@@ -16,11 +16,18 @@ limitations under the License.
 #ifndef TENSORFLOW_LITE_DELEGATES_VX_DELEGAGE_DELEGATE_MAIN_H
 #define TENSORFLOW_LITE_DELEGATES_VX_DELEGAGE_DELEGATE_MAIN_H
 
+#include <atomic>
+#include <condition_variable>
+#include <list>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
+#include "stats.h"
 #include "tensorflow/lite/builtin_op_data.h"
 #include "tensorflow/lite/builtin_ops.h"
 #include "tensorflow/lite/context.h"
@@ -40,6 +47,8 @@ struct OpData {
   std::vector<int> subgraph_inputs;
   std::vector<int> subgraph_outputs;
   std::vector<int> subgraph_states;
+  // Label of the delegate node in TfLite profiles.
+  std::string profiling_string;
 
   std::unique_ptr<Delegate> delegate;
 };
@@ -53,22 +62,378 @@ typedef struct {
   bool error_during_prepare;
   // Report error during invoke.
   bool error_during_invoke;
+  // Directory for persisting compiled graphs (NBG) across process restarts.
+  // Caching is disabled if null or empty.
+  const char* cache_dir;
+  // Compile graphs on a worker thread started from Prepare, running the
+  // partitions with the TfLite CPU kernels until the NPU graph is ready.
+  bool async_compile;
+  // Compiled graphs kept per delegate for partitions whose input shapes
+  // changed, so switching back to a known shape skips the recompile.
+  int max_cached_graphs;
+  // Checksum inputs on every Invoke and skip uploading those whose contents
+  // are unchanged since the last upload to the same graph.
+  bool skip_unchanged_inputs;
+  // Process-wide trace level, see trace.h. Only takes effect in builds with
+  // VX_DELEGATE_ENABLE_TRACE; 0 leaves the current level unchanged.
+  int trace_level;
+  // Partitions whose outputs are all bound to buffer handles of the delegate
+  // upload their inputs and return from Invoke, running the graph and
+  // writing the outputs on a per partition executor thread. Partitions
+  // feeding another partition of the delegate stay synchronous, as that one
+  // reads their buffers without TfLite waiting for them. Needs
+  // Interpreter::SetAllowBufferHandleOutput(true), or Invoke waits for the
+  // model outputs anyway.
+  bool async_invoke;
+  // Compiled copies of a graph that `async_invoke` rotates through, so inputs
+  // are uploaded to one while another runs. 1 or less uses a single copy.
+  int pipeline_depth;
+  // Partitions with fewer nodes stay on the CPU.
+  int min_partition_nodes;
+  // Partitions with less estimated compute (MACs) per byte crossing their
+  // boundary stay on the CPU.
+  float min_partition_benefit;
+  // Most partitions to delegate, keeping those with the most compute. 0 for
+  // no limit.
+  int max_partitions;
+  // File of measured partition latencies. Partitions found in it go to
+  // whichever of the NPU and the CPU kernels was faster.
+  const char* profile_path;
+  // Delegate every supported partition and time it on both the NPU and the
+  // CPU kernels, saving the measurements to `profile_path` when the delegate
+  // is deleted. Each partition runs twice per invoke until it has 16
+  // samples, then only on the NPU.
+  bool calibrate;
+  // Write the trace as a chrome://tracing JSON file here when the delegate is
+  // deleted. Raises the trace level to verbose; needs tracing compiled in.
+  const char* trace_file;
+  // Write a JSON report of which nodes were delegated, why the others
+  // weren't, and the partitions with their boundary tensors here whenever
+  // the delegate is applied to a model.
+  const char* coverage_file;
 } VxDelegateOptions;
 
+// Called on the executor thread when an asynchronous partition run is done
+// and its outputs are written, with the status of the run.
+typedef void (*VxDelegateCompletionCallback)(void* user_data,
+                                             TfLiteStatus status);
+
 VxDelegateOptions VxDelegateOptionsDefault();
 
+// Latency of one invoke phase, see VxDelegateStats. Percentiles are accurate
+// to within 25%.
+typedef struct {
+  uint64_t count;
+  double total_us;
+  double p50_us;
+  double p90_us;
+  double p99_us;
+} VxDelegateLatencyStats;
+
+// Snapshot of a delegate's runtime statistics, cumulative since it was
+// created or last reset.
+typedef struct {
+  // Partition invocations, including those run on the CPU fallback.
+  uint64_t invokes;
+  uint64_t fallback_invokes;
+  // Uploading inputs, running the graph, and downloading outputs and states,
+  // per NPU invocation.
+  VxDelegateLatencyStats copy_in;
+  VxDelegateLatencyStats run;
+  VxDelegateLatencyStats copy_out;
+  uint64_t bytes_in;
+  uint64_t bytes_out;
+  uint64_t skipped_input_bytes;
+  // Partitioning of the model the delegate was last applied to: delegated
+  // partitions, nodes they replaced and nodes in the execution plan.
+  int partitions;
+  int delegated_nodes;
+  int total_nodes;
+  // Partitions with compile times, see VxDelegateGetPartitionStats().
+  int compiled_partitions;
+  double compile_ms;
+  // Background compiles of `async_compile` that failed, each leaving its
+  // partition on the CPU kernels for the input shapes it was compiling.
+  uint64_t failed_compiles;
+} VxDelegateStats;
+
+// Compile time of one partition kernel, including replicas, recompiles for
+// new input shapes and loads from `cache_dir`.
+typedef struct {
+  // Process-unique id, as tagged on the partition's trace events.
+  int32_t partition_id;
+  int nodes;
+  // Ops with constant inputs evaluated once when the graph was built.
+  int folded_ops;
+  // Fused activations dropped because the output quantization already
+  // clamps to their range.
+  int fused_activations;
+  // Quantize and Dequantize ops removed as no-ops or merged into a
+  // neighbour.
+  int removed_converts;
+  // Reshape, Squeeze and ExpandDims ops removed as no-ops or merged into a
+  // neighbour, as in the coverage report.
+  int removed_reshapes;
+  // Reshape, Squeeze and ExpandDims ops left that keep the dims of their
+  // input, which the graph build aliases instead of emitting. Only known
+  // once compiled, so not in the coverage report.
+  int aliased_reshapes;
+  uint64_t compiles;
+  double compile_ms;
+  // Part of `compile_ms` spent mapping the ops to a graph and inferring its
+  // layout, none for cache loads.
+  double build_ms;
+} VxDelegatePartitionStats;
+
+// A partition input, output or state resolved to the compiled graph's
+// tensor, so Invoke doesn't search the layout inference map.
+struct TensorBinding {
+  int tensor_index;
+  tim::vx::Tensor* tensor;
+  size_t bytes;
+  // Inputs only: checksum of the data last uploaded, for
+  // `skip_unchanged_inputs`.
+  bool has_checksum;
+  uint64_t checksum;
+};
+
+// A compiled tim::vx graph of a partition and the tensors it was built from.
+struct CompiledGraph {
+  // Releases the graph under context_mutex.
+  ~CompiledGraph();
+
+  // DelegateData::context_mutex, set along with context.
+  std::mutex* context_mutex = nullptr;
+  std::shared_ptr<tim::vx::Context> context;
+  std::shared_ptr<tim::vx::Graph> graph;
+  //first: layout infered graph; second: map from src_tensor to infered_tensor.
+  std::pair<std::shared_ptr<tim::vx::Graph>,
+          std::map<std::shared_ptr<tim::vx::Tensor>,
+                   std::shared_ptr<tim::vx::Tensor>>> layout_infered;
+  std::vector<std::shared_ptr<tim::vx::Tensor>> tensors;
+  std::vector<std::shared_ptr<tim::vx::Tensor>> state_tensors;
+  std::vector<std::shared_ptr<tim::vx::Operation>> ops;
+  // Reshape, Squeeze and ExpandDims ops whose readers use their input tensor
+  // instead, see KeepsDims().
+  int aliased_reshapes = 0;
+  // Keeps the NBG binary alive for the NBG op loaded from the cache.
+  std::vector<char> nbg_binary;
+  // Built once the graph is compiled, in the order of OpData's indexes.
+  std::vector<TensorBinding> input_bindings;
+  std::vector<TensorBinding> output_bindings;
+  std::vector<TensorBinding> state_bindings;
+};
+
+// LRU of compiled graphs that no partition kernel is using. A kernel takes a
+// graph out while it runs it and puts it back when it is done with it, so a
+// graph is never shared between kernels.
+class CompiledGraphCache {
+ public:
+  explicit CompiledGraphCache(size_t capacity) : capacity_(capacity) {}
+
+  // Remove and return the graph compiled for `key`, or nullptr.
+  std::unique_ptr<CompiledGraph> Take(uint64_t key);
+  // Make `graph` available for `key`, evicting the least recently used graph
+  // when over capacity.
+  void Put(uint64_t key, std::unique_ptr<CompiledGraph> graph);
+
+ private:
+  std::mutex mutex_;
+  size_t capacity_;
+  // Most recently used first.
+  std::list<std::pair<uint64_t, std::unique_ptr<CompiledGraph>>> graphs_;
+};
+
+// Measured latencies of partitions, keyed by PartitionProfileKey().
+class PartitionProfile {
+ public:
+  struct Entry {
+    double npu_us = 0;
+    uint64_t npu_samples = 0;
+    double cpu_us = 0;
+    uint64_t cpu_samples = 0;
+  };
+
+  // Merge the entries saved in `path`. Returns false if it can't be read.
+  bool Load(const std::string& path);
+  bool Save(const std::string& path);
+  // Add a sample of `us` microseconds to the NPU or CPU average of `key`.
+  void Record(uint64_t key, bool npu, double us);
+  // Returns false if `key` hasn't been measured on both sides.
+  bool Lookup(uint64_t key, Entry* entry);
+
+ private:
+  std::mutex mutex_;
+  std::map<uint64_t, Entry> entries_;
+};
+
+// State owned by one TfLiteDelegate instance, reachable from every partition
+// kernel through TfLiteDelegate::data_. A delegate may be shared by
+// interpreters invoking on different threads: each kernel owns its graph and
+// everything mutable in here is atomic or locked.
+struct DelegateData {
+  explicit DelegateData(const VxDelegateOptions& options);
+
+  VxDelegateOptions options;
+  // Owned copies of the options' strings.
+  std::string cache_dir;
+  std::string profile_path;
+  std::string trace_file;
+  std::string coverage_file;
+  PartitionProfile profile;
+  // Invocations served by the CPU fallback while graphs were compiling.
+  std::atomic<uint64_t> fallback_invokes{0};
+  // Input bytes not uploaded because of `skip_unchanged_inputs`.
+  std::atomic<uint64_t> skipped_input_bytes{0};
+  DelegateStats stats;
+  // Coverage report of the model the delegate was last applied to.
+  std::mutex coverage_mutex;
+  std::string coverage_report;
+  // What the graph passes did to each partition kernel, filled in by
+  // Delegate::Init for the report.
+  std::vector<KernelPasses> kernel_passes;
+
+  // The tim::vx context all partitions create their graphs on, created on
+  // first use. Callers hold context_mutex, which also guards everything
+  // done to graphs on the context that isn't local to one graph: creating,
+  // compiling, running and releasing them.
+  std::shared_ptr<tim::vx::Context> GetContext();
+  std::mutex context_mutex;
+  std::shared_ptr<tim::vx::Context> vx_context;
+  // After context_mutex, which releasing the graphs takes.
+  CompiledGraphCache graph_cache;
+
+  // Caller memory registered as TfLiteBufferHandles of this delegate.
+  struct Buffer {
+    void* data;
+    size_t bytes;
+  };
+  TfLiteBufferHandle RegisterBuffer(void* data, size_t bytes);
+  // Returns false if `handle` is not registered.
+  bool LookupBuffer(TfLiteBufferHandle handle, Buffer* buffer);
+  void ReleaseBuffer(TfLiteBufferHandle handle);
+  std::mutex buffers_mutex;
+  std::map<TfLiteBufferHandle, Buffer> buffers;
+  TfLiteBufferHandle next_buffer_handle = 0;
+
+  // Asynchronous partition runs of `async_invoke` still in flight, with the
+  // buffer handles each of them writes.
+  void BeginAsyncRun(const std::vector<TfLiteBufferHandle>& handles);
+  void EndAsyncRun(const std::vector<TfLiteBufferHandle>& handles,
+                   TfLiteStatus status);
+  // Block until no run writing `handle` is in flight. Fails if the last run
+  // that wrote it failed.
+  TfLiteStatus WaitForBuffer(TfLiteBufferHandle handle);
+  // Block until no run is in flight. Fails if the last run writing any of
+  // the buffer handles failed.
+  TfLiteStatus WaitForAsyncRuns();
+  void SetCompletionCallback(VxDelegateCompletionCallback callback,
+                             void* user_data);
+  std::mutex async_mutex;
+  std::condition_variable async_cv;
+  int pending_async_runs = 0;
+  struct AsyncWrites {
+    int pending = 0;
+    // Of the last run to finish writing the buffer.
+    TfLiteStatus status = kTfLiteOk;
+  };
+  std::map<TfLiteBufferHandle, AsyncWrites> async_writes;
+  VxDelegateCompletionCallback completion_callback = nullptr;
+  void* completion_user_data = nullptr;
+};
+
 TfLiteDelegate* VxDelegateCreate(const VxDelegateOptions* options);
 
+// Delete a delegate of VxDelegateCreate(). The one VxDelegate() returns is
+// never deleted.
 void VxDelegateDelete(TfLiteDelegate* delegate);
+
+// Number of invocations that ran on the CPU fallback path while
+// `async_compile` graphs were still compiling.
+uint64_t VxDelegateGetFallbackInvokeCount(const TfLiteDelegate* delegate);
+
+// Input bytes whose upload `skip_unchanged_inputs` avoided.
+uint64_t VxDelegateGetSkippedInputBytes(const TfLiteDelegate* delegate);
+
+// Fill `stats` with the runtime statistics of `delegate`. Counters are
+// updated with relaxed atomics, so a snapshot taken during an Invoke may be
+// slightly inconsistent.
+TfLiteStatus VxDelegateGetStats(const TfLiteDelegate* delegate,
+                                VxDelegateStats* stats);
+// Compile time of the `index`th of the `compiled_partitions` partitions, in
+// partition id order.
+TfLiteStatus VxDelegateGetPartitionStats(const TfLiteDelegate* delegate,
+                                         int index,
+                                         VxDelegatePartitionStats* stats);
+// Clear the invoke, transfer and compile statistics, e.g. after warm-up,
+// including the fallback invoke and skipped input byte counts.
+void VxDelegateResetStats(TfLiteDelegate* delegate);
+
+// Bind `bytes` of caller memory at `data` to a new buffer handle of
+// `delegate`, to attach to tensors with Interpreter::SetBufferHandle.
+// Partitions then read inputs from and write outputs to this memory directly,
+// and CPU readers of an output get a copy of it only on demand. The memory
+// must outlive the handle. Returns kTfLiteNullBufferHandle on failure.
+TfLiteBufferHandle VxDelegateRegisterBufferHandle(TfLiteDelegate* delegate,
+                                                  void* data,
+                                                  size_t bytes);
+
+// Set the callback invoked after every asynchronous partition run of
+// `delegate`, see VxDelegateOptions::async_invoke. Set it before invoking.
+void VxDelegateSetCompletionCallback(TfLiteDelegate* delegate,
+                                     VxDelegateCompletionCallback callback,
+                                     void* user_data);
+
+// Block until the asynchronous partition runs of `delegate` are done.
+// Returns an error if the last run writing any buffer handle failed.
+TfLiteStatus VxDelegateWaitForCompletion(TfLiteDelegate* delegate);
+
+// Write the events in the process-wide trace buffer to `path`, one per
+// line. Returns false if the file can't be written.
+bool VxDelegateDumpTrace(const char* path);
+// Same as a chrome://tracing JSON file, with the partition id and the bytes
+// copied or other event argument in the args of each event.
+bool VxDelegateDumpChromeTrace(const char* path);
+
+// Write the coverage report, see VxDelegateOptions::coverage_file, of the
+// model `delegate` was last applied to. Returns false if it hasn't been
+// applied or the file can't be written.
+bool VxDelegateWriteCoverageReport(const TfLiteDelegate* delegate,
+                                   const char* path);
+
+// Number of tim::vx contexts and partition graphs currently alive in the
+// process, across all delegates.
+int64_t VxDelegateGetLiveContextCount();
+int64_t VxDelegateGetLiveGraphCount();
+
+struct OperationDataType {
+  int builtin_code;
+  std::string custom_name;
+  std::vector<int> inputs;
+  std::vector<int> outputs;
+  std::vector<int> states;
+  std::vector<uint8_t> builtin_data;
+  // Kernel the node was registered with, to run it on the CPU.
+  TfLiteRegistration registration;
+  const char* custom_initial_data;
+  int custom_initial_data_size;
+};
+
+class Executor;
+class KernelRunner;
+
 class Delegate {
  public:
-  static TfLiteDelegate* Create();
+  static TfLiteDelegate* Create(const VxDelegateOptions& options);
+  // Whether an op mapper accepts the node, with the reason in `reason` if
+  // none does.
   static bool SupportedOp(TfLiteContext* context,
                           TfLiteNode* node,
-                          const TfLiteRegistration* registration);
+                          const TfLiteRegistration* registration,
+                          std::string* reason);
 
   Delegate();
-  ~Delegate() {}
+  ~Delegate();
 
   std::unique_ptr<OpData> Init(TfLiteContext* context,
                                const TfLiteDelegateParams* params);
@@ -78,33 +443,133 @@ class Delegate {
   TfLiteStatus Invoke(const OpData& op_data,
                       TfLiteContext* context,
                       TfLiteNode* node);
-  std::vector<std::shared_ptr<tim::vx::Operation>>& GetOps() { return ops_; }
-  std::shared_ptr<tim::vx::Graph>& GetGraph() { return graph_; }
+  std::vector<std::shared_ptr<tim::vx::Operation>>& GetOps() {
+    return current_->ops;
+  }
+  std::shared_ptr<tim::vx::Graph>& GetGraph() { return current_->graph; }
   std::vector<std::shared_ptr<tim::vx::Tensor>>& GetTensors() {
-    return tensors_;
+    return current_->tensors;
   }
 
  private:
-  struct OperationDataType {
-    int builtin_code;
-    std::string custom_name;
-    std::vector<int> inputs;
-    std::vector<int> outputs;
-    std::vector<int> states;
-    std::vector<uint8_t> builtin_data;
-  };
+  // Builds the tim::vx graph for the partition, runs layout inference and
+  // compiles it.
+  TfLiteStatus Compile(const OpData& op_data, TfLiteContext* context);
+  // Map the partition's tensors and ops into a fresh current_.
+  void BuildGraph(const OpData& op_data, TfLiteContext* context);
 
-  std::shared_ptr<tim::vx::Context> context_;
-  std::shared_ptr<tim::vx::Graph> graph_;
-  //first: layout infered graph; second: map from src_tensor to infered_tensor.
-  std::pair<std::shared_ptr<tim::vx::Graph>,
-          std::map<std::shared_ptr<tim::vx::Tensor>,
-                   std::shared_ptr<tim::vx::Tensor>>> layout_infered_;
-  std::vector<std::shared_ptr<tim::vx::Tensor>> tensors_;
-  std::vector<std::shared_ptr<tim::vx::Tensor>> state_tensors_;
-  std::vector<std::shared_ptr<tim::vx::Operation>> ops_;
+  // Key of the graph for the current tensor shapes: partition_signature_
+  // combined with the dims of the non-constant tensors.
+  uint64_t GraphKey(TfLiteContext* context) const;
+  // Path of the on-disk compiled graph for graph_key_, or an empty string if
+  // the partition can't be cached.
+  std::string CompiledGraphCachePath() const;
+  // Rebuild the graph as a single NBG op from a cached compiled graph.
+  bool LoadCompiledGraph(const std::string& path,
+                         const OpData& op_data,
+                         TfLiteContext* context);
+  void SaveCompiledGraph(const std::string& path, const OpData& op_data);
+  // Drop any previously built graph and reset the tensor tables.
+  void ResetGraph(TfLiteContext* context);
+  // Hand the current graph back to the delegate's graph cache.
+  void ReleaseGraph();
+  // Fill the binding tables of the just compiled current_.
+  bool BuildBindings(const OpData& op_data, TfLiteContext* context);
+  // Caller memory bound to `tensor` through a buffer handle of this delegate,
+  // or nullptr if it has none. Fails if the memory is smaller than the tensor.
+  TfLiteStatus BufferHandleData(const TfLiteTensor& tensor, void** data);
+  // Start compiling on compile_thread_ from a snapshot of the context, with
+  // kernel_runner_ serving Invoke meanwhile.
+  TfLiteStatus CompileAsync(const OpData& op_data, TfLiteContext* context);
+  // Join compile_thread_ once it is done, or right away if `wait`, and
+  // record a failed compile. A graph compiled for shapes Prepare has moved
+  // on from goes to the graph cache. Returns false while still compiling.
+  bool JoinCompile(bool wait);
+  // Hand current_ to the graph cache and pick up the graph compiled earlier
+  // for prepared_key_, if any.
+  void UsePreparedGraph();
+  // Upload the inputs, run the graph and download the outputs, or submit
+  // the run for `async_invoke`.
+  TfLiteStatus InvokeGraph(const OpData& op_data, TfLiteContext* context);
+  // Run the partition on `runner`.
+  TfLiteStatus InvokeFallback(const OpData& op_data,
+                              TfLiteContext* context,
+                              KernelRunner* runner);
+  // Run and time the partition on the CPU kernels and on the NPU, for
+  // `calibrate`.
+  TfLiteStatus InvokeCalibrating(const OpData& op_data,
+                                 TfLiteContext* context);
+  // Whether `async_invoke` applies to the current output bindings, with the
+  // buffer handle and its memory of each output if so.
+  bool AsyncOutputs(TfLiteContext* context,
+                    std::vector<TfLiteBufferHandle>* handles,
+                    std::vector<void*>* outputs);
+  // Whether another kernel of the delegate reads an output of the partition.
+  bool FeedsDelegateKernels(const OpData& op_data,
+                            TfLiteContext* context,
+                            TfLiteNode* node) const;
+  // Compile replicas_ up to `pipeline_depth` graphs.
+  void BuildReplicas(const OpData& op_data, TfLiteContext* context);
+  // Run `graph`, whose inputs are uploaded, on executor_ and write its
+  // outputs to `outputs`, the memory of buffer handles `handles`.
+  void SubmitAsyncRun(CompiledGraph* graph,
+                      size_t slot,
+                      const std::vector<TfLiteBufferHandle>& handles,
+                      const std::vector<void*>& outputs);
+
+  std::unique_ptr<CompiledGraph> current_;
   std::vector<OperationDataType> operations_;
-  bool compiled_;
+  // What the graph passes did to operations_, and the data of the outputs
+  // of folded ops that the remaining ones read.
+  GraphPassCounts graph_passes_;
+  std::map<int, std::vector<uint8_t>> folded_constants_;
+  DelegateData* delegate_data_;
+  // Hash of everything the graph depends on but the non-constant tensor dims.
+  uint64_t partition_signature_;
+  // Non-constant tensors whose dims select the graph.
+  std::vector<int> shape_tensors_;
+  // Graphs with state or variable tensors can't be handed between kernels.
+  bool cacheable_;
+  // Custom ops are not persisted to cache_dir.
+  bool has_custom_ops_;
+  // Key of current_, or of the graph being compiled.
+  uint64_t graph_key_;
+  // Key of the shapes of the last Prepare. Differs from graph_key_ while a
+  // background compile for earlier shapes finishes.
+  uint64_t prepared_key_;
+  bool has_graph_key_;
+  // Set last by Compile, so a true value publishes the whole graph to Invoke.
+  std::atomic<bool> compiled_;
+
+  std::unique_ptr<KernelRunner> kernel_runner_;
+  // Owns current_ and graph_key_ until joined.
+  std::thread compile_thread_;
+  // Set by compile_thread_ when it is done.
+  std::atomic<bool> compile_done_;
+  // The background compile for prepared_key_ failed, the partition stays on
+  // the CPU kernels for these shapes.
+  bool compile_failed_;
+  uint64_t fallback_invokes_;
+  // Runs current_ and replicas_ for `async_invoke`, created on first use.
+  // Drained before the graphs are touched by anything else.
+  std::unique_ptr<Executor> executor_;
+  // Extra copies of current_ for `pipeline_depth`, and for each slot
+  // (current_ first) the executor ticket of its last run.
+  std::vector<std::unique_ptr<CompiledGraph>> replicas_;
+  bool replicas_built_;
+  // Set by Prepare, keeps the partition's invokes synchronous.
+  bool feeds_delegate_kernels_;
+  std::vector<uint64_t> slot_tickets_;
+  size_t next_slot_;
+  // PartitionProfileKey() of the partition.
+  uint64_t profile_key_;
+  // Times the CPU kernels for `calibrate`.
+  std::unique_ptr<KernelRunner> calibration_runner_;
+  uint64_t calibration_invokes_;
+  // First node replaced by the partition, to tag TfLite profiler events.
+  int first_node_;
+  // Process-unique id tagging the partition's trace events.
+  int32_t partition_id_;
 };
 
 }  // namespace delegate
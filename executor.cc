@@ -0,0 +1,74 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "executor.h"
+
+namespace vx {
+namespace delegate {
+
+Executor::Executor() : submitted_(0), completed_(0), stop_(false) {
+  thread_ = std::thread(&Executor::Loop, this);
+}
+
+Executor::~Executor() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+}
+
+uint64_t Executor::Submit(std::function<void()> task) {
+  uint64_t ticket;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push_back(std::move(task));
+    ticket = ++submitted_;
+  }
+  cv_.notify_all();
+  return ticket;
+}
+
+void Executor::Wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  uint64_t ticket = submitted_;
+  cv_.wait(lock, [this, ticket]() { return completed_ >= ticket; });
+}
+
+void Executor::WaitFor(uint64_t ticket) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this, ticket]() { return completed_ >= ticket; });
+}
+
+void Executor::Loop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+    if (tasks_.empty()) {
+      return;
+    }
+    std::function<void()> task = std::move(tasks_.front());
+    tasks_.pop_front();
+    lock.unlock();
+    task();
+    lock.lock();
+    completed_++;
+    cv_.notify_all();
+  }
+}
+
+}  // namespace delegate
+}  // namespace vx
@@ -0,0 +1,58 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_LITE_DELEGATES_VX_DELEGAGE_EXECUTOR_H_
+#define TENSORFLOW_LITE_DELEGATES_VX_DELEGAGE_EXECUTOR_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace vx {
+namespace delegate {
+
+/// Runs tasks one at a time, in submission order, on a dedicated thread.
+class Executor {
+ public:
+  Executor();
+  /// Runs the tasks already submitted, then joins the thread.
+  ~Executor();
+
+  /// Returns a ticket to wait for the task with.
+  uint64_t Submit(std::function<void()> task);
+  /// Block until every task submitted so far has run.
+  void Wait();
+  /// Block until the task of `ticket` and all before it have run.
+  void WaitFor(uint64_t ticket);
+
+ private:
+  void Loop();
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> tasks_;
+  uint64_t submitted_;
+  uint64_t completed_;
+  bool stop_;
+  std::thread thread_;
+};
+
+}  // namespace delegate
+}  // namespace vx
+
+#endif /* TENSORFLOW_LITE_DELEGATES_VX_DELEGAGE_EXECUTOR_H_ */
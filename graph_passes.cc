@@ -0,0 +1,479 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "graph_passes.h"
+
+#include <cmath>
+#include <iterator>
+#include <map>
+#include <set>
+
+#include "coverage.h"
+#include "kernel_runner.h"
+#include "tensorflow/lite/builtin_op_data.h"
+#include "tensorflow/lite/tools/logging.h"
+
+namespace {
+
+bool IsConvert(const vx::delegate::OperationDataType& operation) {
+  return operation.custom_name.empty() &&
+         (operation.builtin_code == kTfLiteBuiltinQuantize ||
+          operation.builtin_code == kTfLiteBuiltinDequantize) &&
+         operation.inputs.size() == 1 && operation.outputs.size() == 1 &&
+         operation.inputs[0] >= 0 && operation.outputs[0] >= 0;
+}
+
+// Ops whose NPU and CPU kernels requantize into any output quantization.
+bool QuantizesOutput(const vx::delegate::OperationDataType& operation) {
+  if (!operation.custom_name.empty() || operation.outputs.size() != 1) {
+    return false;
+  }
+  switch (operation.builtin_code) {
+    case kTfLiteBuiltinConv2d:
+    case kTfLiteBuiltinDepthwiseConv2d:
+    case kTfLiteBuiltinFullyConnected:
+    case kTfLiteBuiltinAdd:
+    case kTfLiteBuiltinSub:
+    case kTfLiteBuiltinMul:
+      return true;
+    default:
+      return false;
+  }
+}
+
+const TfLiteAffineQuantization* PerTensorQuantization(
+    const TfLiteTensor& tensor) {
+  if (tensor.quantization.type != kTfLiteAffineQuantization) {
+    return nullptr;
+  }
+  const auto* params = reinterpret_cast<const TfLiteAffineQuantization*>(
+      tensor.quantization.params);
+  if (params == nullptr || params->scale->size != 1 ||
+      params->zero_point->size != 1 || params->scale->data[0] <= 0) {
+    return nullptr;
+  }
+  return params;
+}
+
+bool IsQuantized(const TfLiteTensor& tensor) {
+  return (tensor.type == kTfLiteUInt8 || tensor.type == kTfLiteInt8) &&
+         PerTensorQuantization(tensor) != nullptr;
+}
+
+bool SameQuantization(const TfLiteTensor& a, const TfLiteTensor& b) {
+  if (a.type != b.type) {
+    return false;
+  }
+  if (a.type == kTfLiteFloat32) {
+    return true;
+  }
+  const TfLiteAffineQuantization* qa = PerTensorQuantization(a);
+  const TfLiteAffineQuantization* qb = PerTensorQuantization(b);
+  return qa != nullptr && qb != nullptr &&
+         qa->scale->data[0] == qb->scale->data[0] &&
+         qa->zero_point->data[0] == qb->zero_point->data[0];
+}
+
+// Real range a quantized tensor can hold.
+void QuantizedRange(const TfLiteTensor& tensor, float* min, float* max) {
+  const TfLiteAffineQuantization* params = PerTensorQuantization(tensor);
+  const int32_t qmin = tensor.type == kTfLiteInt8 ? -128 : 0;
+  const int32_t qmax = tensor.type == kTfLiteInt8 ? 127 : 255;
+  const float scale = params->scale->data[0];
+  const int32_t zero_point = params->zero_point->data[0];
+  *min = (qmin - zero_point) * scale;
+  *max = (qmax - zero_point) * scale;
+}
+
+// Whether `outer` holds every real value `inner` can, so quantizing into
+// `inner` clamps at least as much as quantizing into `outer` first.
+bool Covers(const TfLiteTensor& outer, const TfLiteTensor& inner) {
+  float outer_min, outer_max, inner_min, inner_max;
+  QuantizedRange(outer, &outer_min, &outer_max);
+  QuantizedRange(inner, &inner_min, &inner_max);
+  return outer_min <= inner_min && outer_max >= inner_max;
+}
+
+// Whether requantizing through `intermediate` into `output` rounds within
+// one step of `output` of requantizing straight into it: the intermediate
+// step is at most as large and clamps nothing the output keeps.
+bool FinerAndCovering(const TfLiteTensor& intermediate,
+                      const TfLiteTensor& output) {
+  if (PerTensorQuantization(intermediate)->scale->data[0] >
+      PerTensorQuantization(output)->scale->data[0]) {
+    return false;
+  }
+  return Covers(intermediate, output);
+}
+
+void ReplaceInput(int from,
+                  int to,
+                  std::vector<vx::delegate::OperationDataType>* operations) {
+  for (auto& operation : *operations) {
+    for (int& tensor_idx : operation.inputs) {
+      if (tensor_idx == from) {
+        tensor_idx = to;
+      }
+    }
+  }
+}
+
+bool IsReshape(const vx::delegate::OperationDataType& operation) {
+  return operation.custom_name.empty() &&
+         (operation.builtin_code == kTfLiteBuiltinReshape ||
+          operation.builtin_code == kTfLiteBuiltinSqueeze ||
+          operation.builtin_code == kTfLiteBuiltinExpandDims) &&
+         !operation.inputs.empty() && operation.outputs.size() == 1 &&
+         operation.inputs[0] >= 0 && operation.outputs[0] >= 0;
+}
+
+template <typename T_Param>
+TfLiteFusedActivation* ActivationOf(std::vector<uint8_t>& builtin_data) {
+  if (builtin_data.size() < sizeof(T_Param)) {
+    return nullptr;
+  }
+  return &reinterpret_cast<T_Param*>(builtin_data.data())->activation;
+}
+
+// The fused activation in the params of `operation`, or nullptr if its op
+// has none.
+TfLiteFusedActivation* FusedActivation(
+    vx::delegate::OperationDataType& operation) {
+  if (!operation.custom_name.empty()) {
+    return nullptr;
+  }
+  auto& data = operation.builtin_data;
+  switch (operation.builtin_code) {
+    case kTfLiteBuiltinConv2d:
+      return ActivationOf<TfLiteConvParams>(data);
+    case kTfLiteBuiltinDepthwiseConv2d:
+      return ActivationOf<TfLiteDepthwiseConvParams>(data);
+    case kTfLiteBuiltinFullyConnected:
+      return ActivationOf<TfLiteFullyConnectedParams>(data);
+    case kTfLiteBuiltinAveragePool2d:
+    case kTfLiteBuiltinMaxPool2d:
+      return ActivationOf<TfLitePoolParams>(data);
+    case kTfLiteBuiltinAdd:
+      return ActivationOf<TfLiteAddParams>(data);
+    case kTfLiteBuiltinSub:
+      return ActivationOf<TfLiteSubParams>(data);
+    case kTfLiteBuiltinMul:
+      return ActivationOf<TfLiteMulParams>(data);
+    case kTfLiteBuiltinDiv:
+      return ActivationOf<TfLiteDivParams>(data);
+    case kTfLiteBuiltinConcatenation:
+      return ActivationOf<TfLiteConcatenationParams>(data);
+    case kTfLiteBuiltinL2Normalization:
+      return ActivationOf<TfLiteL2NormParams>(data);
+    default:
+      return nullptr;
+  }
+}
+
+// Whether the quantized range of `tensor` lies within the range of
+// `activation`, as CalculateActivationRangeQuantized computes it.
+bool QuantizationClamps(const TfLiteTensor& tensor,
+                        TfLiteFusedActivation activation) {
+  int32_t qmin;
+  int32_t qmax;
+  switch (tensor.type) {
+    case kTfLiteUInt8:
+      qmin = 0;
+      qmax = 255;
+      break;
+    case kTfLiteInt8:
+      qmin = -128;
+      qmax = 127;
+      break;
+    default:
+      return false;
+  }
+  const TfLiteAffineQuantization* params = PerTensorQuantization(tensor);
+  if (params == nullptr) {
+    return false;
+  }
+  const float scale = params->scale->data[0];
+  const int32_t zero_point = params->zero_point->data[0];
+  auto quantize = [scale, zero_point](float value) {
+    return zero_point + static_cast<int32_t>(std::round(value / scale));
+  };
+
+  switch (activation) {
+    case kTfLiteActRelu:
+      return quantize(0) <= qmin;
+    case kTfLiteActRelu6:
+      return quantize(0) <= qmin && quantize(6) >= qmax;
+    case kTfLiteActReluN1To1:
+      return quantize(-1) <= qmin && quantize(1) >= qmax;
+    default:
+      return false;
+  }
+}
+
+}  // namespace
+
+namespace vx {
+namespace delegate {
+
+GraphPassCounts RunGraphPasses(TfLiteContext* context,
+                               const OpData& op_data,
+                               std::vector<OperationDataType>* operations,
+                               std::map<int, std::vector<uint8_t>>* constants) {
+  GraphPassCounts counts;
+  constants->clear();
+  counts.folded_ops = FoldConstants(context, op_data, operations, constants);
+  counts.removed_reshapes = EliminateReshapes(context, op_data, operations);
+  // Ops quantizing their output for a removed Quantize may get their
+  // activation folded into the new quantization.
+  counts.removed_converts = EliminateConverts(context, op_data, operations);
+  counts.fused_activations = FoldFusedActivations(context, operations);
+  return counts;
+}
+
+int FoldConstants(TfLiteContext* context,
+                  const OpData& op_data,
+                  std::vector<OperationDataType>* operations,
+                  std::map<int, std::vector<uint8_t>>* constants) {
+  std::set<int> pinned(op_data.subgraph_outputs.begin(),
+                       op_data.subgraph_outputs.end());
+  pinned.insert(op_data.subgraph_states.begin(),
+                op_data.subgraph_states.end());
+  auto foldable = [&](const OperationDataType& operation) {
+    if (!operation.custom_name.empty() || !operation.states.empty() ||
+        operation.outputs.empty()) {
+      return false;
+    }
+    bool has_input = false;
+    for (int tensor_idx : operation.inputs) {
+      if (tensor_idx < 0) {
+        continue;
+      }
+      const TfLiteTensor& tensor = context->tensors[tensor_idx];
+      if (constants->count(tensor_idx) == 0 &&
+          (tensor.allocation_type != kTfLiteMmapRo ||
+           tensor.data.raw_const == nullptr)) {
+        return false;
+      }
+      has_input = true;
+    }
+    for (int tensor_idx : operation.outputs) {
+      if (tensor_idx < 0 || pinned.count(tensor_idx) > 0 ||
+          context->tensors[tensor_idx].is_variable) {
+        return false;
+      }
+    }
+    return has_input;
+  };
+
+  int folded = 0;
+  for (auto it = operations->begin(); it != operations->end();) {
+    if (!foldable(*it)) {
+      ++it;
+      continue;
+    }
+    std::vector<std::vector<uint8_t>> outputs;
+    if (!KernelRunner::EvaluateConstant(context, *it, *constants, &outputs)) {
+      TFLITE_LOG(WARN) << "Failed to fold constant "
+                       << OpName(&it->registration);
+      ++it;
+      continue;
+    }
+    for (size_t i = 0; i < outputs.size(); i++) {
+      (*constants)[it->outputs[i]] = std::move(outputs[i]);
+    }
+    it = operations->erase(it);
+    folded++;
+  }
+
+  // Only keep the data of tensors the remaining ops read.
+  std::set<int> read;
+  for (const auto& operation : *operations) {
+    read.insert(operation.inputs.begin(), operation.inputs.end());
+  }
+  for (auto it = constants->begin(); it != constants->end();) {
+    it = read.count(it->first) > 0 ? std::next(it) : constants->erase(it);
+  }
+  return folded;
+}
+
+int EliminateReshapes(TfLiteContext* context,
+                      const OpData& op_data,
+                      std::vector<OperationDataType>* operations) {
+  auto& ops = *operations;
+  int removed = 0;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    std::map<int, int> consumers;
+    for (const auto& operation : ops) {
+      for (int tensor_idx : operation.inputs) {
+        consumers[tensor_idx]++;
+      }
+    }
+    std::set<int> pinned(op_data.subgraph_outputs.begin(),
+                         op_data.subgraph_outputs.end());
+    pinned.insert(op_data.subgraph_states.begin(),
+                  op_data.subgraph_states.end());
+    auto removable = [&](int tensor_idx) {
+      return pinned.count(tensor_idx) == 0 && consumers[tensor_idx] <= 1 &&
+             !context->tensors[tensor_idx].is_variable;
+    };
+    std::map<int, size_t> producer;
+    for (size_t i = 0; i < ops.size(); i++) {
+      for (int tensor_idx : ops[i].outputs) {
+        producer[tensor_idx] = i;
+      }
+    }
+
+    for (size_t i = 0; i < ops.size() && !changed; i++) {
+      // previous: source -> input, reshape: input -> output. A Reshape's
+      // shape doesn't depend on the dims of its input, so it can read the
+      // source instead.
+      OperationDataType& reshape = ops[i];
+      if (!IsReshape(reshape) ||
+          reshape.builtin_code != kTfLiteBuiltinReshape) {
+        continue;
+      }
+      const int input = reshape.inputs[0];
+      auto it = producer.find(input);
+      if (it == producer.end() || !removable(input) ||
+          !IsReshape(ops[it->second])) {
+        continue;
+      }
+      reshape.inputs[0] = ops[it->second].inputs[0];
+      ops.erase(ops.begin() + it->second);
+      changed = true;
+    }
+    removed += changed;
+  }
+  return removed;
+}
+
+bool KeepsDims(TfLiteContext* context, const OperationDataType& operation) {
+  return IsReshape(operation) &&
+         TfLiteIntArrayEqual(context->tensors[operation.inputs[0]].dims,
+                             context->tensors[operation.outputs[0]].dims);
+}
+
+int EliminateConverts(TfLiteContext* context,
+                      const OpData& op_data,
+                      std::vector<OperationDataType>* operations) {
+  auto& ops = *operations;
+  int removed = 0;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    // Tensors that must keep being written: read outside the partition, or
+    // by more than one op.
+    std::map<int, int> consumers;
+    for (const auto& operation : ops) {
+      for (int tensor_idx : operation.inputs) {
+        consumers[tensor_idx]++;
+      }
+    }
+    std::set<int> pinned(op_data.subgraph_outputs.begin(),
+                         op_data.subgraph_outputs.end());
+    pinned.insert(op_data.subgraph_states.begin(),
+                  op_data.subgraph_states.end());
+    auto removable = [&](int tensor_idx) {
+      return pinned.count(tensor_idx) == 0 && consumers[tensor_idx] <= 1 &&
+             !context->tensors[tensor_idx].is_variable;
+    };
+    // Producer of each tensor, by position in ops.
+    std::map<int, size_t> producer;
+    for (size_t i = 0; i < ops.size(); i++) {
+      for (int tensor_idx : ops[i].outputs) {
+        producer[tensor_idx] = i;
+      }
+    }
+
+    for (size_t i = 0; i < ops.size() && !changed; i++) {
+      OperationDataType& convert = ops[i];
+      if (!IsConvert(convert)) {
+        continue;
+      }
+      const int input = convert.inputs[0];
+      const int output = convert.outputs[0];
+      const TfLiteTensor& input_tensor = context->tensors[input];
+      const TfLiteTensor& output_tensor = context->tensors[output];
+
+      // A no-op convert: readers of its output read its input instead.
+      if (SameQuantization(input_tensor, output_tensor) &&
+          pinned.count(output) == 0) {
+        ReplaceInput(output, input, operations);
+        ops.erase(ops.begin() + i);
+        changed = true;
+        break;
+      }
+
+      auto it = producer.find(input);
+      if (it == producer.end() || !removable(input)) {
+        continue;
+      }
+      const size_t producer_pos = it->second;
+      OperationDataType& previous = ops[producer_pos];
+      if (IsConvert(previous)) {
+        // previous: source -> input, convert: input -> output.
+        const TfLiteTensor& source = context->tensors[previous.inputs[0]];
+        const bool exact = IsQuantized(source) &&
+                           input_tensor.type == kTfLiteFloat32 &&
+                           previous.builtin_code == kTfLiteBuiltinDequantize &&
+                           convert.builtin_code == kTfLiteBuiltinQuantize;
+        const bool requantize = IsQuantized(source) &&
+                                IsQuantized(input_tensor) &&
+                                IsQuantized(output_tensor) &&
+                                FinerAndCovering(input_tensor, output_tensor);
+        if (exact || requantize) {
+          // Both cases leave convert a Quantize from quantized source.
+          convert.inputs[0] = previous.inputs[0];
+          ops.erase(ops.begin() + producer_pos);
+          changed = true;
+        }
+      } else if (QuantizesOutput(previous) &&
+                 convert.builtin_code == kTfLiteBuiltinQuantize &&
+                 IsQuantized(input_tensor) && IsQuantized(output_tensor) &&
+                 input_tensor.type == output_tensor.type &&
+                 Covers(input_tensor, output_tensor) &&
+                 previous.outputs[0] == input) {
+        previous.outputs[0] = output;
+        ops.erase(ops.begin() + i);
+        changed = true;
+      }
+    }
+    removed += changed;
+  }
+  return removed;
+}
+
+int FoldFusedActivations(TfLiteContext* context,
+                         std::vector<OperationDataType>* operations) {
+  int folded = 0;
+  for (auto& operation : *operations) {
+    TfLiteFusedActivation* activation = FusedActivation(operation);
+    if (activation == nullptr || *activation == kTfLiteActNone ||
+        operation.outputs.empty() || operation.outputs[0] < 0) {
+      continue;
+    }
+    if (QuantizationClamps(context->tensors[operation.outputs[0]],
+                           *activation)) {
+      *activation = kTfLiteActNone;
+      folded++;
+    }
+  }
+  return folded;
+}
+
+}  // namespace delegate
+}  // namespace vx
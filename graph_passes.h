@@ -0,0 +1,92 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_LITE_DELEGATES_VX_DELEGAGE_GRAPH_PASSES_H_
+#define TENSORFLOW_LITE_DELEGATES_VX_DELEGAGE_GRAPH_PASSES_H_
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "delegate_main.h"
+
+namespace vx {
+namespace delegate {
+
+/// Run the graph passes below over the operations of the partition of
+/// `op_data`, before they are hashed into its signature and mapped to
+/// TIM-VX ops. `constants` is set to the data of the folded tensors.
+GraphPassCounts RunGraphPasses(TfLiteContext* context,
+                               const OpData& op_data,
+                               std::vector<OperationDataType>* operations,
+                               std::map<int, std::vector<uint8_t>>* constants);
+
+/// Evaluate the ops whose inputs are all constant once on their CPU kernels
+/// and remove them, adding their outputs to `constants` so the graph gets
+/// them as constant tensors, e.g. Mul or Add of constants, Transpose of
+/// weights or Dequantize of float16 weights. Ops writing a tensor read
+/// outside the partition stay. Returns the number of ops folded.
+int FoldConstants(TfLiteContext* context,
+                  const OpData& op_data,
+                  std::vector<OperationDataType>* operations,
+                  std::map<int, std::vector<uint8_t>>* constants);
+
+/// Merge chains of Reshape, Squeeze and ExpandDims ops ending in a Reshape
+/// into that Reshape, whose shape doesn't depend on the dims of its input.
+/// Tensors consumed by other ops or read outside the partition are kept.
+/// Returns the number of ops removed.
+int EliminateReshapes(TfLiteContext* context,
+                      const OpData& op_data,
+                      std::vector<OperationDataType>* operations);
+
+/// Whether `operation` is a Reshape, Squeeze or ExpandDims whose output has
+/// the current dims of its input. The dims change when the model is resized,
+/// so BuildGraph checks this for every graph it builds rather than a pass
+/// removing the op once.
+bool KeepsDims(TfLiteContext* context, const OperationDataType& operation);
+
+/// Remove the Quantize and Dequantize ops, each mapped to a DataConvert,
+/// that don't change the values they pass on:
+/// - converts between tensors of the same type and quantization
+/// - Dequantize of an int8 or uint8 tensor into Quantize, merged into one
+///   requantizing Quantize
+/// - requantize chains whose intermediate tensor is at least as fine as the
+///   final one and covers its range, merged into one Quantize that differs
+///   by at most one quantization step
+/// - a requantizing Quantize right after a Conv2d, DepthwiseConv2d,
+///   FullyConnected, Add, Sub or Mul whose output range lies within the
+///   intermediate one, which then quantizes its output directly with the
+///   Quantize's parameters
+/// Tensors consumed by other ops or read outside the partition are kept.
+/// Quantize into Dequantize stays, as it rounds the values to the
+/// quantization grid. Returns the number of ops removed.
+int EliminateConverts(TfLiteContext* context,
+                      const OpData& op_data,
+                      std::vector<OperationDataType>* operations);
+
+/// Drop the fused activation of ops whose quantized output can't leave the
+/// activation's range anyway, e.g. Relu6 into a uint8 tensor with zero point
+/// 0 and scale 6/255. The op mappers would otherwise add a separate
+/// activation op and an intermediate tensor, which the NPU runs as an extra
+/// layer. TfLite's kernels intersect the activation with the same quantized
+/// range, so the CPU fallback computes the same result. Returns the number
+/// of activations dropped.
+int FoldFusedActivations(TfLiteContext* context,
+                         std::vector<OperationDataType>* operations);
+
+}  // namespace delegate
+}  // namespace vx
+
+#endif /* TENSORFLOW_LITE_DELEGATES_VX_DELEGAGE_GRAPH_PASSES_H_ */
@@ -0,0 +1,247 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "kernel_runner.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <map>
+
+#include "tensorflow/lite/tools/logging.h"
+
+namespace {
+
+TfLiteQuantization CopyQuantization(const TfLiteQuantization& src) {
+  TfLiteQuantization dst;
+  dst.type = kTfLiteNoQuantization;
+  dst.params = nullptr;
+  if (src.type == kTfLiteAffineQuantization && src.params != nullptr) {
+    const TfLiteAffineQuantization* src_params =
+        reinterpret_cast<const TfLiteAffineQuantization*>(src.params);
+    // Ownership passes to the interpreter, which releases it with free().
+    TfLiteAffineQuantization* params =
+        reinterpret_cast<TfLiteAffineQuantization*>(
+            malloc(sizeof(TfLiteAffineQuantization)));
+    params->scale = TfLiteFloatArrayCreate(src_params->scale->size);
+    memcpy(params->scale->data,
+           src_params->scale->data,
+           src_params->scale->size * sizeof(float));
+    params->zero_point = TfLiteIntArrayCopy(src_params->zero_point);
+    params->quantized_dimension = src_params->quantized_dimension;
+    dst.type = kTfLiteAffineQuantization;
+    dst.params = params;
+  }
+  return dst;
+}
+
+}  // namespace
+
+namespace vx {
+namespace delegate {
+
+std::unique_ptr<KernelRunner> KernelRunner::Create(
+    TfLiteContext* context,
+    const std::vector<OperationDataType>& operations,
+    const std::vector<int>& inputs,
+    const std::vector<int>& outputs,
+    const std::map<int, std::vector<uint8_t>>* constants) {
+  std::unique_ptr<KernelRunner> runner(new KernelRunner());
+  runner->interpreter_.reset(new tflite::Interpreter());
+  auto& interpreter = runner->interpreter_;
+
+  // Map TfLite tensor indexes of the partition to the private interpreter.
+  std::map<int, int> local_index;
+  auto map_tensor = [&local_index](int tensor_idx) {
+    if (tensor_idx < 0) {
+      return tensor_idx;
+    }
+    auto it = local_index.find(tensor_idx);
+    if (it == local_index.end()) {
+      it = local_index.emplace(tensor_idx, local_index.size()).first;
+    }
+    return it->second;
+  };
+
+  struct LocalNode {
+    std::vector<int> inputs;
+    std::vector<int> outputs;
+  };
+  std::vector<LocalNode> nodes;
+  for (const auto& op_info : operations) {
+    LocalNode node;
+    for (int tensor_idx : op_info.inputs) {
+      node.inputs.push_back(map_tensor(tensor_idx));
+    }
+    for (int tensor_idx : op_info.outputs) {
+      node.outputs.push_back(map_tensor(tensor_idx));
+    }
+    nodes.push_back(std::move(node));
+  }
+
+  if (interpreter->AddTensors(local_index.size()) != kTfLiteOk) {
+    return nullptr;
+  }
+  for (const auto& kv : local_index) {
+    const TfLiteTensor& tensor = context->tensors[kv.first];
+    if (tensor.is_variable) {
+      TFLITE_LOG(WARN) << "Variable tensors can't run on the CPU fallback";
+      return nullptr;
+    }
+    std::vector<int> dims(tensor.dims->data,
+                          tensor.dims->data + tensor.dims->size);
+    TfLiteStatus status = kTfLiteOk;
+    const std::vector<uint8_t>* constant = nullptr;
+    if (constants != nullptr) {
+      auto it = constants->find(kv.first);
+      constant = it == constants->end() ? nullptr : &it->second;
+    }
+    if (constant != nullptr) {
+      status = interpreter->SetTensorParametersReadOnly(
+          kv.second,
+          tensor.type,
+          tensor.name,
+          dims,
+          CopyQuantization(tensor.quantization),
+          reinterpret_cast<const char*>(constant->data()),
+          constant->size());
+    } else if (tensor.allocation_type == kTfLiteMmapRo) {
+      status = interpreter->SetTensorParametersReadOnly(
+          kv.second,
+          tensor.type,
+          tensor.name,
+          dims,
+          CopyQuantization(tensor.quantization),
+          tensor.data.raw_const,
+          tensor.bytes);
+    } else {
+      status = interpreter->SetTensorParametersReadWrite(
+          kv.second,
+          tensor.type,
+          tensor.name,
+          dims,
+          CopyQuantization(tensor.quantization));
+    }
+    if (status != kTfLiteOk) {
+      return nullptr;
+    }
+  }
+
+  // Constant inputs are already baked into the private tensors.
+  std::vector<int> runtime_inputs;
+  std::vector<int> local_inputs;
+  for (int tensor_idx : inputs) {
+    if (context->tensors[tensor_idx].allocation_type == kTfLiteMmapRo) {
+      continue;
+    }
+    runtime_inputs.push_back(tensor_idx);
+    local_inputs.push_back(map_tensor(tensor_idx));
+  }
+  std::vector<int> local_outputs;
+  for (int tensor_idx : outputs) {
+    local_outputs.push_back(map_tensor(tensor_idx));
+  }
+  if (local_index.size() != interpreter->tensors_size() ||
+      interpreter->SetInputs(local_inputs) != kTfLiteOk ||
+      interpreter->SetOutputs(local_outputs) != kTfLiteOk) {
+    return nullptr;
+  }
+
+  for (size_t i = 0; i < operations.size(); i++) {
+    const auto& op_info = operations[i];
+    const char* init_data = nullptr;
+    size_t init_data_size = 0;
+    void* builtin_data = nullptr;
+    if (op_info.custom_name.empty()) {
+      if (!op_info.builtin_data.empty()) {
+        // The interpreter takes ownership and releases it with free().
+        builtin_data = malloc(op_info.builtin_data.size());
+        memcpy(builtin_data,
+               op_info.builtin_data.data(),
+               op_info.builtin_data.size());
+      }
+    } else {
+      init_data = op_info.custom_initial_data;
+      init_data_size = op_info.custom_initial_data_size;
+    }
+    if (interpreter->AddNodeWithParameters(nodes[i].inputs,
+                                           nodes[i].outputs,
+                                           init_data,
+                                           init_data_size,
+                                           builtin_data,
+                                           &op_info.registration) !=
+        kTfLiteOk) {
+      return nullptr;
+    }
+  }
+
+  if (interpreter->AllocateTensors() != kTfLiteOk) {
+    TFLITE_LOG(WARN) << "Failed to prepare CPU fallback kernels";
+    return nullptr;
+  }
+
+  runner->inputs_ = runtime_inputs;
+  runner->outputs_ = outputs;
+  return runner;
+}
+
+bool KernelRunner::EvaluateConstant(
+    TfLiteContext* context,
+    const OperationDataType& operation,
+    const std::map<int, std::vector<uint8_t>>& constants,
+    std::vector<std::vector<uint8_t>>* outputs) {
+  std::unique_ptr<KernelRunner> runner =
+      Create(context, {operation}, {}, operation.outputs, &constants);
+  if (!runner || runner->interpreter_->Invoke() != kTfLiteOk) {
+    return false;
+  }
+  outputs->clear();
+  for (size_t i = 0; i < operation.outputs.size(); i++) {
+    const TfLiteTensor* src = runner->interpreter_->output_tensor(i);
+    const TfLiteTensor& dst = context->tensors[operation.outputs[i]];
+    if (!TfLiteIntArrayEqual(src->dims, dst.dims)) {
+      return false;
+    }
+    outputs->emplace_back(src->data.uint8, src->data.uint8 + src->bytes);
+  }
+  return true;
+}
+
+TfLiteStatus KernelRunner::Invoke(TfLiteContext* context) {
+  for (size_t i = 0; i < inputs_.size(); i++) {
+    const TfLiteTensor& src = context->tensors[inputs_[i]];
+    TfLiteTensor* dst = interpreter_->input_tensor(i);
+    if (src.bytes != dst->bytes) {
+      TFLITE_LOG(ERROR) << "CPU fallback input size mismatch: " << src.name;
+      return kTfLiteError;
+    }
+    memcpy(dst->data.raw, src.data.raw_const, src.bytes);
+  }
+
+  TF_LITE_ENSURE_STATUS(interpreter_->Invoke());
+
+  for (size_t i = 0; i < outputs_.size(); i++) {
+    TfLiteTensor& dst = context->tensors[outputs_[i]];
+    const TfLiteTensor* src = interpreter_->output_tensor(i);
+    if (src->bytes != dst.bytes) {
+      TFLITE_LOG(ERROR) << "CPU fallback output size mismatch: " << dst.name;
+      return kTfLiteError;
+    }
+    memcpy(dst.data.raw, src->data.raw_const, src->bytes);
+  }
+  return kTfLiteOk;
+}
+
+}  // namespace delegate
+}  // namespace vx
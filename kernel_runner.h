@@ -0,0 +1,70 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_LITE_DELEGATES_VX_DELEGAGE_KERNEL_RUNNER_H_
+#define TENSORFLOW_LITE_DELEGATES_VX_DELEGAGE_KERNEL_RUNNER_H_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "delegate_main.h"
+#include "tensorflow/lite/interpreter.h"
+
+namespace vx {
+namespace delegate {
+
+/// Runs the original nodes of a partition with the TfLite kernels they were
+/// registered with, on a private interpreter that mirrors the partition's
+/// tensors. Used while the NPU graph is not ready.
+class KernelRunner {
+ public:
+  /// Returns nullptr if the nodes can't be run on the CPU. Tensors in
+  /// `constants`, the outputs of ops removed by constant folding, are
+  /// constant with the data given there.
+  static std::unique_ptr<KernelRunner> Create(
+      TfLiteContext* context,
+      const std::vector<OperationDataType>& operations,
+      const std::vector<int>& inputs,
+      const std::vector<int>& outputs,
+      const std::map<int, std::vector<uint8_t>>* constants = nullptr);
+
+  /// Run `operation`, whose inputs are all constant, once and return the
+  /// data of its outputs. Fails if an output doesn't get the dims it has in
+  /// `context`.
+  static bool EvaluateConstant(
+      TfLiteContext* context,
+      const OperationDataType& operation,
+      const std::map<int, std::vector<uint8_t>>& constants,
+      std::vector<std::vector<uint8_t>>* outputs);
+
+  /// Copy `inputs` from `context`, run the nodes and copy `outputs` back.
+  TfLiteStatus Invoke(TfLiteContext* context);
+
+ private:
+  KernelRunner() {}
+
+  std::unique_ptr<tflite::Interpreter> interpreter_;
+  // TfLite tensor index in the delegated context of each interpreter
+  // input/output.
+  std::vector<int> inputs_;
+  std::vector<int> outputs_;
+};
+
+}  // namespace delegate
+}  // namespace vx
+
+#endif /* TENSORFLOW_LITE_DELEGATES_VX_DELEGAGE_KERNEL_RUNNER_H_ */
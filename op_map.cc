@@ -24,6 +24,7 @@ limitations under the License.
 #include <tuple>
 #include <vector>
 
+#include "trace.h"
 #include "tensorflow/lite/tools/logging.h"
 #include "tensorflow/lite/context_util.h"
 #include "tensorflow/lite/kernels/internal/reference/reference_ops.h"
@@ -278,6 +279,12 @@ struct FusedActivationAction
   }
 };
 
+// Rejects a node from IsSupported, with `why` as the reason reported for it.
+bool Reject(std::string* reason, const char* why) {
+  *reason = why;
+  return false;
+}
+
 template <typename T_Param, typename... Actions>
 struct OpMapperBase : public vx::op_map::IOpMapper {
   std::vector<std::unique_ptr<IAction>> actions_;
@@ -291,58 +298,50 @@ struct OpMapperBase : public vx::op_map::IOpMapper {
 
   bool IsSupported(TfLiteContext* context,
                    TfLiteNode* node,
-                   const TfLiteRegistration* registration) const override {
+                   const TfLiteRegistration* registration,
+                   std::string* reason) const override {
     for (int i = 0; i < node->inputs->size; i++) {
       int input_index = node->inputs->data[i];
       if (input_index < 0) {
         continue;
       }
       if (context->tensors[input_index].type == kTfLiteInt16) {
-        TFLITE_LOG(ERROR) << "Int16 input is not supported";
-        return false;
+        return Reject(reason, "int16 input");
       }
       if (context->tensors[input_index].type == kTfLiteInt64) {
-        TFLITE_LOG(ERROR) << "Int64 input is not supported";
-        return false;
+        return Reject(reason, "int64 input");
       }
       if (context->tensors[input_index].dims->size > 6) {
-        TFLITE_LOG(ERROR) << "vx-delegate doesn't support the tensor whose dimension "
-                      "is greater than 6.";
-        return false;
+        return Reject(reason, "input with more than 6 dims");
       }
       for (int j = 0; j < context->tensors[input_index].dims->size; j++) {
         if (context->tensors[input_index].dims->data[j] == 0) {
-          TFLITE_LOG(ERROR) << "vx-delegate doesn't support the tensor of which one "
-                        "of dims is 0";
-          return false;
+          return Reject(reason, "input with a zero dim");
         }
       }
     }
     for (int i = 0; i < node->outputs->size; i++) {
       int output_index = node->outputs->data[i];
       if (context->tensors[output_index].type == kTfLiteInt16) {
-        TFLITE_LOG(ERROR) << "Int16 output is not supported";
-        return false;
+        return Reject(reason, "int16 output");
       }
       if (context->tensors[output_index].type == kTfLiteInt64) {
-        TFLITE_LOG(ERROR) << "Int64 output is not supported";
-        return false;
+        return Reject(reason, "int64 output");
       }
       for (int j = 0; j < context->tensors[output_index].dims->size; j++) {
         if (context->tensors[output_index].dims->data[j] == 0) {
-          TFLITE_LOG(ERROR) << "vx-delegate doesn't support the tensor of which one "
-                        "of dims is 0";
-          return false;
+          return Reject(reason, "output with a zero dim");
         }
       }
     }
 
-    return IsOpSupported(context, node, registration);
+    return IsOpSupported(context, node, registration, reason);
   }
 
   virtual bool IsOpSupported(TfLiteContext* context,
                              TfLiteNode* node,
-                             const TfLiteRegistration* registration) const {
+                             const TfLiteRegistration* registration,
+                             std::string* reason) const {
     return true;
   }
 
@@ -392,6 +391,8 @@ struct OpMapperBase : public vx::op_map::IOpMapper {
 namespace vx {
 namespace op_map {
 
+namespace trace = vx::delegate::trace;
+
 template <typename T_OperationType>
 struct SimpleOpMapper : public OpMapperBase<EmptyStructPlaceholder> {
   std::string name_;
@@ -402,7 +403,7 @@ struct SimpleOpMapper : public OpMapperBase<EmptyStructPlaceholder> {
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Creating " << name_ << " op";
+    VX_TRACE(trace::kVerbose, "map_op", name_.c_str(), 0);
 
     auto op = delegate->GetGraph()->CreateOperation<T_OperationType>();
     (*op).BindInputs(inputs).BindOutputs(outputs);
@@ -424,7 +425,7 @@ struct SimpleOpWithFusedActiovationMapper
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Creating " << name_ << " op";
+    VX_TRACE(trace::kVerbose, "map_op", name_.c_str(), 0);
 
     auto op = delegate->GetGraph()->CreateOperation<T_OperationType>();
     (*op).BindInputs(inputs).BindOutputs(outputs);
@@ -445,7 +446,8 @@ struct FullyConnectedMapper
           FusedActivationAction<0, TfLiteFullyConnectedParams>> {
   bool IsOpSupported(TfLiteContext* context,
                      TfLiteNode* node,
-                     const TfLiteRegistration* registration) const override {
+                     const TfLiteRegistration* registration,
+                     std::string* reason) const override {
     const auto builtin =
         reinterpret_cast<const TfLiteFullyConnectedParams*>(node->builtin_data);
 
@@ -453,19 +455,16 @@ struct FullyConnectedMapper
     auto weight_tensor = context->tensors[node->inputs->data[1]];
 
     if (input_tensor.type != weight_tensor.type) {
-      TFLITE_LOG(ERROR) << "hybrid data type is not supported in fullyconnected.";
-      return false;
+      return Reject(reason, "hybrid input and weight types");
     }
     if (builtin->weights_format ==
         kTfLiteFullyConnectedWeightsFormatShuffled4x16Int8) {
-      TFLITE_LOG(ERROR) << "Shuffled weight is not supported";
-      return false;
+      return Reject(reason, "shuffled 4x16 int8 weights");
     }
     for (int i = 0; i < node->inputs->size; i++) {
       int input_index = node->inputs->data[i];
       if (context->tensors[input_index].type == kTfLiteInt16) {
-        TFLITE_LOG(ERROR) << "Int16 input is not supported";
-        return false;
+        return Reject(reason, "int16 input");
       }
     }
     return true;
@@ -475,7 +474,7 @@ struct FullyConnectedMapper
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Creating fully connected op";
+    VX_TRACE(trace::kVerbose, "map_op", "FullyConnected", 0);
     const auto builtin =
         reinterpret_cast<const TfLiteFullyConnectedParams*>(params);
     auto input_tensor = inputs[0];
@@ -519,7 +518,7 @@ struct SoftmaxMapper : public OpMapperBase<TfLiteSoftmaxParams> {
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Creating softmax op";
+    VX_TRACE(trace::kVerbose, "map_op", "Softmax", 0);
     auto builtin = reinterpret_cast<const TfLiteSoftmaxParams*>(params);
     auto op = delegate->GetGraph()->CreateOperation<tim::vx::ops::Softmax>(
         builtin->beta, 0);
@@ -534,13 +533,13 @@ struct SoftmaxMapper : public OpMapperBase<TfLiteSoftmaxParams> {
 struct Conv2dMapper : public Conv2dKind<TfLiteConvParams> {
   virtual bool IsOpSupported(TfLiteContext* context,
                              TfLiteNode* node,
-                             const TfLiteRegistration* registration) const {
+                             const TfLiteRegistration* registration,
+                             std::string* reason) const {
     auto input_tensor = context->tensors[node->inputs->data[0]];
     auto weight_tensor = context->tensors[node->inputs->data[1]];
 
     if (input_tensor.type != weight_tensor.type) {
-      TFLITE_LOG(ERROR) << "hybrid data type is not supported in conv2d.";
-      return false;
+      return Reject(reason, "hybrid input and weight types");
     }
     return true;
   }
@@ -549,7 +548,7 @@ struct Conv2dMapper : public Conv2dKind<TfLiteConvParams> {
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(ERROR) << "Creating Conv2d op";
+    VX_TRACE(trace::kVerbose, "map_op", "Conv2d", 0);
     const auto builtin = reinterpret_cast<const TfLiteConvParams*>(params);
 
     uint32_t weights = inputs[1]->GetShape()[3];
@@ -582,7 +581,7 @@ struct TransposeConvMapper
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Create TransposeConv op";
+    VX_TRACE(trace::kVerbose, "map_op", "TransposeConv", 0);
     const auto builtin =
         reinterpret_cast<const TfLiteTransposeConvParams*>(params);
     auto padding = TflitePadTypeToVsiPadType(builtin->padding);
@@ -635,7 +634,8 @@ template <tim::vx::PoolType poolType>
 struct Pool2dMapper : public Conv2dKind<TfLitePoolParams> {
   virtual bool IsOpSupported(TfLiteContext* context,
                              TfLiteNode* node,
-                             const TfLiteRegistration* registration) const {
+                             const TfLiteRegistration* registration,
+                             std::string* reason) const {
     return true;
   }
 
@@ -643,7 +643,7 @@ struct Pool2dMapper : public Conv2dKind<TfLitePoolParams> {
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Creating Pool2d(" << static_cast<int>(poolType) << ") op";
+    VX_TRACE(trace::kVerbose, "map_op", "Pool2d", static_cast<int>(poolType));
     const auto builtin = reinterpret_cast<const TfLitePoolParams*>(params);
 
     auto op = delegate->GetGraph()->CreateOperation<tim::vx::ops::Pool2d>(
@@ -668,13 +668,13 @@ struct Pool2dMapper : public Conv2dKind<TfLitePoolParams> {
 struct DepthwiseConv2dMapper : public Conv2dKind<TfLiteDepthwiseConvParams> {
   virtual bool IsOpSupported(TfLiteContext* context,
                              TfLiteNode* node,
-                             const TfLiteRegistration* registration) const {
+                             const TfLiteRegistration* registration,
+                             std::string* reason) const {
     auto input_tensor = context->tensors[node->inputs->data[0]];
     auto weight_tensor = context->tensors[node->inputs->data[1]];
 
     if (input_tensor.type != weight_tensor.type) {
-      TFLITE_LOG(ERROR) << "hybrid data type is not supported in DepthwiseConv2d.";
-      return false;
+      return Reject(reason, "hybrid input and weight types");
     }
     return true;
   }
@@ -683,7 +683,7 @@ struct DepthwiseConv2dMapper : public Conv2dKind<TfLiteDepthwiseConvParams> {
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(WARN) << "Creating DepthwiseConv2d op";
+    VX_TRACE(trace::kVerbose, "map_op", "DepthwiseConv2d", 0);
     const auto builtin =
         reinterpret_cast<const TfLiteDepthwiseConvParams*>(params);
 
@@ -717,7 +717,7 @@ struct ConcatenationMapper
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Creating Concatenation op";
+    VX_TRACE(trace::kVerbose, "map_op", "Concatenation", 0);
     const auto builtin =
         reinterpret_cast<const TfLiteConcatenationParams*>(params);
     auto output_tensor = outputs[0];
@@ -743,7 +743,7 @@ struct LocalResponseNormalizationMapper
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Creating LRN op";
+    VX_TRACE(trace::kVerbose, "map_op", "LRN", 0);
     const auto builtin =
         reinterpret_cast<const TfLiteLocalResponseNormParams*>(params);
     auto op = delegate->GetGraph()
@@ -768,7 +768,7 @@ struct L2NormalizationMapper
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Creating L2Normaliztion op";
+    VX_TRACE(trace::kVerbose, "map_op", "L2Normaliztion", 0);
     auto op =
         delegate->GetGraph()->CreateOperation<tim::vx::ops::L2Normalization>(0);
 
@@ -785,7 +785,7 @@ struct ReshapeMapper : public OpMapperBase<TfLiteReshapeParams> {
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Creating Reshape op";
+    VX_TRACE(trace::kVerbose, "map_op", "Reshape", 0);
     const auto builtin = reinterpret_cast<const TfLiteReshapeParams*>(params);
     std::vector<uint32_t> new_shape;
 
@@ -817,17 +817,15 @@ struct ReshapeMapper : public OpMapperBase<TfLiteReshapeParams> {
 struct StridedSliceMapper : public OpMapperBase<TfLiteStridedSliceParams> {
   virtual bool IsOpSupported(TfLiteContext* context,
                              TfLiteNode* node,
-                             const TfLiteRegistration* registration) const {
-    TFLITE_LOG(INFO) << "Check  StridedSlice";
+                             const TfLiteRegistration* registration,
+                             std::string* reason) const {
     const auto builtin =
         reinterpret_cast<const TfLiteStridedSliceParams*>(node->builtin_data);
     if (builtin->new_axis_mask) {
-      TFLITE_LOG(ERROR) << "new_axis_mask > 0 is not supported";
-      return false;
+      return Reject(reason, "new_axis_mask unsupported");
     }
     if (builtin->ellipsis_mask) {
-      TFLITE_LOG(ERROR) << "ellipsis_mask > 0 is not supported";
-      return false;
+      return Reject(reason, "ellipsis_mask unsupported");
     }
     return true;
   }
@@ -836,7 +834,7 @@ struct StridedSliceMapper : public OpMapperBase<TfLiteStridedSliceParams> {
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Creating StridedSlice op";
+    VX_TRACE(trace::kVerbose, "map_op", "StridedSlice", 0);
     const auto builtin =
         reinterpret_cast<const TfLiteStridedSliceParams*>(params);
     auto input_tensor = inputs[0];
@@ -939,7 +937,7 @@ struct PadMapper : public OpMapperBase<EmptyStructPlaceholder> {
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Creating Pad op";
+    VX_TRACE(trace::kVerbose, "map_op", "Pad", 0);
     auto padding = inputs[1];
     std::vector<uint32_t> padding_shape = padding->GetShape();
     uint32_t pad = 1;
@@ -985,31 +983,28 @@ struct ResizeMapper
     : public OpMapperBase<TfLiteResizeNearestNeighborParams> {
   virtual bool IsOpSupported(TfLiteContext* context,
                              TfLiteNode* node,
-                             const TfLiteRegistration* registration) const {
-    TFLITE_LOG(INFO) << "Check Resize(" << static_cast<int>(resizeType) << ")";
-
+                             const TfLiteRegistration* registration,
+                             std::string* reason) const {
     int input_index = node->inputs->data[0];
     if ((context->tensors[input_index].type == kTfLiteInt8 ||
          context->tensors[input_index].type == kTfLiteUInt8) &&
         context->tensors[input_index].quantization.type ==
             kTfLiteNoQuantization) {
-      TFLITE_LOG(ERROR)
-          << "Int8 or uint8 input without quantization is not supported in "
-             "Resize";
-      return false;
+      return Reject(reason, "unquantized int8 or uint8 input");
     }
 
     int size_tensor_idx = node->inputs->data[1];
-    const uint8_t* tensor_data = reinterpret_cast<const uint8_t*>(
-        context->tensors[size_tensor_idx].data.raw_const);
-    return tensor_data != nullptr;
+    if (context->tensors[size_tensor_idx].data.raw_const == nullptr) {
+      return Reject(reason, "non-constant size");
+    }
+    return true;
   }
 
   bool HandleMapOp(vx::delegate::Delegate* delegate,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Creating Resize(" << static_cast<int>(resizeType) << ") op";
+    VX_TRACE(trace::kVerbose, "map_op", "Resize", static_cast<int>(resizeType));
     auto input_shape = inputs[0]->GetShape();
     uint32_t resize_rank = inputs[1]->GetShape()[0];
     std::vector<int32_t> output_shape(resize_rank);
@@ -1062,7 +1057,7 @@ struct AddNMapper : public OpMapperBase<EmptyStructPlaceholder> {
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Creating AddN op";
+    VX_TRACE(trace::kVerbose, "map_op", "AddN", 0);
     auto output_tensor = outputs[0];
     auto op = delegate->GetGraph()->CreateOperation<tim::vx::ops::AddN>(
         inputs.size());
@@ -1079,17 +1074,15 @@ struct AddNMapper : public OpMapperBase<EmptyStructPlaceholder> {
 struct SplitMapper : public OpMapperBase<TfLiteSplitParams> {
   virtual bool IsOpSupported(TfLiteContext* context,
                              TfLiteNode* node,
-                             const TfLiteRegistration* registration) const {
+                             const TfLiteRegistration* registration,
+                             std::string* reason) const {
     for (int i = 0; i < node->inputs->size; i++) {
       int input_index = node->inputs->data[i];
       if ((context->tensors[input_index].type == kTfLiteInt8 ||
            context->tensors[input_index].type == kTfLiteUInt8) &&
           context->tensors[input_index].quantization.type ==
               kTfLiteNoQuantization) {
-        TFLITE_LOG(ERROR)
-            << "Int8 or uint8 input without quantization is not supported in "
-               "Split";
-        return false;
+        return Reject(reason, "unquantized int8 or uint8 input");
       }
     }
 
@@ -1099,7 +1092,7 @@ struct SplitMapper : public OpMapperBase<TfLiteSplitParams> {
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Creating Split op";
+    VX_TRACE(trace::kVerbose, "map_op", "Split", 0);
     auto axis_tensor = inputs[0];
     auto input_tensor = inputs[1];
 
@@ -1130,7 +1123,7 @@ struct SqueezeMapper : public OpMapperBase<TfLiteSqueezeParams> {
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Creating Squeeze op";
+    VX_TRACE(trace::kVerbose, "map_op", "Squeeze", 0);
     auto input_shape = inputs[0]->GetShape();
     const auto builtin = reinterpret_cast<const TfLiteSqueezeParams*>(params);
     std::vector<uint32_t> vx_axis(builtin->num_squeeze_dims);
@@ -1163,25 +1156,21 @@ struct Space2DepthMapper
     : public OpMapperBase<TfLiteSpaceToDepthParams> {
   virtual bool IsOpSupported(TfLiteContext* context,
                              TfLiteNode* node,
-                             const TfLiteRegistration* registration) const {
+                             const TfLiteRegistration* registration,
+                             std::string* reason) const {
     for (int i = 0; i < node->inputs->size; i++) {
       int input_index = node->inputs->data[i];
       if (context->tensors[input_index].type == kTfLiteInt32) {
-        TFLITE_LOG(ERROR) << "Int32 input is not supported in Space2Depth";
-        return false;
+        return Reject(reason, "int32 input");
       }
       if (context->tensors[input_index].type == kTfLiteInt64) {
-        TFLITE_LOG(ERROR) << "Int64 input is not supported in Space2Depth";
-        return false;
+        return Reject(reason, "int64 input");
       }
       if ((context->tensors[input_index].type == kTfLiteInt8 ||
            context->tensors[input_index].type == kTfLiteUInt8) &&
           context->tensors[input_index].quantization.type ==
               kTfLiteNoQuantization) {
-        TFLITE_LOG(ERROR)
-            << "Int8 or uint8 input without quantization is not supported in "
-               "Space2Depth";
-        return false;
+        return Reject(reason, "unquantized int8 or uint8 input");
       }
     }
 
@@ -1192,7 +1181,7 @@ struct Space2DepthMapper
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Create SpaceToDepth op";
+    VX_TRACE(trace::kVerbose, "map_op", "SpaceToDepth", 0);
     const auto builtin =
         reinterpret_cast<const TfLiteSpaceToDepthParams*>(params);
 
@@ -1212,25 +1201,21 @@ struct Depth2SpaceMapper
     : public OpMapperBase<TfLiteDepthToSpaceParams> {
   virtual bool IsOpSupported(TfLiteContext* context,
                              TfLiteNode* node,
-                             const TfLiteRegistration* registration) const {
+                             const TfLiteRegistration* registration,
+                             std::string* reason) const {
     for (int i = 0; i < node->inputs->size; i++) {
       int input_index = node->inputs->data[i];
       if (context->tensors[input_index].type == kTfLiteInt32) {
-        TFLITE_LOG(INFO) << "Int32 input is not supported in Depth2Space";
-        return false;
+        return Reject(reason, "int32 input");
       }
       if (context->tensors[input_index].type == kTfLiteInt64) {
-        TFLITE_LOG(INFO) << "Int64 input is not supported in Depth2Space";
-        return false;
+        return Reject(reason, "int64 input");
       }
       if ((context->tensors[input_index].type == kTfLiteInt8 ||
            context->tensors[input_index].type == kTfLiteUInt8) &&
           context->tensors[input_index].quantization.type ==
               kTfLiteNoQuantization) {
-        TFLITE_LOG(ERROR)
-            << "Int8 or uint8 input without quantization is not supported in "
-               "Depth2Space";
-        return false;
+        return Reject(reason, "unquantized int8 or uint8 input");
       }
     }
     return true;
@@ -1240,7 +1225,7 @@ struct Depth2SpaceMapper
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Create DepthToSpace op";
+    VX_TRACE(trace::kVerbose, "map_op", "DepthToSpace", 0);
     const auto builtin =
         reinterpret_cast<const TfLiteDepthToSpaceParams*>(params);
 
@@ -1261,7 +1246,7 @@ struct PreluMapper : public OpMapperBase<EmptyStructPlaceholder> {
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Create Prelu op";
+    VX_TRACE(trace::kVerbose, "map_op", "Prelu", 0);
     auto op = delegate->GetGraph()->CreateOperation<tim::vx::ops::Prelu>(0);
 
     (*op).BindInputs(inputs);
@@ -1278,7 +1263,7 @@ struct Transpose : public OpMapperBase<TfLiteTransposeParams> {
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Create Transpose op";
+    VX_TRACE(trace::kVerbose, "map_op", "Transpose", 0);
     auto perm_tensor = inputs[1];
     std::vector<uint32_t> perm(perm_tensor->GetShape()[0]);
     perm_tensor->CopyDataFromTensor(perm.data());
@@ -1301,7 +1286,7 @@ struct Gather : public OpMapperBase<TfLiteGatherParams> {
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Create Gather op";
+    VX_TRACE(trace::kVerbose, "map_op", "Gather", 0);
     const auto builtin = reinterpret_cast<const TfLiteGatherParams*>(params);
     int axis = vx::delegate::utils::ConvertAxis(builtin->axis,
                                                 inputs[0]->GetShape().size());
@@ -1321,7 +1306,7 @@ struct GatherNd : public OpMapperBase<EmptyStructPlaceholder> {
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Create GatherNd op";
+    VX_TRACE(trace::kVerbose, "map_op", "GatherNd", 0);
     std::vector<int32_t> axis({0});
     inputs[1] = ReverseInputTensor(delegate, inputs[1], axis);
     auto op = delegate->GetGraph()->CreateOperation<tim::vx::ops::GatherNd>();
@@ -1338,26 +1323,21 @@ struct GatherNd : public OpMapperBase<EmptyStructPlaceholder> {
 struct Batch2Space : public OpMapperBase<TfLiteBatchToSpaceNDParams> {
   virtual bool IsOpSupported(TfLiteContext* context,
                              TfLiteNode* node,
-                             const TfLiteRegistration* registration) const {
+                             const TfLiteRegistration* registration,
+                             std::string* reason) const {
     int input_index = node->inputs->data[0];
     if (context->tensors[input_index].dims->size != 4) {
-      TFLITE_LOG(ERROR) << "batch2space in vx-delagate only support 4D input";
-      return false;
+      return Reject(reason, "input not 4D");
     }
     int block_index = node->inputs->data[1];
     if (context->tensors[block_index].dims->data[0] != 2) {
-      TFLITE_LOG(ERROR) << "batch2space in vx-delagate only support the input whose "
-                    "spatial dimensions is 2";
-      return false;
+      return Reject(reason, "spatial dims other than 2");
     }
     if ((context->tensors[input_index].type == kTfLiteInt8 ||
          context->tensors[input_index].type == kTfLiteUInt8) &&
         context->tensors[input_index].quantization.type ==
             kTfLiteNoQuantization) {
-      TFLITE_LOG(ERROR)
-          << "Int8 or uint8 input without quantization is not supported in "
-             "Batch2Space";
-      return false;
+      return Reject(reason, "unquantized int8 or uint8 input");
     }
     return true;
   }
@@ -1366,7 +1346,7 @@ struct Batch2Space : public OpMapperBase<TfLiteBatchToSpaceNDParams> {
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Create Batch2Space op";
+    VX_TRACE(trace::kVerbose, "map_op", "Batch2Space", 0);
     // the value of block_size_num should be 2.
     int block_size_num = inputs[1]->GetShape()[0];
     std::vector<int> block_size(block_size_num);
@@ -1391,17 +1371,15 @@ struct Batch2Space : public OpMapperBase<TfLiteBatchToSpaceNDParams> {
 struct Space2Batch : public OpMapperBase<TfLiteSpaceToBatchNDParams> {
   virtual bool IsOpSupported(TfLiteContext* context,
                              TfLiteNode* node,
-                             const TfLiteRegistration* registration) const {
+                             const TfLiteRegistration* registration,
+                             std::string* reason) const {
     int input_index = node->inputs->data[0];
     if (context->tensors[input_index].dims->size != 4) {
-      TFLITE_LOG(ERROR) << "space2batch in vx-delegate only support 4D input";
-      return false;
+      return Reject(reason, "input not 4D");
     }
     int block_index = node->inputs->data[1];
     if (context->tensors[block_index].dims->data[0] != 2) {
-      TFLITE_LOG(ERROR) << "space2batch in vx-delegate only support the input whose "
-                    "spatial dimensions is 2";
-      return false;
+      return Reject(reason, "spatial dims other than 2");
     }
     return true;
   }
@@ -1409,7 +1387,7 @@ struct Space2Batch : public OpMapperBase<TfLiteSpaceToBatchNDParams> {
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Create SpaceToBatch op";
+    VX_TRACE(trace::kVerbose, "map_op", "SpaceToBatch", 0);
     // the value of block_size_num should be 2.
     int block_size_num = inputs[1]->GetShape()[0];
     std::vector<int> block_size(block_size_num);
@@ -1433,8 +1411,9 @@ struct Space2Batch : public OpMapperBase<TfLiteSpaceToBatchNDParams> {
 struct CustomOpMap : public OpMapperBase<EmptyStructPlaceholder> {
   virtual bool IsOpSupported(TfLiteContext* context,
                              TfLiteNode* node,
-                             const TfLiteRegistration* registration) const {
-    return false;
+                             const TfLiteRegistration* registration,
+                             std::string* reason) const {
+    return Reject(reason, "custom op");
   }
 };
 
@@ -1447,7 +1426,7 @@ struct ReduceOpMapper : public OpMapperBase<TfLiteReducerParams> {
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Create reduce_" << name_ << " op";
+    VX_TRACE(trace::kVerbose, "map_op", name_.c_str(), 0);
     const auto builtin = reinterpret_cast<const TfLiteReducerParams*>(params);
     auto keep_dims = builtin->keep_dims;
 
@@ -1475,7 +1454,7 @@ struct ExpandDimsMapper : public OpMapperBase<EmptyStructPlaceholder> {
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Create ExpandDims op";
+    VX_TRACE(trace::kVerbose, "map_op", "ExpandDims", 0);
 
     auto input_shape = inputs[0]->GetShape();
     int axis = 0;
@@ -1504,7 +1483,7 @@ struct LeakyReluMapper : public OpMapperBase<TfLiteLeakyReluParams> {
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Create LeakyRelu op";
+    VX_TRACE(trace::kVerbose, "map_op", "LeakyRelu", 0);
     const auto builtin = reinterpret_cast<const TfLiteLeakyReluParams*>(params);
     auto alpha = builtin->alpha;
     auto op =
@@ -1522,7 +1501,8 @@ struct LeakyReluMapper : public OpMapperBase<TfLiteLeakyReluParams> {
 struct Slice : public OpMapperBase<EmptyStructPlaceholder> {
   bool IsOpSupported(TfLiteContext* context,
                      TfLiteNode* node,
-                     const TfLiteRegistration* registration) const override {
+                     const TfLiteRegistration* registration,
+                     std::string* reason) const override {
     int input_index = node->inputs->data[0];
     int output_index = node->outputs->data[0];
     int input_dim_size = context->tensors[input_index].dims->size;
@@ -1530,8 +1510,7 @@ struct Slice : public OpMapperBase<EmptyStructPlaceholder> {
     int batch_out = context->tensors[output_index].dims->data[0];
 
     if (input_dim_size > 3 && (batch_in != batch_out)) {
-      TFLITE_LOG(ERROR) << "vx-delegate doesn't support slice in batch.";
-      return false;
+      return Reject(reason, "slice across the batch dim");
     }
 
     return true;
@@ -1541,7 +1520,7 @@ struct Slice : public OpMapperBase<EmptyStructPlaceholder> {
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Create Slice op";
+    VX_TRACE(trace::kVerbose, "map_op", "Slice", 0);
     auto input_tensor = inputs[0];
     auto begin_tensor = inputs[1];
     auto size_tensor = inputs[2];
@@ -1578,21 +1557,20 @@ struct Slice : public OpMapperBase<EmptyStructPlaceholder> {
 struct Select : public OpMapperBase<EmptyStructPlaceholder> {
   bool IsOpSupported(TfLiteContext* context,
                      TfLiteNode* node,
-                     const TfLiteRegistration* registration) const override {
+                     const TfLiteRegistration* registration,
+                     std::string* reason) const override {
     int condition_index = node->inputs->data[0];
     int input_x_index = node->inputs->data[1];
     if (context->tensors[condition_index].dims->size !=
         context->tensors[input_x_index].dims->size) {
-      TFLITE_LOG(ERROR) << "condition and input must have the same rank";
-      return false;
+      return Reject(reason, "condition and input ranks differ");
     }
     for (int i = 1; i < node->inputs->size; i++) {
       int input_index = node->inputs->data[i];
       auto input_type = context->tensors[input_index].type;
       if (input_type == kTfLiteBool || input_type == kTfLiteInt8 ||
           input_type == kTfLiteUInt8) {
-        TFLITE_LOG(ERROR) << "Bool type input is not supported";
-        return false;
+        return Reject(reason, "bool, int8 or uint8 input");
       }
     }
     for (int i = 0; i < node->outputs->size; i++) {
@@ -1600,8 +1578,7 @@ struct Select : public OpMapperBase<EmptyStructPlaceholder> {
       auto output_type = context->tensors[output_index].type;
       if (output_type == kTfLiteBool || output_type == kTfLiteInt8 ||
           output_type == kTfLiteUInt8) {
-        TFLITE_LOG(ERROR) << "Bool type output is not supported";
-        return false;
+        return Reject(reason, "bool, int8 or uint8 output");
       }
     }
 
@@ -1612,7 +1589,7 @@ struct Select : public OpMapperBase<EmptyStructPlaceholder> {
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Create Select op";
+    VX_TRACE(trace::kVerbose, "map_op", "Select", 0);
 
     auto op = delegate->GetGraph()->CreateOperation<tim::vx::ops::Select>();
 
@@ -1634,7 +1611,7 @@ struct LogicalOpMapper : public OpMapperBase<EmptyStructPlaceholder> {
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Creating Logical" << name_ << " op";
+    VX_TRACE(trace::kVerbose, "map_op", name_.c_str(), 0);
 
     auto op = delegate->GetGraph()->CreateOperation<T_OperationType>();
     (*op).BindInputs(inputs).BindOutputs(outputs);
@@ -1648,12 +1625,13 @@ struct LogicalOpMapper : public OpMapperBase<EmptyStructPlaceholder> {
 struct PackMapper : public OpMapperBase<TfLitePackParams> {
   virtual bool IsOpSupported(TfLiteContext* context,
                              TfLiteNode* node,
-                             const TfLiteRegistration* registration) const {
+                             const TfLiteRegistration* registration,
+                             std::string* reason) const {
     auto input_tensor = context->tensors[node->inputs->data[0]];
     if (input_tensor.type == kTfLiteInt32 || input_tensor.type == kTfLiteInt8 ||
         (input_tensor.dims->size == 1 && (input_tensor.type == kTfLiteInt8 ||
                                           input_tensor.type == kTfLiteUInt8))) {
-      return false;
+      return Reject(reason, "int32 or int8 input");
     }
     return true;
   }
@@ -1661,7 +1639,7 @@ struct PackMapper : public OpMapperBase<TfLitePackParams> {
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Creating Pack op";
+    VX_TRACE(trace::kVerbose, "map_op", "Pack", 0);
     const auto builtin = reinterpret_cast<const TfLitePackParams*>(params);
     uint32_t axis = vx::delegate::utils::ConvertAxis(
         builtin->axis, inputs[0]->GetShape().size() + 1);
@@ -1686,7 +1664,7 @@ struct ArgOpMapper : public OpMapperBase<EmptyStructPlaceholder> {
       std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
       std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
       const void* params) {
-    TFLITE_LOG(INFO) << "Creating Arg" << name_ << " op";
+    VX_TRACE(trace::kVerbose, "map_op", name_.c_str(), 0);
 
     auto axis_tensor = inputs[1];
     std::vector<int> axis(axis_tensor->GetShape()[0]);
@@ -1839,7 +1817,7 @@ struct NBGOpMap : public OpMapperBase<TfLiteVsiNpuParams> {
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& inputs,
                    std::vector<std::shared_ptr<tim::vx::Tensor>>& outputs,
                    const void* params) override {
-    TFLITE_LOG(INFO) << "Create NBG op";
+    VX_TRACE(trace::kVerbose, "map_op", "NBG", 0);
     const auto builtin = reinterpret_cast<const TfLiteVsiNpuParams*>(params);
     auto op = delegate->GetGraph()->CreateOperation<tim::vx::ops::NBG>(
         reinterpret_cast<const char*>(builtin->binary),
@@ -19,6 +19,7 @@ limitations under the License.
 #include <functional>
 #include <map>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include "delegate_main.h"
@@ -31,9 +32,12 @@ struct IOpMapper {
   IOpMapper() {}
   virtual ~IOpMapper() {}
 
+  // Whether the node can be mapped. If not, sets `reason` to the rule that
+  // rejected it.
   virtual bool IsSupported(TfLiteContext* context,
                            TfLiteNode* node,
-                           const TfLiteRegistration* registration) const {
+                           const TfLiteRegistration* registration,
+                           std::string* reason) const {
     return true;
   }
 
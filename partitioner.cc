@@ -0,0 +1,294 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "partitioner.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#include "utils.h"
+#include "tensorflow/lite/context_util.h"
+#include "tensorflow/lite/tools/logging.h"
+
+namespace {
+
+uint64_t NumElements(const TfLiteTensor& tensor) {
+  if (tensor.dims == nullptr) {
+    return 0;
+  }
+  uint64_t elements = 1;
+  for (int i = 0; i < tensor.dims->size; i++) {
+    elements *= std::max(tensor.dims->data[i], 1);
+  }
+  return elements;
+}
+
+// Product of the filter dims in [begin, end).
+uint64_t FilterSize(const TfLiteTensor& filter, int begin, int end) {
+  uint64_t size = 1;
+  for (int i = begin; i < std::min(end, filter.dims->size); i++) {
+    size *= std::max(filter.dims->data[i], 1);
+  }
+  return size;
+}
+
+}  // namespace
+
+namespace vx {
+namespace delegate {
+
+bool PartitionProfile::Load(const std::string& path) {
+  std::vector<char> data;
+  if (!utils::ReadFile(path, data)) {
+    return false;
+  }
+  data.push_back('\0');
+  std::lock_guard<std::mutex> lock(mutex_);
+  // One "key npu_us npu_samples cpu_us cpu_samples" line per partition.
+  const char* line = data.data();
+  while (*line != '\0') {
+    uint64_t key;
+    Entry entry;
+    unsigned long long npu_samples, cpu_samples;
+    if (sscanf(line,
+               "%" SCNx64 " %lf %llu %lf %llu",
+               &key,
+               &entry.npu_us,
+               &npu_samples,
+               &entry.cpu_us,
+               &cpu_samples) == 5) {
+      entry.npu_samples = npu_samples;
+      entry.cpu_samples = cpu_samples;
+      entries_[key] = entry;
+    }
+    const char* next = strchr(line, '\n');
+    if (next == nullptr) {
+      break;
+    }
+    line = next + 1;
+  }
+  return true;
+}
+
+bool PartitionProfile::Save(const std::string& path) {
+  std::string text;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    char line[128];
+    for (const auto& kv : entries_) {
+      snprintf(line,
+               sizeof(line),
+               "%016" PRIx64 " %.3f %llu %.3f %llu\n",
+               kv.first,
+               kv.second.npu_us,
+               static_cast<unsigned long long>(kv.second.npu_samples),
+               kv.second.cpu_us,
+               static_cast<unsigned long long>(kv.second.cpu_samples));
+      text += line;
+    }
+  }
+  return utils::WriteFileAtomic(path,
+                                std::vector<char>(text.begin(), text.end()));
+}
+
+void PartitionProfile::Record(uint64_t key, bool npu, double us) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Entry& entry = entries_[key];
+  double& average = npu ? entry.npu_us : entry.cpu_us;
+  uint64_t& samples = npu ? entry.npu_samples : entry.cpu_samples;
+  samples++;
+  average += (us - average) / samples;
+}
+
+bool PartitionProfile::Lookup(uint64_t key, Entry* entry) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(key);
+  if (it == entries_.end() || it->second.npu_samples == 0 ||
+      it->second.cpu_samples == 0) {
+    return false;
+  }
+  *entry = it->second;
+  return true;
+}
+
+uint64_t PartitionProfileKey(TfLiteContext* context,
+                             const TfLiteDelegateParams& params) {
+  uint64_t key = utils::Fnv1aHashValue(params.nodes_to_replace->size,
+                                       utils::kFnv1aOffsetBasis);
+  for (int node_index : tflite::TfLiteIntArrayView(params.nodes_to_replace)) {
+    TfLiteNode* node;
+    TfLiteRegistration* registration;
+    if (context->GetNodeAndRegistration(
+            context, node_index, &node, &registration) == kTfLiteOk) {
+      key = utils::Fnv1aHashValue(node_index, key);
+      key = utils::Fnv1aHashValue(registration->builtin_code, key);
+    }
+  }
+  auto hash_tensors = [&](const TfLiteIntArray* tensors) {
+    for (int tensor_idx : tflite::TfLiteIntArrayView(tensors)) {
+      const TfLiteTensor& tensor = context->tensors[tensor_idx];
+      key = utils::Fnv1aHashValue(tensor_idx, key);
+      key = utils::Fnv1aHashValue(tensor.type, key);
+      if (tensor.dims != nullptr) {
+        key = utils::Fnv1aHash(
+            tensor.dims->data, tensor.dims->size * sizeof(int), key);
+      }
+    }
+  };
+  hash_tensors(params.input_tensors);
+  hash_tensors(params.output_tensors);
+  return key;
+}
+
+uint64_t EstimateNodeCompute(TfLiteContext* context,
+                             const TfLiteNode* node,
+                             const TfLiteRegistration* registration) {
+  uint64_t outputs = 0;
+  for (int tensor_idx : tflite::TfLiteIntArrayView(node->outputs)) {
+    if (tensor_idx >= 0) {
+      outputs += NumElements(context->tensors[tensor_idx]);
+    }
+  }
+  if (node->inputs->size < 2 || node->inputs->data[1] < 0) {
+    return outputs;
+  }
+  const TfLiteTensor& weights = context->tensors[node->inputs->data[1]];
+  if (weights.dims == nullptr) {
+    return outputs;
+  }
+  switch (registration->builtin_code) {
+    case kTfLiteBuiltinConv2d:
+      // Filter is [out_channels, height, width, in_channels].
+      return outputs * FilterSize(weights, 1, 4);
+    case kTfLiteBuiltinDepthwiseConv2d:
+      // Filter is [1, height, width, channels].
+      return outputs * FilterSize(weights, 1, 3);
+    case kTfLiteBuiltinTransposeConv:
+      // Inputs are (output shape, filter, input), the filter is laid out as
+      // for Conv2d. Overestimates strided ones.
+      return outputs * FilterSize(weights, 1, 4);
+    case kTfLiteBuiltinFullyConnected:
+      // Weights are [out_units, in_units].
+      return outputs * FilterSize(weights, 1, 2);
+    default:
+      return outputs;
+  }
+}
+
+TfLiteStatus PlanPartitions(TfLiteContext* context,
+                            const std::vector<int>& supported_nodes,
+                            const VxDelegateOptions& options,
+                            PartitionProfile* profile,
+                            std::vector<PartitionEstimate>* plan) {
+  plan->clear();
+  if (supported_nodes.empty()) {
+    return kTfLiteOk;
+  }
+  std::vector<int> nodes_array = {static_cast<int>(supported_nodes.size())};
+  nodes_array.insert(
+      nodes_array.end(), supported_nodes.begin(), supported_nodes.end());
+  TfLiteDelegateParams* partitions = nullptr;
+  int num_partitions = 0;
+  TF_LITE_ENSURE_STATUS(context->PreviewDelegatePartitioning(
+      context,
+      reinterpret_cast<TfLiteIntArray*>(nodes_array.data()),
+      &partitions,
+      &num_partitions));
+
+  for (int i = 0; i < num_partitions; i++) {
+    const TfLiteDelegateParams& params = partitions[i];
+    PartitionEstimate estimate;
+    estimate.compute = 0;
+    estimate.transfer_bytes = 0;
+    estimate.profile_key = PartitionProfileKey(context, params);
+    estimate.delegated = true;
+    for (int node_index :
+         tflite::TfLiteIntArrayView(params.nodes_to_replace)) {
+      TfLiteNode* node;
+      TfLiteRegistration* registration;
+      TF_LITE_ENSURE_STATUS(context->GetNodeAndRegistration(
+          context, node_index, &node, &registration));
+      estimate.nodes.push_back(node_index);
+      estimate.compute += EstimateNodeCompute(context, node, registration);
+    }
+    for (int tensor_idx : tflite::TfLiteIntArrayView(params.input_tensors)) {
+      const TfLiteTensor& tensor = context->tensors[tensor_idx];
+      if (tensor.allocation_type != kTfLiteMmapRo) {
+        estimate.transfer_bytes += tensor.bytes;
+        estimate.inputs.push_back(tensor_idx);
+      }
+    }
+    for (int tensor_idx : tflite::TfLiteIntArrayView(params.output_tensors)) {
+      estimate.transfer_bytes += context->tensors[tensor_idx].bytes;
+      estimate.outputs.push_back(tensor_idx);
+    }
+
+    PartitionProfile::Entry measured;
+    if (options.calibrate) {
+      estimate.reason = "calibrating";
+    } else if (profile->Lookup(estimate.profile_key, &measured)) {
+      estimate.delegated = measured.npu_us < measured.cpu_us;
+      estimate.reason = "measured NPU " + std::to_string(measured.npu_us) +
+                        " us, CPU " + std::to_string(measured.cpu_us) + " us";
+    } else if (static_cast<int>(estimate.nodes.size()) <
+               options.min_partition_nodes) {
+      estimate.delegated = false;
+      estimate.reason = "fewer nodes than min_partition_nodes";
+    } else if (estimate.transfer_bytes > 0 &&
+               static_cast<double>(estimate.compute) /
+                       estimate.transfer_bytes <
+                   options.min_partition_benefit) {
+      estimate.delegated = false;
+      estimate.reason = "compute per transferred byte below "
+                        "min_partition_benefit";
+    }
+    plan->push_back(std::move(estimate));
+  }
+
+  if (options.max_partitions > 0 && !options.calibrate) {
+    std::vector<PartitionEstimate*> delegated;
+    for (auto& estimate : *plan) {
+      if (estimate.delegated) {
+        delegated.push_back(&estimate);
+      }
+    }
+    std::stable_sort(
+        delegated.begin(),
+        delegated.end(),
+        [](const PartitionEstimate* a, const PartitionEstimate* b) {
+          return a->compute > b->compute;
+        });
+    for (size_t i = options.max_partitions; i < delegated.size(); i++) {
+      delegated[i]->delegated = false;
+      delegated[i]->reason = "beyond max_partitions";
+    }
+  }
+
+  for (size_t i = 0; i < plan->size(); i++) {
+    const PartitionEstimate& estimate = (*plan)[i];
+    TFLITE_LOG(INFO) << "Partition " << i << ": " << estimate.nodes.size()
+                     << " nodes from node " << estimate.nodes.front()
+                     << ", compute " << estimate.compute << ", transfer "
+                     << estimate.transfer_bytes << " bytes -> "
+                     << (estimate.delegated ? "NPU" : "CPU") << " "
+                     << estimate.reason;
+  }
+  return kTfLiteOk;
+}
+
+}  // namespace delegate
+}  // namespace vx
@@ -0,0 +1,71 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_LITE_DELEGATES_VX_DELEGAGE_PARTITIONER_H_
+#define TENSORFLOW_LITE_DELEGATES_VX_DELEGAGE_PARTITIONER_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "delegate_main.h"
+
+namespace vx {
+namespace delegate {
+
+/// Estimated cost of a candidate partition, as TfLite would form it from the
+/// supported nodes.
+struct PartitionEstimate {
+  std::vector<int> nodes;
+  // Multiply-accumulates, or elements produced for ops without a reduction.
+  uint64_t compute;
+  // Bytes of non-constant inputs and of outputs crossing the partition
+  // boundary on every invoke.
+  uint64_t transfer_bytes;
+  // Those non-constant input and output tensors.
+  std::vector<int> inputs;
+  std::vector<int> outputs;
+  // PartitionProfileKey() of the partition.
+  uint64_t profile_key;
+  bool delegated;
+  // Why the partition stays on the CPU, or a measured reason to delegate.
+  std::string reason;
+};
+
+/// Identifies a partition across runs of the same model, for
+/// PartitionProfile.
+uint64_t PartitionProfileKey(TfLiteContext* context,
+                             const TfLiteDelegateParams& params);
+
+/// Estimated compute of one node, see PartitionEstimate::compute.
+uint64_t EstimateNodeCompute(TfLiteContext* context,
+                             const TfLiteNode* node,
+                             const TfLiteRegistration* registration);
+
+/// Group `supported_nodes` into the partitions TfLite would create and drop
+/// those that `options` rules too small or too costly to transfer, keeping at
+/// most `max_partitions` by estimated compute. Partitions measured in
+/// `profile` go to the faster side instead, and with `calibrate` all are
+/// delegated. Logs the plan.
+TfLiteStatus PlanPartitions(TfLiteContext* context,
+                            const std::vector<int>& supported_nodes,
+                            const VxDelegateOptions& options,
+                            PartitionProfile* profile,
+                            std::vector<PartitionEstimate>* plan);
+
+}  // namespace delegate
+}  // namespace vx
+
+#endif /* TENSORFLOW_LITE_DELEGATES_VX_DELEGAGE_PARTITIONER_H_ */
@@ -0,0 +1,110 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "stats.h"
+
+#include <cmath>
+
+namespace vx {
+namespace delegate {
+
+constexpr int LatencyHistogram::kSubBuckets;
+constexpr int LatencyHistogram::kBuckets;
+
+int LatencyHistogram::Bucket(uint64_t ns) {
+  if (ns < kSubBuckets) {
+    return static_cast<int>(ns);
+  }
+  // ns is in [2^log, 2^(log+1)), split by its two bits after the leading one.
+  const int log = 63 - __builtin_clzll(ns);
+  const int sub = static_cast<int>(ns >> (log - 2)) & (kSubBuckets - 1);
+  return (log - 1) * kSubBuckets + sub;
+}
+
+uint64_t LatencyHistogram::BucketUpperBound(int bucket) {
+  if (bucket < kSubBuckets) {
+    return bucket;
+  }
+  const int log = bucket / kSubBuckets + 1;
+  const uint64_t sub = bucket % kSubBuckets;
+  return ((kSubBuckets + sub + 1) << (log - 2)) - 1;
+}
+
+void LatencyHistogram::Record(uint64_t ns) {
+  buckets_[Bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  total_ns_.fetch_add(ns, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::Reset() {
+  for (auto& bucket : buckets_) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+  count_.store(0, std::memory_order_relaxed);
+  total_ns_.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::Percentile(double percentile) const {
+  uint64_t counts[kBuckets];
+  uint64_t total = 0;
+  for (int i = 0; i < kBuckets; i++) {
+    counts[i] = buckets_[i].load(std::memory_order_relaxed);
+    total += counts[i];
+  }
+  if (total == 0) {
+    return 0;
+  }
+  uint64_t rank = static_cast<uint64_t>(std::ceil(percentile / 100 * total));
+  rank = rank < 1 ? 1 : (rank > total ? total : rank);
+  uint64_t seen = 0;
+  for (int i = 0; i < kBuckets; i++) {
+    seen += counts[i];
+    if (seen >= rank) {
+      return BucketUpperBound(i);
+    }
+  }
+  return BucketUpperBound(kBuckets - 1);
+}
+
+void DelegateStats::RecordCompile(int32_t partition_id,
+                                  int nodes,
+                                  const GraphPassCounts& passes,
+                                  int aliased_reshapes,
+                                  uint64_t build_ns,
+                                  uint64_t ns) {
+  std::lock_guard<std::mutex> lock(compile_mutex);
+  Partition& partition = compiles[partition_id];
+  partition.nodes = nodes;
+  partition.passes = passes;
+  partition.aliased_reshapes = aliased_reshapes;
+  partition.compiles++;
+  partition.compile_ns += ns;
+  partition.build_ns += build_ns;
+}
+
+void DelegateStats::Reset() {
+  invokes.store(0, std::memory_order_relaxed);
+  copy_in.Reset();
+  run.Reset();
+  copy_out.Reset();
+  bytes_in.store(0, std::memory_order_relaxed);
+  bytes_out.store(0, std::memory_order_relaxed);
+  failed_compiles.store(0, std::memory_order_relaxed);
+  std::lock_guard<std::mutex> lock(compile_mutex);
+  compiles.clear();
+}
+
+}  // namespace delegate
+}  // namespace vx
@@ -0,0 +1,127 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_LITE_DELEGATES_VX_DELEGAGE_STATS_H_
+#define TENSORFLOW_LITE_DELEGATES_VX_DELEGAGE_STATS_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace vx {
+namespace delegate {
+
+/// Latency distribution with four buckets per power of two nanoseconds, so
+/// percentiles are within 25%. Recording is a few relaxed atomic adds and
+/// may race with reads, which see a slightly stale distribution.
+class LatencyHistogram {
+ public:
+  LatencyHistogram() { Reset(); }
+
+  void Record(uint64_t ns);
+  void Reset();
+
+  uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+  uint64_t total_ns() const {
+    return total_ns_.load(std::memory_order_relaxed);
+  }
+  /// Upper bound of the bucket holding the `percentile` (0-100) sample, or 0
+  /// if nothing was recorded.
+  uint64_t Percentile(double percentile) const;
+
+ private:
+  static constexpr int kSubBuckets = 4;
+  static constexpr int kBuckets = 64 * kSubBuckets;
+
+  static int Bucket(uint64_t ns);
+  static uint64_t BucketUpperBound(int bucket);
+
+  std::atomic<uint64_t> buckets_[kBuckets];
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> total_ns_;
+};
+
+/// Rewrites of a partition's ops by the passes of graph_passes.h.
+struct GraphPassCounts {
+  int folded_ops = 0;
+  int fused_activations = 0;
+  int removed_converts = 0;
+  int removed_reshapes = 0;
+};
+
+/// Counts of one partition kernel, with the nodes it replaced.
+struct KernelPasses {
+  std::vector<int> nodes;
+  GraphPassCounts counts;
+};
+
+/// Runtime statistics of one delegate, see VxDelegateGetStats().
+struct DelegateStats {
+  struct Partition {
+    int nodes = 0;
+    GraphPassCounts passes;
+    // Reshapes to the dims they already have, left out of the last graph.
+    int aliased_reshapes = 0;
+    uint64_t compiles = 0;
+    uint64_t compile_ns = 0;
+    // Part of compile_ns spent building the graph and inferring its layout.
+    uint64_t build_ns = 0;
+  };
+
+  /// Nanoseconds on the steady clock, for timing the phases.
+  static uint64_t Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  /// Add a compile of `nodes` nodes rewritten by `passes`, with
+  /// `aliased_reshapes` left out of the graph, taking `ns`, `build_ns` of
+  /// which built the graph, to partition `partition_id`.
+  void RecordCompile(int32_t partition_id,
+                     int nodes,
+                     const GraphPassCounts& passes,
+                     int aliased_reshapes,
+                     uint64_t build_ns,
+                     uint64_t ns);
+  /// Clear the invoke and compile counters, keeping the partitioning.
+  void Reset();
+
+  std::atomic<uint64_t> invokes{0};
+  LatencyHistogram copy_in;
+  LatencyHistogram run;
+  LatencyHistogram copy_out;
+  std::atomic<uint64_t> bytes_in{0};
+  std::atomic<uint64_t> bytes_out{0};
+
+  // Partitioning of the model the delegate was last applied to.
+  std::atomic<int> partitions{0};
+  std::atomic<int> delegated_nodes{0};
+  std::atomic<int> total_nodes{0};
+
+  // Background compiles of `async_compile` that failed.
+  std::atomic<uint64_t> failed_compiles{0};
+  // Compiles happen rarely, so they are kept per partition under a lock.
+  std::mutex compile_mutex;
+  std::map<int32_t, Partition> compiles;
+};
+
+}  // namespace delegate
+}  // namespace vx
+
+#endif /* TENSORFLOW_LITE_DELEGATES_VX_DELEGAGE_STATS_H_ */
@@ -0,0 +1,201 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "trace.h"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+
+#include "tensorflow/lite/tools/logging.h"
+
+namespace {
+
+constexpr uint64_t kCapacity = 1 << 14;
+
+// A slot is a small seqlock: `sequence` is 0 while the writer fills it and
+// the event's position + 1 once complete, so readers can drop slots that
+// were being overwritten.
+struct Slot {
+  std::atomic<uint64_t> sequence;
+  std::atomic<uint64_t> timestamp_ns;
+  std::atomic<const char*> category;
+  std::atomic<const char*> name;
+  std::atomic<int64_t> arg;
+  std::atomic<uint32_t> thread_id;
+  std::atomic<int32_t> partition;
+  std::atomic<char> phase;
+};
+
+struct Ring {
+  std::atomic<uint64_t> head{0};
+  Slot slots[kCapacity];
+};
+
+Ring& GetRing() {
+  static Ring* ring = new Ring();
+  return *ring;
+}
+
+uint32_t ThreadId() {
+  static std::atomic<uint32_t> next_id{1};
+  thread_local uint32_t id = next_id++;
+  return id;
+}
+
+thread_local int32_t current_partition = -1;
+
+// Writes `text` as a JSON string. Event names and categories are
+// identifiers, so only quotes and backslashes need escaping.
+void WriteJsonString(FILE* file, const char* text) {
+  fputc('"', file);
+  for (const char* c = text; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\') {
+      fputc('\\', file);
+    }
+    fputc(*c, file);
+  }
+  fputc('"', file);
+}
+
+}  // namespace
+
+namespace vx {
+namespace delegate {
+namespace trace {
+
+std::atomic<int> g_level{kOff};
+
+void SetLevel(int level) {
+#ifndef VX_DELEGATE_ENABLE_TRACE
+  if (level > kOff) {
+    TFLITE_LOG(WARN) << "Tracing is not compiled in, rebuild with "
+                        "VX_DELEGATE_ENABLE_TRACE";
+  }
+#endif
+  g_level.store(level, std::memory_order_relaxed);
+}
+
+void Record(char phase, const char* category, const char* name, int64_t arg) {
+  Ring& ring = GetRing();
+  uint64_t position = ring.head.fetch_add(1, std::memory_order_relaxed);
+  Slot& slot = ring.slots[position % kCapacity];
+  uint64_t timestamp_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count();
+
+  slot.sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.timestamp_ns.store(timestamp_ns, std::memory_order_relaxed);
+  slot.category.store(category, std::memory_order_relaxed);
+  slot.name.store(name, std::memory_order_relaxed);
+  slot.arg.store(arg, std::memory_order_relaxed);
+  slot.thread_id.store(ThreadId(), std::memory_order_relaxed);
+  slot.partition.store(current_partition, std::memory_order_relaxed);
+  slot.phase.store(phase, std::memory_order_relaxed);
+  slot.sequence.store(position + 1, std::memory_order_release);
+}
+
+std::vector<Event> Snapshot() {
+  Ring& ring = GetRing();
+  uint64_t head = ring.head.load(std::memory_order_acquire);
+  uint64_t begin = head > kCapacity ? head - kCapacity : 0;
+  std::vector<Event> events;
+  events.reserve(head - begin);
+  for (uint64_t position = begin; position < head; position++) {
+    const Slot& slot = ring.slots[position % kCapacity];
+    if (slot.sequence.load(std::memory_order_acquire) != position + 1) {
+      continue;
+    }
+    Event event;
+    event.timestamp_ns = slot.timestamp_ns.load(std::memory_order_relaxed);
+    event.category = slot.category.load(std::memory_order_relaxed);
+    event.name = slot.name.load(std::memory_order_relaxed);
+    event.arg = slot.arg.load(std::memory_order_relaxed);
+    event.thread_id = slot.thread_id.load(std::memory_order_relaxed);
+    event.partition = slot.partition.load(std::memory_order_relaxed);
+    event.phase = slot.phase.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) == position + 1) {
+      events.push_back(event);
+    }
+  }
+  return events;
+}
+
+bool DumpToFile(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    TFLITE_LOG(ERROR) << "Failed to open " << path << " for the trace";
+    return false;
+  }
+  for (const Event& event : Snapshot()) {
+    fprintf(file,
+            "%" PRIu64 " %" PRIu32 " %" PRId32 " %c %s %s %" PRId64 "\n",
+            event.timestamp_ns,
+            event.thread_id,
+            event.partition,
+            event.phase,
+            event.category,
+            event.name,
+            event.arg);
+  }
+  return fclose(file) == 0;
+}
+
+bool DumpChromeTrace(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    TFLITE_LOG(ERROR) << "Failed to open " << path << " for the trace";
+    return false;
+  }
+  const int pid = getpid();
+  fprintf(file, "{\"traceEvents\":[");
+  bool first = true;
+  for (const Event& event : Snapshot()) {
+    fprintf(file, first ? "\n" : ",\n");
+    first = false;
+    fprintf(file, "{\"name\":");
+    WriteJsonString(file, event.name);
+    fprintf(file, ",\"cat\":");
+    WriteJsonString(file, event.category);
+    fprintf(file,
+            ",\"ph\":\"%c\",%s\"ts\":%.3f,\"pid\":%d,\"tid\":%" PRIu32
+            ",\"args\":{\"partition\":%" PRId32 ",\"arg\":%" PRId64 "}}",
+            event.phase,
+            event.phase == 'i' ? "\"s\":\"t\"," : "",
+            event.timestamp_ns / 1000.0,
+            pid,
+            event.thread_id,
+            event.partition,
+            event.arg);
+  }
+  fprintf(file, "\n]}\n");
+  return fclose(file) == 0;
+}
+
+PartitionScope::PartitionScope(int32_t partition)
+    : previous_(current_partition) {
+  current_partition = partition;
+}
+
+PartitionScope::~PartitionScope() { current_partition = previous_; }
+
+}  // namespace trace
+}  // namespace delegate
+}  // namespace vx
@@ -0,0 +1,131 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_LITE_DELEGATES_VX_DELEGAGE_TRACE_H_
+#define TENSORFLOW_LITE_DELEGATES_VX_DELEGAGE_TRACE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Tracing records timestamped events into a process-wide lock-free ring
+// buffer. It is compiled in only with VX_DELEGATE_ENABLE_TRACE; otherwise the
+// macros below expand to nothing and their arguments are not evaluated.
+// Event categories and names must be string literals, or strings that live
+// as long as the process, since only the pointers are recorded.
+
+namespace vx {
+namespace delegate {
+namespace trace {
+
+enum Level {
+  kOff = 0,
+  // Per invoke and per graph build events.
+  kInvoke = 1,
+  // Also per tensor copy and per mapped op events.
+  kVerbose = 2,
+};
+
+struct Event {
+  uint64_t timestamp_ns;
+  const char* category;
+  const char* name;
+  // Bytes copied for copy events, otherwise specific to the event.
+  int64_t arg;
+  uint32_t thread_id;
+  // Partition the recording thread was working on, or -1.
+  int32_t partition;
+  // 'B' begin, 'E' end or 'i' instant, as in the Chrome trace format.
+  char phase;
+};
+
+extern std::atomic<int> g_level;
+
+void SetLevel(int level);
+
+inline bool Enabled(int level) {
+  return level <= g_level.load(std::memory_order_relaxed);
+}
+
+void Record(char phase, const char* category, const char* name, int64_t arg);
+
+// Events still in the ring buffer, oldest first.
+std::vector<Event> Snapshot();
+
+// Write Snapshot() to `path` as text, one event per line.
+bool DumpToFile(const std::string& path);
+
+// Write Snapshot() to `path` as a chrome://tracing (Trace Event Format) JSON
+// file, with the partition and arg of each event in its args.
+bool DumpChromeTrace(const std::string& path);
+
+class ScopedEvent {
+ public:
+  ScopedEvent(int level, const char* category, const char* name, int64_t arg)
+      : category_(category), name_(name), arg_(arg), enabled_(Enabled(level)) {
+    if (enabled_) Record('B', category_, name_, arg_);
+  }
+  ~ScopedEvent() {
+    if (enabled_) Record('E', category_, name_, arg_);
+  }
+
+ private:
+  const char* category_;
+  const char* name_;
+  int64_t arg_;
+  bool enabled_;
+};
+
+// Tags the events recorded by the current thread with `partition` for its
+// lifetime.
+class PartitionScope {
+ public:
+  explicit PartitionScope(int32_t partition);
+  ~PartitionScope();
+
+ private:
+  int32_t previous_;
+};
+
+}  // namespace trace
+}  // namespace delegate
+}  // namespace vx
+
+#ifdef VX_DELEGATE_ENABLE_TRACE
+#define VX_TRACE_CONCAT_INNER(a, b) a##b
+#define VX_TRACE_CONCAT(a, b) VX_TRACE_CONCAT_INNER(a, b)
+#define VX_TRACE(level, category, name, arg)                            \
+  do {                                                                  \
+    if (::vx::delegate::trace::Enabled(level)) {                        \
+      ::vx::delegate::trace::Record('i', (category), (name), (arg));    \
+    }                                                                   \
+  } while (0)
+#define VX_TRACE_SCOPE(level, category, name, arg)                     \
+  ::vx::delegate::trace::ScopedEvent VX_TRACE_CONCAT(vx_trace_scope_,  \
+                                                     __LINE__)(        \
+      (level), (category), (name), (arg))
+#define VX_TRACE_PARTITION(partition)                                    \
+  ::vx::delegate::trace::PartitionScope VX_TRACE_CONCAT(                 \
+      vx_trace_partition_, __LINE__)(partition)
+#else
+#define VX_TRACE(level, category, name, arg) \
+  do {                                       \
+  } while (0)
+#define VX_TRACE_SCOPE(level, category, name, arg)
+#define VX_TRACE_PARTITION(partition)
+#endif
+
+#endif /* TENSORFLOW_LITE_DELEGATES_VX_DELEGAGE_TRACE_H_ */
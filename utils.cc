@@ -15,6 +15,13 @@ limitations under the License.
 
 #include "utils.h"
 
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
 namespace vx {
 namespace delegate {
 namespace utils {
@@ -61,7 +68,57 @@ void GenerateWeightDataForNearest(float* data,
   return;
 }
 
+uint64_t Checksum(const void* data, size_t size) {
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+  uint64_t hash = kFnv1aOffsetBasis ^ size;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, bytes + i, sizeof(word));
+    hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+    hash ^= hash >> 32;
+  }
+  return Fnv1aHash(bytes + i, size - i, hash);
+}
 
+bool ReadFile(const std::string& path, std::vector<char>& data) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file.is_open()) {
+    return false;
+  }
+  std::streamsize size = file.tellg();
+  if (size < 0) {
+    return false;
+  }
+  file.seekg(0, std::ios::beg);
+  data.resize(size);
+  return static_cast<bool>(file.read(data.data(), size));
+}
+
+bool WriteFileAtomic(const std::string& path, const std::vector<char>& data) {
+  static std::atomic<uint32_t> sequence{0};
+  std::string tmp_path = path + ".tmp." + std::to_string(getpid()) + "." +
+                         std::to_string(sequence++);
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+      TFLITE_LOG(ERROR) << "Failed to open " << tmp_path << " for writing";
+      return false;
+    }
+    file.write(data.data(), data.size());
+    if (!file) {
+      TFLITE_LOG(ERROR) << "Failed to write " << tmp_path;
+      std::remove(tmp_path.c_str());
+      return false;
+    }
+  }
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    TFLITE_LOG(ERROR) << "Failed to rename " << tmp_path << " to " << path;
+    std::remove(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
 
 }  // namespace utils
 }  // namespace delegate
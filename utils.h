@@ -17,6 +17,7 @@ limitations under the License.
 #define TENSORFLOW_LITE_DELEGATES_VX_DELEGAGE_UTILS_H_
 
 #include <cstdint>
+#include <string>
 #include <vector>
 #include <limits>
 #include <cmath>
@@ -105,6 +106,37 @@ inline void Quantize(const std::vector<float>& data, float scale,
   }
 }
 
+constexpr uint64_t kFnv1aOffsetBasis = 14695981039346656037ULL;
+
+// 64-bit FNV-1a hash of `size` bytes, chained from `seed`.
+inline uint64_t Fnv1aHash(const void* data,
+                          size_t size,
+                          uint64_t seed = kFnv1aOffsetBasis) {
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+  uint64_t hash = seed;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+template <typename T>
+inline uint64_t Fnv1aHashValue(const T& value, uint64_t seed) {
+  return Fnv1aHash(&value, sizeof(T), seed);
+}
+
+// Fast 64-bit checksum of `size` bytes, mixing a word at a time. Meant for
+// change detection of tensor data, not for persistent keys.
+uint64_t Checksum(const void* data, size_t size);
+
+// Read the whole file at `path` into `data`.
+bool ReadFile(const std::string& path, std::vector<char>& data);
+
+// Write `data` to `path` through a temporary file and rename, so concurrent
+// readers never observe a partially written file.
+bool WriteFileAtomic(const std::string& path, const std::vector<char>& data);
+
 }  // namespace utils
 }  // namespace delegate
 }  // namespace vx
@@ -49,6 +49,25 @@ TfLiteDelegate* CreateVxDelegateFromOptions(char** options_keys,
   constexpr char kReportErrorDuingInit[] = "error_during_init";
   constexpr char kReportErrorDuingPrepare[] = "error_during_prepare";
   constexpr char kReportErrorDuingInvoke[] = "error_during_invoke";
+  constexpr char kCacheDir[] = "cache_dir";
+  constexpr char kAsyncCompile[] = "async_compile";
+  constexpr char kMaxCachedGraphs[] = "max_cached_graphs";
+  constexpr char kSkipUnchangedInputs[] = "skip_unchanged_inputs";
+  constexpr char kTraceLevel[] = "trace_level";
+  constexpr char kAsyncInvoke[] = "async_invoke";
+  constexpr char kPipelineDepth[] = "pipeline_depth";
+  constexpr char kMinPartitionNodes[] = "min_partition_nodes";
+  constexpr char kMinPartitionBenefit[] = "min_partition_benefit";
+  constexpr char kMaxPartitions[] = "max_partitions";
+  constexpr char kProfilePath[] = "profile_path";
+  constexpr char kCalibrate[] = "calibrate";
+  constexpr char kTraceFile[] = "trace_file";
+  constexpr char kCoverageFile[] = "coverage_file";
+
+  std::string cache_dir;
+  std::string profile_path;
+  std::string trace_file;
+  std::string coverage_file;
 
   std::vector<tflite::Flag> flag_list = {
       tflite::Flag::CreateFlag(kAllowedBuiltinOp, &options.allowed_builtin_code,
@@ -62,6 +81,60 @@ TfLiteDelegate* CreateVxDelegateFromOptions(char** options_keys,
       tflite::Flag::CreateFlag(kReportErrorDuingInvoke,
                                &options.error_during_invoke,
                                "Report error during invoke."),
+      tflite::Flag::CreateFlag(kCacheDir,
+                               &cache_dir,
+                               "Directory for caching compiled graphs."),
+      tflite::Flag::CreateFlag(kAsyncCompile,
+                               &options.async_compile,
+                               "Compile graphs in the background and run on "
+                               "the CPU until they are ready."),
+      tflite::Flag::CreateFlag(kMaxCachedGraphs,
+                               &options.max_cached_graphs,
+                               "Compiled graphs kept for other input shapes."),
+      tflite::Flag::CreateFlag(kSkipUnchangedInputs,
+                               &options.skip_unchanged_inputs,
+                               "Don't re-upload inputs whose contents are "
+                               "unchanged."),
+      tflite::Flag::CreateFlag(kTraceLevel,
+                               &options.trace_level,
+                               "Trace level: 0 off, 1 invokes, 2 verbose."),
+      tflite::Flag::CreateFlag(kAsyncInvoke,
+                               &options.async_invoke,
+                               "Return from Invoke once the inputs are "
+                               "uploaded for partitions whose outputs are "
+                               "all bound to buffer handles."),
+      tflite::Flag::CreateFlag(kPipelineDepth,
+                               &options.pipeline_depth,
+                               "Compiled copies of each async_invoke graph "
+                               "to overlap uploads with runs."),
+      tflite::Flag::CreateFlag(kMinPartitionNodes,
+                               &options.min_partition_nodes,
+                               "Smallest partition to delegate, in nodes."),
+      tflite::Flag::CreateFlag(kMinPartitionBenefit,
+                               &options.min_partition_benefit,
+                               "Least estimated MACs per transferred byte "
+                               "of a delegated partition."),
+      tflite::Flag::CreateFlag(kMaxPartitions,
+                               &options.max_partitions,
+                               "Most partitions to delegate, 0 for no "
+                               "limit."),
+      tflite::Flag::CreateFlag(kProfilePath,
+                               &profile_path,
+                               "File of measured partition latencies."),
+      tflite::Flag::CreateFlag(kCalibrate,
+                               &options.calibrate,
+                               "Time partitions on the NPU and the CPU and "
+                               "save them to profile_path. Runs each "
+                               "partition on both for its first 17 "
+                               "invokes."),
+      tflite::Flag::CreateFlag(kTraceFile,
+                               &trace_file,
+                               "chrome://tracing JSON file to write the "
+                               "trace to on exit."),
+      tflite::Flag::CreateFlag(kCoverageFile,
+                               &coverage_file,
+                               "JSON file to write the delegation coverage "
+                               "report to."),
   };
 
   int argc = num_options + 1;
@@ -77,7 +150,37 @@ TfLiteDelegate* CreateVxDelegateFromOptions(char** options_keys,
                    << options.error_during_prepare << ".";
   TFLITE_LOG(INFO) << "Vx delegate: error_during_invoke set to "
                    << options.error_during_invoke << ".";
-
+  TFLITE_LOG(INFO) << "Vx delegate: cache_dir set to " << cache_dir << ".";
+  TFLITE_LOG(INFO) << "Vx delegate: async_compile set to "
+                   << options.async_compile << ".";
+  TFLITE_LOG(INFO) << "Vx delegate: max_cached_graphs set to "
+                   << options.max_cached_graphs << ".";
+  TFLITE_LOG(INFO) << "Vx delegate: skip_unchanged_inputs set to "
+                   << options.skip_unchanged_inputs << ".";
+  TFLITE_LOG(INFO) << "Vx delegate: trace_level set to "
+                   << options.trace_level << ".";
+  TFLITE_LOG(INFO) << "Vx delegate: async_invoke set to "
+                   << options.async_invoke << ".";
+  TFLITE_LOG(INFO) << "Vx delegate: pipeline_depth set to "
+                   << options.pipeline_depth << ".";
+  TFLITE_LOG(INFO) << "Vx delegate: min_partition_nodes set to "
+                   << options.min_partition_nodes << ".";
+  TFLITE_LOG(INFO) << "Vx delegate: min_partition_benefit set to "
+                   << options.min_partition_benefit << ".";
+  TFLITE_LOG(INFO) << "Vx delegate: max_partitions set to "
+                   << options.max_partitions << ".";
+  TFLITE_LOG(INFO) << "Vx delegate: profile_path set to " << profile_path
+                   << ".";
+  TFLITE_LOG(INFO) << "Vx delegate: calibrate set to " << options.calibrate
+                   << ".";
+  TFLITE_LOG(INFO) << "Vx delegate: trace_file set to " << trace_file << ".";
+  TFLITE_LOG(INFO) << "Vx delegate: coverage_file set to " << coverage_file
+                   << ".";
+
+  options.cache_dir = cache_dir.c_str();
+  options.profile_path = profile_path.c_str();
+  options.trace_file = trace_file.c_str();
+  options.coverage_file = coverage_file.c_str();
   return VxDelegateCreate(&options);
 }
 
@@ -99,4 +202,41 @@ TFL_CAPI_EXPORT void tflite_plugin_destroy_delegate(TfLiteDelegate* delegate) {
   vx::delegate::VxDelegateDelete(delegate);
 }
 
+// Runtime statistics of a delegate created above, for applications that
+// load this library through the external delegate. See VxDelegateGetStats in
+// delegate_main.h.
+TFL_CAPI_EXPORT TfLiteStatus vx_delegate_get_stats(
+    const TfLiteDelegate* delegate, vx::delegate::VxDelegateStats* stats) {
+  return vx::delegate::VxDelegateGetStats(delegate, stats);
+}
+
+TFL_CAPI_EXPORT TfLiteStatus vx_delegate_get_partition_stats(
+    const TfLiteDelegate* delegate, int index,
+    vx::delegate::VxDelegatePartitionStats* stats) {
+  return vx::delegate::VxDelegateGetPartitionStats(delegate, index, stats);
+}
+
+TFL_CAPI_EXPORT void vx_delegate_reset_stats(TfLiteDelegate* delegate) {
+  vx::delegate::VxDelegateResetStats(delegate);
+}
+
+// Buffer handles and asynchronous completion, for `async_invoke` through the
+// external delegate. See the functions of the same names in delegate_main.h.
+TFL_CAPI_EXPORT TfLiteBufferHandle vx_delegate_register_buffer_handle(
+    TfLiteDelegate* delegate, void* data, size_t bytes) {
+  return vx::delegate::VxDelegateRegisterBufferHandle(delegate, data, bytes);
+}
+
+TFL_CAPI_EXPORT void vx_delegate_set_completion_callback(
+    TfLiteDelegate* delegate,
+    vx::delegate::VxDelegateCompletionCallback callback,
+    void* user_data) {
+  vx::delegate::VxDelegateSetCompletionCallback(delegate, callback, user_data);
+}
+
+TFL_CAPI_EXPORT TfLiteStatus vx_delegate_wait_for_completion(
+    TfLiteDelegate* delegate) {
+  return vx::delegate::VxDelegateWaitForCompletion(delegate);
+}
+
 }  // extern "C"
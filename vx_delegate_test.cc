@@ -0,0 +1,1584 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include <gtest/gtest.h>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "delegate_main.h"
+#include "trace.h"
+#include "tensorflow/lite/interpreter.h"
+#include "tensorflow/lite/kernels/register.h"
+
+namespace {
+
+constexpr int kTensorSize = 1024;
+
+struct DelegateDeleter {
+  void operator()(TfLiteDelegate* delegate) {
+    vx::delegate::VxDelegateDelete(delegate);
+  }
+};
+using DelegatePtr = std::unique_ptr<TfLiteDelegate, DelegateDeleter>;
+
+DelegatePtr CreateDelegate() {
+  VxDelegateOptions options = vx::delegate::VxDelegateOptionsDefault();
+  return DelegatePtr(vx::delegate::VxDelegateCreate(&options));
+}
+
+// Builds `num_adds` independent `out_i = a_i + b_i` nodes on float tensors of
+// `size` elements and hands them to `delegate`. Inputs are a_0, b_0, a_1, ...
+std::unique_ptr<tflite::Interpreter> BuildAddInterpreter(
+    TfLiteDelegate* delegate, int num_adds = 1, int size = kTensorSize) {
+  tflite::ops::builtin::BuiltinOpResolver resolver;
+  std::unique_ptr<tflite::Interpreter> interpreter(new tflite::Interpreter());
+  std::vector<int> inputs;
+  std::vector<int> outputs;
+  for (int i = 0; i < num_adds; i++) {
+    inputs.push_back(3 * i);
+    inputs.push_back(3 * i + 1);
+    outputs.push_back(3 * i + 2);
+  }
+  if (interpreter->AddTensors(3 * num_adds) != kTfLiteOk ||
+      interpreter->SetInputs(inputs) != kTfLiteOk ||
+      interpreter->SetOutputs(outputs) != kTfLiteOk) {
+    return nullptr;
+  }
+  for (int i = 0; i < 3 * num_adds; i++) {
+    TfLiteQuantization quantization;
+    quantization.type = kTfLiteNoQuantization;
+    quantization.params = nullptr;
+    if (interpreter->SetTensorParametersReadWrite(
+            i, kTfLiteFloat32, "", {1, size}, quantization) != kTfLiteOk) {
+      return nullptr;
+    }
+  }
+
+  for (int i = 0; i < num_adds; i++) {
+    auto* params =
+        reinterpret_cast<TfLiteAddParams*>(malloc(sizeof(TfLiteAddParams)));
+    memset(params, 0, sizeof(TfLiteAddParams));
+    params->activation = kTfLiteActNone;
+    if (interpreter->AddNodeWithParameters(
+            {3 * i, 3 * i + 1},
+            {3 * i + 2},
+            nullptr,
+            0,
+            params,
+            resolver.FindOp(tflite::BuiltinOperator_ADD, 1)) != kTfLiteOk) {
+      return nullptr;
+    }
+  }
+  if (interpreter->ModifyGraphWithDelegate(delegate) != kTfLiteOk ||
+      interpreter->AllocateTensors() != kTfLiteOk) {
+    return nullptr;
+  }
+  return interpreter;
+}
+
+// Adds the tensors and nodes of a model to an empty interpreter.
+using ModelBuilder = std::function<void(tflite::Interpreter*)>;
+
+// Builds the model of `build` and hands it to `delegate`, or leaves it all on
+// the TfLite CPU kernels if null, for a reference to compare with.
+std::unique_ptr<tflite::Interpreter> BuildInterpreter(
+    const ModelBuilder& build, TfLiteDelegate* delegate) {
+  std::unique_ptr<tflite::Interpreter> interpreter(new tflite::Interpreter());
+  build(interpreter.get());
+  if (::testing::Test::HasFatalFailure() ||
+      (delegate != nullptr &&
+       interpreter->ModifyGraphWithDelegate(delegate) != kTfLiteOk) ||
+      interpreter->AllocateTensors() != kTfLiteOk) {
+    return nullptr;
+  }
+  return interpreter;
+}
+
+// Per-tensor quantization by `scale` and `zero_point`, owned by the tensor
+// it is set on.
+TfLiteQuantization AffineQuantization(float scale, int zero_point) {
+  auto* affine = reinterpret_cast<TfLiteAffineQuantization*>(
+      malloc(sizeof(TfLiteAffineQuantization)));
+  affine->scale = TfLiteFloatArrayCreate(1);
+  affine->scale->data[0] = scale;
+  affine->zero_point = TfLiteIntArrayCreate(1);
+  affine->zero_point->data[0] = zero_point;
+  affine->quantized_dimension = 0;
+  TfLiteQuantization quantization;
+  quantization.type = kTfLiteAffineQuantization;
+  quantization.params = affine;
+  return quantization;
+}
+
+TfLiteQuantization NoQuantization() {
+  TfLiteQuantization quantization;
+  quantization.type = kTfLiteNoQuantization;
+  quantization.params = nullptr;
+  return quantization;
+}
+
+template <typename T>
+void ExpectNear(const TfLiteTensor& actual,
+                const TfLiteTensor& expected,
+                double tolerance) {
+  const T* actual_data = reinterpret_cast<const T*>(actual.data.raw_const);
+  const T* expected_data = reinterpret_cast<const T*>(expected.data.raw_const);
+  for (size_t i = 0; i < actual.bytes / sizeof(T); i++) {
+    if (std::abs(static_cast<double>(actual_data[i]) - expected_data[i]) >
+        tolerance) {
+      ADD_FAILURE() << "output " << actual.name << " at " << i << ": "
+                    << +actual_data[i] << ", CPU reference "
+                    << +expected_data[i];
+      return;
+    }
+  }
+}
+
+// Feeds `reference` the inputs already in `delegated`, invokes both and
+// expects every output within `tolerance` of the reference, in units of the
+// output type.
+void ExpectMatchesReference(tflite::Interpreter* delegated,
+                            tflite::Interpreter* reference,
+                            double tolerance) {
+  ASSERT_EQ(delegated->inputs().size(), reference->inputs().size());
+  for (size_t i = 0; i < delegated->inputs().size(); i++) {
+    const TfLiteTensor* from = delegated->input_tensor(i);
+    TfLiteTensor* to = reference->input_tensor(i);
+    ASSERT_EQ(from->bytes, to->bytes);
+    memcpy(to->data.raw, from->data.raw_const, from->bytes);
+  }
+  ASSERT_EQ(delegated->Invoke(), kTfLiteOk);
+  ASSERT_EQ(reference->Invoke(), kTfLiteOk);
+  ASSERT_EQ(delegated->outputs().size(), reference->outputs().size());
+  for (size_t i = 0; i < delegated->outputs().size(); i++) {
+    const TfLiteTensor& actual = *delegated->output_tensor(i);
+    const TfLiteTensor& expected = *reference->output_tensor(i);
+    ASSERT_EQ(actual.type, expected.type);
+    ASSERT_EQ(actual.bytes, expected.bytes);
+    switch (actual.type) {
+      case kTfLiteFloat32:
+        ExpectNear<float>(actual, expected, tolerance);
+        break;
+      case kTfLiteUInt8:
+        ExpectNear<uint8_t>(actual, expected, tolerance);
+        break;
+      case kTfLiteInt8:
+        ExpectNear<int8_t>(actual, expected, tolerance);
+        break;
+      default:
+        ADD_FAILURE() << "unexpected output type "
+                      << TfLiteTypeGetName(actual.type);
+    }
+  }
+}
+
+// `out = activation(a + b)` on uint8 tensors of kTensorSize elements. The
+// inputs are quantized by 1/16 and 128, the output by `output_scale` and
+// `output_zero_point`.
+ModelBuilder QuantizedAddModel(TfLiteFusedActivation activation,
+                               float output_scale,
+                               int output_zero_point) {
+  return [=](tflite::Interpreter* interpreter) {
+    tflite::ops::builtin::BuiltinOpResolver resolver;
+    ASSERT_EQ(interpreter->AddTensors(3), kTfLiteOk);
+    ASSERT_EQ(interpreter->SetInputs({0, 1}), kTfLiteOk);
+    ASSERT_EQ(interpreter->SetOutputs({2}), kTfLiteOk);
+    for (int i = 0; i < 3; i++) {
+      ASSERT_EQ(interpreter->SetTensorParametersReadWrite(
+                    i, kTfLiteUInt8, "", {1, kTensorSize},
+                    i == 2 ? AffineQuantization(output_scale,
+                                                output_zero_point)
+                           : AffineQuantization(1.f / 16, 128)),
+                kTfLiteOk);
+    }
+    auto* params =
+        reinterpret_cast<TfLiteAddParams*>(malloc(sizeof(TfLiteAddParams)));
+    memset(params, 0, sizeof(TfLiteAddParams));
+    params->activation = activation;
+    ASSERT_EQ(interpreter->AddNodeWithParameters(
+                  {0, 1}, {2}, nullptr, 0, params,
+                  resolver.FindOp(tflite::BuiltinOperator_ADD, 1)),
+              kTfLiteOk);
+  };
+}
+
+// `out = a * b + a` on float tensors of {1, kTensorSize}, whose first
+// dimension can be resized.
+void FloatMulAddModel(tflite::Interpreter* interpreter) {
+  tflite::ops::builtin::BuiltinOpResolver resolver;
+  ASSERT_EQ(interpreter->AddTensors(4), kTfLiteOk);
+  ASSERT_EQ(interpreter->SetInputs({0, 1}), kTfLiteOk);
+  ASSERT_EQ(interpreter->SetOutputs({3}), kTfLiteOk);
+  for (int i = 0; i < 4; i++) {
+    ASSERT_EQ(interpreter->SetTensorParametersReadWrite(
+                  i, kTfLiteFloat32, "", {1, kTensorSize}, NoQuantization()),
+              kTfLiteOk);
+  }
+  auto* mul_params =
+      reinterpret_cast<TfLiteMulParams*>(malloc(sizeof(TfLiteMulParams)));
+  memset(mul_params, 0, sizeof(TfLiteMulParams));
+  ASSERT_EQ(interpreter->AddNodeWithParameters(
+                {0, 1}, {2}, nullptr, 0, mul_params,
+                resolver.FindOp(tflite::BuiltinOperator_MUL, 1)),
+            kTfLiteOk);
+  auto* add_params =
+      reinterpret_cast<TfLiteAddParams*>(malloc(sizeof(TfLiteAddParams)));
+  memset(add_params, 0, sizeof(TfLiteAddParams));
+  ASSERT_EQ(interpreter->AddNodeWithParameters(
+                {2, 0}, {3}, nullptr, 0, add_params,
+                resolver.FindOp(tflite::BuiltinOperator_ADD, 1)),
+            kTfLiteOk);
+}
+
+// Resizes the inputs of FloatMulAddModel in both interpreters to `batch`
+// rows, fills `interpreter`'s from `seed` and expects it to match
+// `reference`.
+void RunMulAddBatch(tflite::Interpreter* interpreter,
+                    tflite::Interpreter* reference,
+                    int batch,
+                    int seed) {
+  for (auto* target : {interpreter, reference}) {
+    if (target->input_tensor(0)->dims->data[0] == batch) {
+      continue;
+    }
+    for (int input = 0; input < 2; input++) {
+      ASSERT_EQ(target->ResizeInputTensor(input, {batch, kTensorSize}),
+                kTfLiteOk);
+    }
+    ASSERT_EQ(target->AllocateTensors(), kTfLiteOk);
+  }
+  float* a = interpreter->typed_input_tensor<float>(0);
+  float* b = interpreter->typed_input_tensor<float>(1);
+  for (int i = 0; i < batch * kTensorSize; i++) {
+    // Quarters and halves, so products and sums are exact on both sides.
+    a[i] = 0.25f * ((i + seed) % 13) - 1.f;
+    b[i] = 0.5f * (i % 7) + batch;
+  }
+  ExpectMatchesReference(interpreter, reference, 0);
+}
+
+// Runs `iterations` invokes with inputs derived from `seed` and returns the
+// number of invokes that failed or produced a wrong result.
+int RunAdds(tflite::Interpreter* interpreter, int seed, int iterations) {
+  int failures = 0;
+  for (int iter = 0; iter < iterations; iter++) {
+    float* a = interpreter->typed_input_tensor<float>(0);
+    float* b = interpreter->typed_input_tensor<float>(1);
+    for (int i = 0; i < kTensorSize; i++) {
+      a[i] = static_cast<float>(seed);
+      b[i] = static_cast<float>(iter + i % 7);
+    }
+    if (interpreter->Invoke() != kTfLiteOk) {
+      failures++;
+      continue;
+    }
+    const float* out = interpreter->typed_output_tensor<float>(0);
+    for (int i = 0; i < kTensorSize; i++) {
+      if (out[i] != static_cast<float>(seed + iter + i % 7)) {
+        failures++;
+        break;
+      }
+    }
+  }
+  return failures;
+}
+
+// Paths of the compiled graphs saved in `dir`.
+std::vector<std::string> CachedGraphs(const std::string& dir) {
+  std::vector<std::string> paths;
+  DIR* handle = opendir(dir.c_str());
+  if (handle == nullptr) {
+    return paths;
+  }
+  while (dirent* entry = readdir(handle)) {
+    std::string name = entry->d_name;
+    if (name.size() > 4 && name.compare(name.size() - 4, 4, ".nbg") == 0) {
+      paths.push_back(dir + "/" + name);
+    }
+  }
+  closedir(handle);
+  return paths;
+}
+
+// Build time of partition 0 of `delegate`, none if it was loaded from the
+// compiled graph cache.
+double PartitionBuildMs(TfLiteDelegate* delegate) {
+  vx::delegate::VxDelegatePartitionStats partition;
+  if (vx::delegate::VxDelegateGetPartitionStats(delegate, 0, &partition) !=
+      kTfLiteOk) {
+    return -1;
+  }
+  return partition.build_ms;
+}
+
+// Completion callback holding the first `held` asynchronous runs, each until
+// its own Release(), so tests can observe runs still in flight. A held run
+// gives up after 10 seconds rather than deadlock an Invoke waiting for it.
+class CompletionGate {
+ public:
+  explicit CompletionGate(int held = 1) : held_(held) {}
+
+  static void Callback(void* user_data, TfLiteStatus status) {
+    auto* gate = reinterpret_cast<CompletionGate*>(user_data);
+    std::unique_lock<std::mutex> lock(gate->mutex_);
+    const int call = gate->entered_++;
+    gate->cv_.notify_all();
+    if (call < gate->held_ &&
+        !gate->cv_.wait_for(lock, std::chrono::seconds(10), [gate]() {
+          return gate->released_ > call;
+        })) {
+      gate->timed_out_ = true;
+    }
+    if (gate->on_complete) {
+      gate->on_complete(call, status);
+    }
+    if (status == kTfLiteOk) {
+      gate->completed_++;
+    }
+  }
+
+  // Called for every run, in completion order, once it is released.
+  std::function<void(int call, TfLiteStatus status)> on_complete;
+
+  void Release() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    released_++;
+    cv_.notify_all();
+  }
+  // Waits up to 10 seconds for `calls` runs to reach the callback.
+  bool WaitEntered(int calls) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return cv_.wait_for(lock, std::chrono::seconds(10), [&]() {
+      return entered_ >= calls;
+    });
+  }
+  int completed() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return completed_;
+  }
+  bool timed_out() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return timed_out_;
+  }
+
+ private:
+  const int held_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  int entered_ = 0;
+  int completed_ = 0;
+  int released_ = 0;
+  bool timed_out_ = false;
+};
+
+TEST(VxDelegateTest, CreateReturnsIndependentInstances) {
+  VxDelegateOptions options = vx::delegate::VxDelegateOptionsDefault();
+  options.async_compile = true;
+  DelegatePtr async_delegate(vx::delegate::VxDelegateCreate(&options));
+  DelegatePtr default_delegate(vx::delegate::VxDelegateCreate(nullptr));
+  ASSERT_NE(async_delegate, nullptr);
+  ASSERT_NE(default_delegate, nullptr);
+  EXPECT_NE(async_delegate.get(), default_delegate.get());
+  EXPECT_NE(async_delegate->data_, default_delegate->data_);
+  EXPECT_NE(async_delegate.get(), vx::delegate::VxDelegate());
+
+  auto* async_data =
+      reinterpret_cast<vx::delegate::DelegateData*>(async_delegate->data_);
+  auto* default_data =
+      reinterpret_cast<vx::delegate::DelegateData*>(default_delegate->data_);
+  EXPECT_TRUE(async_data->options.async_compile);
+  EXPECT_FALSE(default_data->options.async_compile);
+
+  // The shared delegate isn't deleted and stays usable.
+  vx::delegate::VxDelegateDelete(vx::delegate::VxDelegate());
+  auto interpreter = BuildAddInterpreter(vx::delegate::VxDelegate());
+  ASSERT_NE(interpreter, nullptr);
+  EXPECT_EQ(RunAdds(interpreter.get(), 1, 1), 0);
+}
+
+TEST(VxDelegateTest, LoadsCompiledGraphsFromCacheDir) {
+  std::string cache_dir = ::testing::TempDir() + "/vx_nbg_cache";
+  mkdir(cache_dir.c_str(), 0755);
+  for (const std::string& path : CachedGraphs(cache_dir)) {
+    std::remove(path.c_str());
+  }
+  VxDelegateOptions options = vx::delegate::VxDelegateOptionsDefault();
+  options.cache_dir = cache_dir.c_str();
+  {
+    DelegatePtr delegate(vx::delegate::VxDelegateCreate(&options));
+    auto interpreter = BuildAddInterpreter(delegate.get());
+    ASSERT_NE(interpreter, nullptr);
+    EXPECT_EQ(RunAdds(interpreter.get(), 1, 2), 0);
+    EXPECT_GT(PartitionBuildMs(delegate.get()), 0);
+  }
+  std::vector<std::string> cached = CachedGraphs(cache_dir);
+  ASSERT_EQ(cached.size(), 1);
+  std::vector<char> nbg(1 << 24);
+  FILE* file = fopen(cached[0].c_str(), "rb");
+  ASSERT_NE(file, nullptr);
+  nbg.resize(fread(nbg.data(), 1, nbg.size(), file));
+  fclose(file);
+  ASSERT_GT(nbg.size(), 16);
+
+  // A fresh delegate loads the graph instead of building it.
+  {
+    DelegatePtr delegate(vx::delegate::VxDelegateCreate(&options));
+    auto interpreter = BuildAddInterpreter(delegate.get());
+    ASSERT_NE(interpreter, nullptr);
+    EXPECT_EQ(RunAdds(interpreter.get(), 2, 2), 0);
+    EXPECT_EQ(PartitionBuildMs(delegate.get()), 0);
+  }
+
+  // Truncated and corrupt files are ignored, the graph is compiled again.
+  std::vector<char> truncated(nbg.begin(), nbg.begin() + 10);
+  std::vector<char> corrupt(nbg);
+  corrupt[0] ^= 0xff;
+  for (const std::vector<char>* data : {&truncated, &corrupt}) {
+    file = fopen(cached[0].c_str(), "wb");
+    ASSERT_NE(file, nullptr);
+    ASSERT_EQ(fwrite(data->data(), 1, data->size(), file), data->size());
+    fclose(file);
+    DelegatePtr delegate(vx::delegate::VxDelegateCreate(&options));
+    auto interpreter = BuildAddInterpreter(delegate.get());
+    ASSERT_NE(interpreter, nullptr);
+    EXPECT_EQ(RunAdds(interpreter.get(), 3, 2), 0);
+    EXPECT_GT(PartitionBuildMs(delegate.get()), 0);
+  }
+}
+
+TEST(VxDelegateTest, AsyncCompileServesInvokesOnCpuUntilCompiled) {
+  VxDelegateOptions options = vx::delegate::VxDelegateOptionsDefault();
+  options.async_compile = true;
+  DelegatePtr delegate(vx::delegate::VxDelegateCreate(&options));
+  auto interpreter = BuildInterpreter(FloatMulAddModel, delegate.get());
+  auto reference = BuildInterpreter(FloatMulAddModel, nullptr);
+  ASSERT_NE(interpreter, nullptr);
+  ASSERT_NE(reference, nullptr);
+
+  // Every invoke runs either on the CPU fallback or on the NPU graph, and
+  // matches the CPU kernels, until the background compile is published.
+  vx::delegate::VxDelegateStats stats;
+  uint64_t invokes = 0;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::minutes(5);
+  do {
+    ASSERT_LT(std::chrono::steady_clock::now(), deadline);
+    RunMulAddBatch(interpreter.get(), reference.get(), 1, invokes);
+    ASSERT_FALSE(HasFailure());
+    invokes++;
+    ASSERT_EQ(vx::delegate::VxDelegateGetStats(delegate.get(), &stats),
+              kTfLiteOk);
+    EXPECT_EQ(vx::delegate::VxDelegateGetFallbackInvokeCount(delegate.get()) +
+                  stats.run.count,
+              invokes);
+    if (stats.run.count == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  } while (stats.run.count == 0);
+
+  // Once on the NPU, the partition stays there.
+  const uint64_t fallback_invokes =
+      vx::delegate::VxDelegateGetFallbackInvokeCount(delegate.get());
+  EXPECT_EQ(fallback_invokes, invokes - 1);
+  for (int seed = 0; seed < 3; seed++) {
+    RunMulAddBatch(interpreter.get(), reference.get(), 1, seed);
+  }
+  EXPECT_EQ(vx::delegate::VxDelegateGetFallbackInvokeCount(delegate.get()),
+            fallback_invokes);
+  ASSERT_EQ(vx::delegate::VxDelegateGetStats(delegate.get(), &stats),
+            kTfLiteOk);
+  EXPECT_EQ(stats.run.count, 4);
+  EXPECT_EQ(stats.failed_compiles, 0);
+}
+
+TEST(VxDelegateTest, AsyncCompileFollowsResizesWithoutWaiting) {
+  VxDelegateOptions options = vx::delegate::VxDelegateOptionsDefault();
+  options.async_compile = true;
+  options.max_cached_graphs = 2;
+  DelegatePtr delegate(vx::delegate::VxDelegateCreate(&options));
+  auto interpreter = BuildInterpreter(FloatMulAddModel, delegate.get());
+  auto reference = BuildInterpreter(FloatMulAddModel, nullptr);
+  ASSERT_NE(interpreter, nullptr);
+  ASSERT_NE(reference, nullptr);
+
+  // Resizing while the batch 1 graph may still be compiling neither waits
+  // for it nor runs it on batch 2 inputs.
+  vx::delegate::VxDelegateStats stats;
+  int seed = 0;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::minutes(5);
+  do {
+    ASSERT_LT(std::chrono::steady_clock::now(), deadline);
+    RunMulAddBatch(interpreter.get(), reference.get(), 2, seed++);
+    ASSERT_FALSE(HasFailure());
+    ASSERT_EQ(vx::delegate::VxDelegateGetStats(delegate.get(), &stats),
+              kTfLiteOk);
+    if (stats.run.count == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  } while (stats.run.count == 0);
+  EXPECT_EQ(stats.failed_compiles, 0);
+
+  // Both graphs got compiled, and going back to batch 1 runs the cached one
+  // right away.
+  vx::delegate::VxDelegatePartitionStats partition;
+  ASSERT_EQ(vx::delegate::VxDelegateGetPartitionStats(
+                delegate.get(), 0, &partition),
+            kTfLiteOk);
+  EXPECT_EQ(partition.compiles, 2);
+  const uint64_t fallback_invokes =
+      vx::delegate::VxDelegateGetFallbackInvokeCount(delegate.get());
+  RunMulAddBatch(interpreter.get(), reference.get(), 1, seed);
+  EXPECT_EQ(vx::delegate::VxDelegateGetFallbackInvokeCount(delegate.get()),
+            fallback_invokes);
+  ASSERT_EQ(vx::delegate::VxDelegateGetPartitionStats(
+                delegate.get(), 0, &partition),
+            kTfLiteOk);
+  EXPECT_EQ(partition.compiles, 2);
+}
+
+TEST(VxDelegateTest, DelegatesAddNode) {
+  DelegatePtr delegate = CreateDelegate();
+  auto interpreter = BuildAddInterpreter(delegate.get());
+  ASSERT_NE(interpreter, nullptr);
+  ASSERT_EQ(interpreter->execution_plan().size(), 1);
+  const auto* node_and_reg =
+      interpreter->node_and_registration(interpreter->execution_plan()[0]);
+  EXPECT_EQ(node_and_reg->second.builtin_code, kTfLiteBuiltinDelegate);
+  EXPECT_EQ(RunAdds(interpreter.get(), 3, 4), 0);
+}
+
+TEST(VxDelegateTest, LabelsDelegateNodeWithItsOps) {
+  DelegatePtr delegate = CreateDelegate();
+  auto interpreter = BuildAddInterpreter(delegate.get(), 2);
+  ASSERT_NE(interpreter, nullptr);
+  ASSERT_EQ(interpreter->execution_plan().size(), 1);
+  const auto* node_and_reg =
+      interpreter->node_and_registration(interpreter->execution_plan()[0]);
+  ASSERT_NE(node_and_reg->second.profiling_string, nullptr);
+  EXPECT_STREQ(
+      node_and_reg->second.profiling_string(nullptr, &node_and_reg->first),
+      "Vx Delegate nodes 0-1 (ADD)");
+}
+
+TEST(VxDelegateTest, SmallPartitionsStayOnCpu) {
+  // t = floor(in + in), out = t * t + t. FLOOR stays on the CPU and splits
+  // the supported nodes into partitions {0} and {2, 3}, the first too small
+  // for min_partition_nodes.
+  ModelBuilder model = [](tflite::Interpreter* interpreter) {
+    tflite::ops::builtin::BuiltinOpResolver resolver;
+    ASSERT_EQ(interpreter->AddTensors(5), kTfLiteOk);
+    ASSERT_EQ(interpreter->SetInputs({0}), kTfLiteOk);
+    ASSERT_EQ(interpreter->SetOutputs({4}), kTfLiteOk);
+    for (int i = 0; i < 5; i++) {
+      ASSERT_EQ(interpreter->SetTensorParametersReadWrite(
+                    i, kTfLiteFloat32, "", {1, kTensorSize}, NoQuantization()),
+                kTfLiteOk);
+    }
+    auto add = [&](int a, int b, int output) {
+      auto* params =
+          reinterpret_cast<TfLiteAddParams*>(malloc(sizeof(TfLiteAddParams)));
+      memset(params, 0, sizeof(TfLiteAddParams));
+      ASSERT_EQ(interpreter->AddNodeWithParameters(
+                    {a, b}, {output}, nullptr, 0, params,
+                    resolver.FindOp(tflite::BuiltinOperator_ADD, 1)),
+                kTfLiteOk);
+    };
+    add(0, 0, 1);
+    ASSERT_EQ(interpreter->AddNodeWithParameters(
+                  {1}, {2}, nullptr, 0, nullptr,
+                  resolver.FindOp(tflite::BuiltinOperator_FLOOR, 1)),
+              kTfLiteOk);
+    auto* mul_params =
+        reinterpret_cast<TfLiteMulParams*>(malloc(sizeof(TfLiteMulParams)));
+    memset(mul_params, 0, sizeof(TfLiteMulParams));
+    ASSERT_EQ(interpreter->AddNodeWithParameters(
+                  {2, 2}, {3}, nullptr, 0, mul_params,
+                  resolver.FindOp(tflite::BuiltinOperator_MUL, 1)),
+              kTfLiteOk);
+    add(3, 2, 4);
+  };
+  VxDelegateOptions options = vx::delegate::VxDelegateOptionsDefault();
+  options.min_partition_nodes = 2;
+  DelegatePtr delegate(vx::delegate::VxDelegateCreate(&options));
+  auto interpreter = BuildInterpreter(model, delegate.get());
+  auto reference = BuildInterpreter(model, nullptr);
+  ASSERT_NE(interpreter, nullptr);
+  ASSERT_NE(reference, nullptr);
+
+  const auto& plan = interpreter->execution_plan();
+  ASSERT_EQ(plan.size(), 3);
+  const TfLiteBuiltinOperator expected_ops[] = {
+      kTfLiteBuiltinAdd, kTfLiteBuiltinFloor, kTfLiteBuiltinDelegate};
+  for (int i = 0; i < 3; i++) {
+    EXPECT_EQ(interpreter->node_and_registration(plan[i])->second.builtin_code,
+              expected_ops[i])
+        << "at " << i;
+  }
+
+  float* in = interpreter->typed_input_tensor<float>(0);
+  for (int i = 0; i < kTensorSize; i++) {
+    in[i] = 0.3f * (i % 50) - 5.f;
+  }
+  ExpectMatchesReference(interpreter.get(), reference.get(), 0);
+}
+
+TEST(VxDelegateTest, ProfilePlacesPartitionsOnFasterSide) {
+  std::string profile_path = ::testing::TempDir() + "/vx_partition_profile";
+  std::remove(profile_path.c_str());
+  VxDelegateOptions options = vx::delegate::VxDelegateOptionsDefault();
+  options.profile_path = profile_path.c_str();
+  options.calibrate = true;
+  {
+    DelegatePtr delegate(vx::delegate::VxDelegateCreate(&options));
+    auto interpreter = BuildAddInterpreter(delegate.get());
+    ASSERT_NE(interpreter, nullptr);
+    // One warm-up and 16 timed invokes on both sides, then the NPU only.
+    EXPECT_EQ(RunAdds(interpreter.get(), 1, 20), 0);
+  }
+
+  FILE* file = fopen(profile_path.c_str(), "r");
+  ASSERT_NE(file, nullptr);
+  char key[32];
+  double npu_us = 0, cpu_us = 0;
+  unsigned long long npu_samples = 0, cpu_samples = 0;
+  int fields = fscanf(
+      file, "%31s %lf %llu %lf %llu", key, &npu_us, &npu_samples, &cpu_us,
+      &cpu_samples);
+  fclose(file);
+  ASSERT_EQ(fields, 5);
+  EXPECT_EQ(npu_samples, 16);
+  EXPECT_EQ(cpu_samples, 16);
+
+  options.calibrate = false;
+  DelegatePtr delegate(vx::delegate::VxDelegateCreate(&options));
+  auto interpreter = BuildAddInterpreter(delegate.get());
+  ASSERT_NE(interpreter, nullptr);
+  const auto* node_and_reg =
+      interpreter->node_and_registration(interpreter->execution_plan()[0]);
+  EXPECT_EQ(node_and_reg->second.builtin_code,
+            npu_us < cpu_us ? kTfLiteBuiltinDelegate : kTfLiteBuiltinAdd);
+  EXPECT_EQ(RunAdds(interpreter.get(), 2, 2), 0);
+}
+
+TEST(VxDelegateTest, ReusesGraphsCompiledForEarlierShapes) {
+  VxDelegateOptions options = vx::delegate::VxDelegateOptionsDefault();
+  options.max_cached_graphs = 2;
+  DelegatePtr delegate(vx::delegate::VxDelegateCreate(&options));
+  auto interpreter = BuildInterpreter(FloatMulAddModel, delegate.get());
+  auto reference = BuildInterpreter(FloatMulAddModel, nullptr);
+  ASSERT_NE(interpreter, nullptr);
+  ASSERT_NE(reference, nullptr);
+
+  // Resizes to `batch` rows, checks the outputs against the CPU kernels and
+  // returns the compiles of the partition so far.
+  int seed = 0;
+  auto run_batch = [&](int batch) -> uint64_t {
+    RunMulAddBatch(interpreter.get(), reference.get(), batch, seed++);
+    vx::delegate::VxDelegatePartitionStats partition;
+    EXPECT_EQ(vx::delegate::VxDelegateGetPartitionStats(
+                  delegate.get(), 0, &partition),
+              kTfLiteOk);
+    return partition.compiles;
+  };
+
+  EXPECT_EQ(run_batch(1), 1);
+  // A new shape recompiles in Prepare, going back reuses the first graph.
+  EXPECT_EQ(run_batch(2), 2);
+  EXPECT_EQ(run_batch(1), 2);
+  // With batch 1 and 2 cached, batch 3 compiles. Going back to batch 1
+  // touches it and puts batch 3 aside, which evicts the least recently
+  // used batch 2 graph.
+  EXPECT_EQ(run_batch(3), 3);
+  EXPECT_EQ(run_batch(1), 3);
+  EXPECT_EQ(run_batch(2), 4);
+  // A graph taken from the cache keeps working for new inputs.
+  EXPECT_EQ(run_batch(2), 4);
+}
+
+TEST(VxDelegateTest, PartitionsShareOneContext) {
+  DelegatePtr delegate = CreateDelegate();
+  int64_t contexts = vx::delegate::VxDelegateGetLiveContextCount();
+  int64_t graphs = vx::delegate::VxDelegateGetLiveGraphCount();
+  {
+    auto first = BuildAddInterpreter(delegate.get());
+    auto second = BuildAddInterpreter(delegate.get());
+    ASSERT_NE(first, nullptr);
+    ASSERT_NE(second, nullptr);
+    EXPECT_EQ(vx::delegate::VxDelegateGetLiveContextCount(), contexts + 1);
+    EXPECT_EQ(vx::delegate::VxDelegateGetLiveGraphCount(), graphs + 2);
+  }
+  delegate.reset();
+  EXPECT_EQ(vx::delegate::VxDelegateGetLiveContextCount(), contexts);
+  EXPECT_EQ(vx::delegate::VxDelegateGetLiveGraphCount(), graphs);
+}
+
+TEST(VxDelegateTest, BufferHandlesBindCallerMemory) {
+  DelegatePtr delegate = CreateDelegate();
+  auto interpreter = BuildAddInterpreter(delegate.get());
+  ASSERT_NE(interpreter, nullptr);
+
+  std::vector<float> a(kTensorSize, 1.0f);
+  std::vector<float> b(kTensorSize, 2.0f);
+  std::vector<float> out(kTensorSize, 0.0f);
+  const size_t bytes = kTensorSize * sizeof(float);
+  std::vector<float>* buffers[] = {&a, &b, &out};
+  for (int i = 0; i < 3; i++) {
+    TfLiteBufferHandle handle = vx::delegate::VxDelegateRegisterBufferHandle(
+        delegate.get(), buffers[i]->data(), bytes);
+    ASSERT_NE(handle, kTfLiteNullBufferHandle);
+    ASSERT_EQ(interpreter->SetBufferHandle(i, handle, delegate.get()),
+              kTfLiteOk);
+  }
+
+  ASSERT_EQ(interpreter->Invoke(), kTfLiteOk);
+  EXPECT_EQ(out, std::vector<float>(kTensorSize, 3.0f));
+  EXPECT_TRUE(interpreter->tensor(2)->data_is_stale);
+
+  ASSERT_EQ(interpreter->EnsureTensorDataIsReadable(2), kTfLiteOk);
+  const float* data = interpreter->typed_output_tensor<float>(0);
+  EXPECT_EQ(std::vector<float>(data, data + kTensorSize), out);
+}
+
+TEST(VxDelegateTest, AsyncInvokeWritesOutputsOnCompletion) {
+  constexpr int kFrames = 4;
+  VxDelegateOptions options = vx::delegate::VxDelegateOptionsDefault();
+  options.async_invoke = true;
+  DelegatePtr delegate(vx::delegate::VxDelegateCreate(&options));
+  auto interpreter = BuildAddInterpreter(delegate.get());
+  ASSERT_NE(interpreter, nullptr);
+
+  CompletionGate gate(kFrames);
+  vx::delegate::VxDelegateSetCompletionCallback(
+      delegate.get(), CompletionGate::Callback, &gate);
+  std::vector<float> out(kTensorSize, 0.0f);
+  TfLiteBufferHandle handle = vx::delegate::VxDelegateRegisterBufferHandle(
+      delegate.get(), out.data(), out.size() * sizeof(float));
+  ASSERT_EQ(interpreter->SetBufferHandle(2, handle, delegate.get()),
+            kTfLiteOk);
+  // Otherwise Invoke reads the output back, waiting for the run.
+  interpreter->SetAllowBufferHandleOutput(true);
+
+  for (int frame = 0; frame < kFrames; frame++) {
+    float* a = interpreter->typed_input_tensor<float>(0);
+    float* b = interpreter->typed_input_tensor<float>(1);
+    std::fill(a, a + kTensorSize, static_cast<float>(frame));
+    std::fill(b, b + kTensorSize, 1.0f);
+    ASSERT_EQ(interpreter->Invoke(), kTfLiteOk);
+    // Invoke returned while the run is still held in its callback.
+    ASSERT_TRUE(gate.WaitEntered(frame + 1));
+    EXPECT_EQ(gate.completed(), frame);
+    // Inputs are uploaded, so they can be reused right away.
+    std::fill(a, a + kTensorSize, -1.0f);
+    gate.Release();
+    ASSERT_EQ(vx::delegate::VxDelegateWaitForCompletion(delegate.get()),
+              kTfLiteOk);
+    EXPECT_EQ(gate.completed(), frame + 1);
+    EXPECT_EQ(out, std::vector<float>(kTensorSize, frame + 1.0f));
+  }
+  EXPECT_FALSE(gate.timed_out());
+
+  ASSERT_EQ(interpreter->EnsureTensorDataIsReadable(2), kTfLiteOk);
+  EXPECT_EQ(interpreter->typed_output_tensor<float>(0)[0],
+            static_cast<float>(kFrames));
+}
+
+TEST(VxDelegateTest, AsyncInvokeWaitsForPartitionFeedingAnother) {
+  // t = a + b on the NPU, f = floor(t) on the CPU and out = t + f on the
+  // NPU again, so the second partition reads the first one's buffer.
+  VxDelegateOptions options = vx::delegate::VxDelegateOptionsDefault();
+  options.async_invoke = true;
+  DelegatePtr delegate(vx::delegate::VxDelegateCreate(&options));
+  tflite::ops::builtin::BuiltinOpResolver resolver;
+  tflite::Interpreter interpreter;
+  TfLiteQuantization quantization;
+  quantization.type = kTfLiteNoQuantization;
+  quantization.params = nullptr;
+  ASSERT_EQ(interpreter.AddTensors(5), kTfLiteOk);
+  ASSERT_EQ(interpreter.SetInputs({0, 1}), kTfLiteOk);
+  ASSERT_EQ(interpreter.SetOutputs({4}), kTfLiteOk);
+  for (int i = 0; i < 5; i++) {
+    ASSERT_EQ(interpreter.SetTensorParametersReadWrite(
+                  i, kTfLiteFloat32, "", {1, kTensorSize}, quantization),
+              kTfLiteOk);
+  }
+  for (const auto& add : {std::vector<int>{0, 1, 2},
+                          std::vector<int>{2, 3, 4}}) {
+    auto* params =
+        reinterpret_cast<TfLiteAddParams*>(malloc(sizeof(TfLiteAddParams)));
+    memset(params, 0, sizeof(TfLiteAddParams));
+    ASSERT_EQ(interpreter.AddNodeWithParameters(
+                  {add[0], add[1]}, {add[2]}, nullptr, 0, params,
+                  resolver.FindOp(tflite::BuiltinOperator_ADD, 1)),
+              kTfLiteOk);
+    if (add[2] == 2) {
+      ASSERT_EQ(interpreter.AddNodeWithParameters(
+                    {2}, {3}, nullptr, 0, nullptr,
+                    resolver.FindOp(tflite::BuiltinOperator_FLOOR, 1)),
+                kTfLiteOk);
+    }
+  }
+  ASSERT_EQ(interpreter.ModifyGraphWithDelegate(delegate.get()), kTfLiteOk);
+  ASSERT_EQ(interpreter.AllocateTensors(), kTfLiteOk);
+  ASSERT_EQ(interpreter.execution_plan().size(), 3);
+
+  constexpr int kFrames = 8;
+  CompletionGate gate(kFrames);
+  vx::delegate::VxDelegateSetCompletionCallback(
+      delegate.get(), CompletionGate::Callback, &gate);
+  std::vector<float> sum(kTensorSize, 0.0f);
+  std::vector<float> out(kTensorSize, 0.0f);
+  for (auto tensor_and_buffer : {std::make_pair(2, &sum),
+                                 std::make_pair(4, &out)}) {
+    TfLiteBufferHandle handle = vx::delegate::VxDelegateRegisterBufferHandle(
+        delegate.get(), tensor_and_buffer.second->data(),
+        kTensorSize * sizeof(float));
+    ASSERT_EQ(interpreter.SetBufferHandle(
+                  tensor_and_buffer.first, handle, delegate.get()),
+              kTfLiteOk);
+  }
+  interpreter.SetAllowBufferHandleOutput(true);
+
+  for (int frame = 0; frame < kFrames; frame++) {
+    float* a = interpreter.typed_input_tensor<float>(0);
+    float* b = interpreter.typed_input_tensor<float>(1);
+    std::fill(a, a + kTensorSize, frame + 0.5f);
+    std::fill(b, b + kTensorSize, 1.0f);
+    ASSERT_EQ(interpreter.Invoke(), kTfLiteOk);
+    // Only the last partition runs asynchronously and is held in its
+    // callback. The first one ran to completion before FLOOR read t.
+    ASSERT_TRUE(gate.WaitEntered(frame + 1));
+    EXPECT_EQ(gate.completed(), frame);
+    EXPECT_EQ(sum, std::vector<float>(kTensorSize, frame + 1.5f))
+        << "frame " << frame;
+    gate.Release();
+    ASSERT_EQ(vx::delegate::VxDelegateWaitForCompletion(delegate.get()),
+              kTfLiteOk);
+    EXPECT_EQ(out, std::vector<float>(kTensorSize, 2 * frame + 2.5f))
+        << "frame " << frame;
+  }
+  EXPECT_EQ(gate.completed(), kFrames);
+  EXPECT_FALSE(gate.timed_out());
+}
+
+TEST(VxDelegateTest, ReadingAnOutputWaitsOnlyForItsOwnRun) {
+  VxDelegateOptions options = vx::delegate::VxDelegateOptionsDefault();
+  options.async_invoke = true;
+  DelegatePtr delegate(vx::delegate::VxDelegateCreate(&options));
+  CompletionGate gate;
+  vx::delegate::VxDelegateSetCompletionCallback(
+      delegate.get(), CompletionGate::Callback, &gate);
+
+  // Two interpreters on the delegate, computing 1 + 1 and 2 + 1.
+  std::unique_ptr<tflite::Interpreter> interpreters[2];
+  std::vector<float> outputs[2];
+  for (int i = 0; i < 2; i++) {
+    interpreters[i] = BuildAddInterpreter(delegate.get());
+    ASSERT_NE(interpreters[i], nullptr);
+    outputs[i].assign(kTensorSize, 0.0f);
+    TfLiteBufferHandle handle = vx::delegate::VxDelegateRegisterBufferHandle(
+        delegate.get(), outputs[i].data(), kTensorSize * sizeof(float));
+    ASSERT_EQ(interpreters[i]->SetBufferHandle(2, handle, delegate.get()),
+              kTfLiteOk);
+    interpreters[i]->SetAllowBufferHandleOutput(true);
+    float* a = interpreters[i]->typed_input_tensor<float>(0);
+    float* b = interpreters[i]->typed_input_tensor<float>(1);
+    std::fill(a, a + kTensorSize, i + 1.0f);
+    std::fill(b, b + kTensorSize, 1.0f);
+  }
+
+  // The first run is held in its callback while the second one finishes,
+  // and reading the second output doesn't wait for the first run.
+  ASSERT_EQ(interpreters[0]->Invoke(), kTfLiteOk);
+  ASSERT_TRUE(gate.WaitEntered(1));
+  ASSERT_EQ(interpreters[1]->Invoke(), kTfLiteOk);
+  ASSERT_EQ(interpreters[1]->EnsureTensorDataIsReadable(2), kTfLiteOk);
+  EXPECT_EQ(interpreters[1]->typed_output_tensor<float>(0)[0], 3.0f);
+  EXPECT_EQ(gate.completed(), 1);
+
+  gate.Release();
+  ASSERT_EQ(interpreters[0]->EnsureTensorDataIsReadable(2), kTfLiteOk);
+  EXPECT_EQ(interpreters[0]->typed_output_tensor<float>(0)[0], 2.0f);
+  EXPECT_EQ(gate.completed(), 2);
+  EXPECT_FALSE(gate.timed_out());
+  EXPECT_EQ(vx::delegate::VxDelegateWaitForCompletion(delegate.get()),
+            kTfLiteOk);
+}
+
+TEST(VxDelegateTest, SkipsUnchangedInputs) {
+  VxDelegateOptions options = vx::delegate::VxDelegateOptionsDefault();
+  options.skip_unchanged_inputs = true;
+  DelegatePtr delegate(vx::delegate::VxDelegateCreate(&options));
+  auto interpreter = BuildAddInterpreter(delegate.get());
+  ASSERT_NE(interpreter, nullptr);
+  const uint64_t bytes = kTensorSize * sizeof(float);
+
+  // RunAdds keeps `a` fixed and changes `b` on every iteration.
+  EXPECT_EQ(RunAdds(interpreter.get(), 5, 3), 0);
+  EXPECT_EQ(vx::delegate::VxDelegateGetSkippedInputBytes(delegate.get()),
+            2 * bytes);
+}
+
+TEST(VxDelegateTest, CollectsRuntimeStats) {
+  // t = (in + in) * (in + in), out = floor(t) + floor(t). FLOOR stays on the
+  // CPU between partitions {0, 1} and {3}.
+  ModelBuilder model = [](tflite::Interpreter* interpreter) {
+    tflite::ops::builtin::BuiltinOpResolver resolver;
+    ASSERT_EQ(interpreter->AddTensors(5), kTfLiteOk);
+    ASSERT_EQ(interpreter->SetInputs({0}), kTfLiteOk);
+    ASSERT_EQ(interpreter->SetOutputs({2, 4}), kTfLiteOk);
+    for (int i = 0; i < 5; i++) {
+      ASSERT_EQ(interpreter->SetTensorParametersReadWrite(
+                    i, kTfLiteFloat32, "", {1, kTensorSize}, NoQuantization()),
+                kTfLiteOk);
+    }
+    auto* add_params =
+        reinterpret_cast<TfLiteAddParams*>(malloc(sizeof(TfLiteAddParams)));
+    memset(add_params, 0, sizeof(TfLiteAddParams));
+    ASSERT_EQ(interpreter->AddNodeWithParameters(
+                  {0, 0}, {1}, nullptr, 0, add_params,
+                  resolver.FindOp(tflite::BuiltinOperator_ADD, 1)),
+              kTfLiteOk);
+    auto* mul_params =
+        reinterpret_cast<TfLiteMulParams*>(malloc(sizeof(TfLiteMulParams)));
+    memset(mul_params, 0, sizeof(TfLiteMulParams));
+    ASSERT_EQ(interpreter->AddNodeWithParameters(
+                  {1, 1}, {2}, nullptr, 0, mul_params,
+                  resolver.FindOp(tflite::BuiltinOperator_MUL, 1)),
+              kTfLiteOk);
+    ASSERT_EQ(interpreter->AddNodeWithParameters(
+                  {2}, {3}, nullptr, 0, nullptr,
+                  resolver.FindOp(tflite::BuiltinOperator_FLOOR, 1)),
+              kTfLiteOk);
+    add_params =
+        reinterpret_cast<TfLiteAddParams*>(malloc(sizeof(TfLiteAddParams)));
+    memset(add_params, 0, sizeof(TfLiteAddParams));
+    ASSERT_EQ(interpreter->AddNodeWithParameters(
+                  {3, 3}, {4}, nullptr, 0, add_params,
+                  resolver.FindOp(tflite::BuiltinOperator_ADD, 1)),
+              kTfLiteOk);
+  };
+  DelegatePtr delegate = CreateDelegate();
+  auto interpreter = BuildInterpreter(model, delegate.get());
+  auto reference = BuildInterpreter(model, nullptr);
+  ASSERT_NE(interpreter, nullptr);
+  ASSERT_NE(reference, nullptr);
+  for (int run = 0; run < 5; run++) {
+    float* in = interpreter->typed_input_tensor<float>(0);
+    for (int i = 0; i < kTensorSize; i++) {
+      in[i] = 0.25f * (i % 20) + run;
+    }
+    ExpectMatchesReference(interpreter.get(), reference.get(), 0);
+  }
+
+  // Each invoke runs both partitions, each reading and writing one tensor.
+  const uint64_t bytes = kTensorSize * sizeof(float);
+  vx::delegate::VxDelegateStats stats;
+  ASSERT_EQ(vx::delegate::VxDelegateGetStats(delegate.get(), &stats),
+            kTfLiteOk);
+  EXPECT_EQ(stats.invokes, 2 * 5);
+  EXPECT_EQ(stats.run.count, 2 * 5);
+  EXPECT_LE(stats.run.p50_us, stats.run.p99_us);
+  EXPECT_GT(stats.run.total_us, 0);
+  EXPECT_EQ(stats.bytes_in, 2 * 5 * bytes);
+  EXPECT_EQ(stats.bytes_out, 2 * 5 * bytes);
+  EXPECT_EQ(stats.partitions, 2);
+  EXPECT_EQ(stats.delegated_nodes, 3);
+  EXPECT_EQ(stats.total_nodes, 4);
+  ASSERT_EQ(stats.compiled_partitions, 2);
+
+  // Partitions are listed in the order they were created.
+  const int nodes[] = {2, 1};
+  vx::delegate::VxDelegatePartitionStats partition;
+  for (int i = 0; i < 2; i++) {
+    ASSERT_EQ(vx::delegate::VxDelegateGetPartitionStats(
+                  delegate.get(), i, &partition),
+              kTfLiteOk);
+    EXPECT_EQ(partition.nodes, nodes[i]) << "partition " << i;
+    EXPECT_EQ(partition.compiles, 1) << "partition " << i;
+    EXPECT_GT(partition.compile_ms, 0) << "partition " << i;
+  }
+  EXPECT_NE(vx::delegate::VxDelegateGetPartitionStats(
+                delegate.get(), 2, &partition),
+            kTfLiteOk);
+
+  vx::delegate::VxDelegateResetStats(delegate.get());
+  ASSERT_EQ(vx::delegate::VxDelegateGetStats(delegate.get(), &stats),
+            kTfLiteOk);
+  EXPECT_EQ(stats.invokes, 0);
+  EXPECT_EQ(stats.run.count, 0);
+  EXPECT_EQ(stats.compiled_partitions, 0);
+  EXPECT_EQ(stats.delegated_nodes, 3);
+}
+
+TEST(VxDelegateTest, CoverageReportGivesReasonsForCpuNodes) {
+  VxDelegateOptions options = vx::delegate::VxDelegateOptionsDefault();
+  options.min_partition_nodes = 3;
+  DelegatePtr delegate(vx::delegate::VxDelegateCreate(&options));
+  auto interpreter = BuildAddInterpreter(delegate.get(), 2);
+  ASSERT_NE(interpreter, nullptr);
+  std::string path = ::testing::TempDir() + "/vx_coverage.json";
+  ASSERT_TRUE(vx::delegate::VxDelegateWriteCoverageReport(delegate.get(),
+                                                          path.c_str()));
+
+  std::vector<char> data(1 << 20);
+  FILE* file = fopen(path.c_str(), "r");
+  ASSERT_NE(file, nullptr);
+  data.resize(fread(data.data(), 1, data.size(), file));
+  fclose(file);
+  std::string json(data.begin(), data.end());
+  EXPECT_NE(json.find("\"summary\": {\"nodes\": 2, \"supported_nodes\": 2, "
+                      "\"delegated_nodes\": 0, \"partitions\": 1"),
+            std::string::npos);
+  EXPECT_NE(json.find("{\"index\": 1, \"op\": \"ADD\", \"delegated\": "
+                      "false, \"partition\": 0, \"reason\": \"fewer nodes "
+                      "than min_partition_nodes\"}"),
+            std::string::npos);
+  // Both adds read two inputs and write one output across the boundary.
+  EXPECT_NE(json.find("\"transfer_bytes\": " +
+                      std::to_string(6 * kTensorSize * sizeof(float))),
+            std::string::npos);
+  EXPECT_NE(json.find("\"type\": \"FLOAT32\", \"shape\": [1, " +
+                      std::to_string(kTensorSize) + "]"),
+            std::string::npos);
+}
+
+TEST(VxDelegateTest, FoldsActivationsTheOutputQuantizationClamps) {
+  struct Case {
+    TfLiteFusedActivation activation;
+    float output_scale;
+    int output_zero_point;
+    int fused_activations;
+  };
+  // Relu with zero point 0, and Relu6 with the output range [0, 6], clamp
+  // exactly where the output quantization does and are folded. Relu with
+  // zero point 128 clamps half the output range and must stay.
+  const Case cases[] = {{kTfLiteActRelu, 1.f / 8, 0, 1},
+                        {kTfLiteActRelu6, 6.f / 255, 0, 1},
+                        {kTfLiteActRelu, 1.f / 8, 128, 0}};
+  for (const Case& c : cases) {
+    SCOPED_TRACE(c.activation == kTfLiteActRelu6 ? "relu6" : "relu");
+    SCOPED_TRACE(c.output_zero_point);
+    ModelBuilder model =
+        QuantizedAddModel(c.activation, c.output_scale, c.output_zero_point);
+    DelegatePtr delegate = CreateDelegate();
+    auto interpreter = BuildInterpreter(model, delegate.get());
+    auto reference = BuildInterpreter(model, nullptr);
+    ASSERT_NE(interpreter, nullptr);
+    ASSERT_NE(reference, nullptr);
+    uint8_t* a = interpreter->typed_input_tensor<uint8_t>(0);
+    uint8_t* b = interpreter->typed_input_tensor<uint8_t>(1);
+    for (int i = 0; i < kTensorSize; i++) {
+      // a + b in [-8, 7.94] crosses both 0 and 6, and hits each exactly.
+      a[i] = static_cast<uint8_t>(i % 256);
+      b[i] = 128;
+    }
+    ExpectMatchesReference(interpreter.get(), reference.get(), 1);
+
+    vx::delegate::VxDelegatePartitionStats partition;
+    ASSERT_EQ(vx::delegate::VxDelegateGetPartitionStats(
+                  delegate.get(), 0, &partition),
+              kTfLiteOk);
+    EXPECT_EQ(partition.fused_activations, c.fused_activations);
+  }
+}
+
+TEST(VxDelegateTest, RemovesDequantizeQuantizePairs) {
+  struct Case {
+    float quantize_scale;
+    int quantize_zero_point;
+    int removed_converts;
+    int nodes;
+  };
+  // in -> Dequantize -> Quantize -> Add(x, x) -> out on uint8 tensors, in
+  // quantized by 1/16 and 0. Requantizing into the same quantization drops
+  // both converts. Into a different one the Dequantize is merged into a
+  // Quantize from uint8, which the NPU requantizes like the CPU kernels.
+  const Case cases[] = {{1.f / 16, 0, 2, 1}, {1.f / 10, 3, 1, 2}};
+  for (const Case& c : cases) {
+    SCOPED_TRACE(c.quantize_scale);
+    ModelBuilder model = [&](tflite::Interpreter* interpreter) {
+      tflite::ops::builtin::BuiltinOpResolver resolver;
+      ASSERT_EQ(interpreter->AddTensors(4), kTfLiteOk);
+      ASSERT_EQ(interpreter->SetInputs({0}), kTfLiteOk);
+      ASSERT_EQ(interpreter->SetOutputs({3}), kTfLiteOk);
+      const TfLiteQuantization quantizations[] = {
+          AffineQuantization(1.f / 16, 0),
+          NoQuantization(),
+          AffineQuantization(c.quantize_scale, c.quantize_zero_point),
+          AffineQuantization(1.f / 4, 0)};
+      for (int i = 0; i < 4; i++) {
+        ASSERT_EQ(interpreter->SetTensorParametersReadWrite(
+                      i, i == 1 ? kTfLiteFloat32 : kTfLiteUInt8, "",
+                      {1, kTensorSize}, quantizations[i]),
+                  kTfLiteOk);
+      }
+      auto* params =
+          reinterpret_cast<TfLiteAddParams*>(malloc(sizeof(TfLiteAddParams)));
+      memset(params, 0, sizeof(TfLiteAddParams));
+      ASSERT_EQ(interpreter->AddNodeWithParameters(
+                    {0}, {1}, nullptr, 0, nullptr,
+                    resolver.FindOp(tflite::BuiltinOperator_DEQUANTIZE, 2)),
+                kTfLiteOk);
+      ASSERT_EQ(interpreter->AddNodeWithParameters(
+                    {1}, {2}, nullptr, 0, nullptr,
+                    resolver.FindOp(tflite::BuiltinOperator_QUANTIZE, 1)),
+                kTfLiteOk);
+      ASSERT_EQ(interpreter->AddNodeWithParameters(
+                    {2, 2}, {3}, nullptr, 0, params,
+                    resolver.FindOp(tflite::BuiltinOperator_ADD, 1)),
+                kTfLiteOk);
+    };
+    DelegatePtr delegate = CreateDelegate();
+    auto interpreter = BuildInterpreter(model, delegate.get());
+    auto reference = BuildInterpreter(model, nullptr);
+    ASSERT_NE(interpreter, nullptr);
+    ASSERT_NE(reference, nullptr);
+    uint8_t* in = interpreter->typed_input_tensor<uint8_t>(0);
+    for (int i = 0; i < kTensorSize; i++) {
+      in[i] = static_cast<uint8_t>(i % 256);
+    }
+    ExpectMatchesReference(interpreter.get(), reference.get(), 1);
+
+    vx::delegate::VxDelegatePartitionStats partition;
+    ASSERT_EQ(vx::delegate::VxDelegateGetPartitionStats(
+                  delegate.get(), 0, &partition),
+              kTfLiteOk);
+    EXPECT_EQ(partition.removed_converts, c.removed_converts);
+    EXPECT_EQ(partition.nodes, c.nodes);
+  }
+}
+
+TEST(VxDelegateTest, FoldsOpsWithConstantInputs) {
+  // out = in + c0 * c1, with the Mul evaluated once at graph build.
+  std::vector<float> c0(kTensorSize);
+  std::vector<float> c1(kTensorSize);
+  for (int i = 0; i < kTensorSize; i++) {
+    c0[i] = static_cast<float>(i % 5) - 2.f;
+    c1[i] = 0.25f * (i % 3) + 0.5f;
+  }
+  ModelBuilder model = [&](tflite::Interpreter* interpreter) {
+    tflite::ops::builtin::BuiltinOpResolver resolver;
+    ASSERT_EQ(interpreter->AddTensors(5), kTfLiteOk);
+    ASSERT_EQ(interpreter->SetInputs({0}), kTfLiteOk);
+    ASSERT_EQ(interpreter->SetOutputs({4}), kTfLiteOk);
+    for (int i : {0, 3, 4}) {
+      ASSERT_EQ(interpreter->SetTensorParametersReadWrite(
+                    i, kTfLiteFloat32, "", {1, kTensorSize}, NoQuantization()),
+                kTfLiteOk);
+    }
+    ASSERT_EQ(interpreter->SetTensorParametersReadOnly(
+                  1, kTfLiteFloat32, "", {1, kTensorSize}, NoQuantization(),
+                  reinterpret_cast<const char*>(c0.data()),
+                  kTensorSize * sizeof(float)),
+              kTfLiteOk);
+    ASSERT_EQ(interpreter->SetTensorParametersReadOnly(
+                  2, kTfLiteFloat32, "", {1, kTensorSize}, NoQuantization(),
+                  reinterpret_cast<const char*>(c1.data()),
+                  kTensorSize * sizeof(float)),
+              kTfLiteOk);
+    auto* mul_params =
+        reinterpret_cast<TfLiteMulParams*>(malloc(sizeof(TfLiteMulParams)));
+    memset(mul_params, 0, sizeof(TfLiteMulParams));
+    auto* add_params =
+        reinterpret_cast<TfLiteAddParams*>(malloc(sizeof(TfLiteAddParams)));
+    memset(add_params, 0, sizeof(TfLiteAddParams));
+    ASSERT_EQ(interpreter->AddNodeWithParameters(
+                  {1, 2}, {3}, nullptr, 0, mul_params,
+                  resolver.FindOp(tflite::BuiltinOperator_MUL, 1)),
+              kTfLiteOk);
+    ASSERT_EQ(interpreter->AddNodeWithParameters(
+                  {0, 3}, {4}, nullptr, 0, add_params,
+                  resolver.FindOp(tflite::BuiltinOperator_ADD, 1)),
+              kTfLiteOk);
+  };
+  DelegatePtr delegate = CreateDelegate();
+  auto interpreter = BuildInterpreter(model, delegate.get());
+  auto reference = BuildInterpreter(model, nullptr);
+  ASSERT_NE(interpreter, nullptr);
+  ASSERT_NE(reference, nullptr);
+
+  // Runs twice, the folded constant must survive the first invoke.
+  for (int run = 0; run < 2; run++) {
+    float* in = interpreter->typed_input_tensor<float>(0);
+    for (int i = 0; i < kTensorSize; i++) {
+      in[i] = static_cast<float>(i + run);
+    }
+    ExpectMatchesReference(interpreter.get(), reference.get(), 1e-5);
+  }
+
+  vx::delegate::VxDelegatePartitionStats partition;
+  ASSERT_EQ(vx::delegate::VxDelegateGetPartitionStats(
+                delegate.get(), 0, &partition),
+            kTfLiteOk);
+  EXPECT_EQ(partition.folded_ops, 1);
+  EXPECT_EQ(partition.nodes, 1);
+}
+
+TEST(VxDelegateTest, RemovesReshapesThatKeepTheDims) {
+  struct Case {
+    std::vector<int> dims;
+    int aliased_reshapes;
+  };
+  // in -> Reshape {kTensorSize} -> Reshape `dims` -> Add(x, x), with in of
+  // dims {1, kTensorSize}. The first reshape is merged into the second. When
+  // that restores the dims of in it emits no NPU op, otherwise it stays a
+  // Reshape layer.
+  const Case cases[] = {{{1, kTensorSize}, 1}, {{2, kTensorSize / 2}, 0}};
+  for (const Case& c : cases) {
+    SCOPED_TRACE(c.dims[0]);
+    ModelBuilder model = [&](tflite::Interpreter* interpreter) {
+      tflite::ops::builtin::BuiltinOpResolver resolver;
+      ASSERT_EQ(interpreter->AddTensors(4), kTfLiteOk);
+      ASSERT_EQ(interpreter->SetInputs({0}), kTfLiteOk);
+      ASSERT_EQ(interpreter->SetOutputs({3}), kTfLiteOk);
+      const std::vector<int> dims[] = {
+          {1, kTensorSize}, {kTensorSize}, c.dims, c.dims};
+      for (int i = 0; i < 4; i++) {
+        ASSERT_EQ(interpreter->SetTensorParametersReadWrite(
+                      i, kTfLiteFloat32, "", dims[i], NoQuantization()),
+                  kTfLiteOk);
+      }
+      for (int i = 0; i < 2; i++) {
+        auto* reshape_params = reinterpret_cast<TfLiteReshapeParams*>(
+            malloc(sizeof(TfLiteReshapeParams)));
+        memset(reshape_params, 0, sizeof(TfLiteReshapeParams));
+        reshape_params->num_dimensions = dims[i + 1].size();
+        std::copy(dims[i + 1].begin(), dims[i + 1].end(),
+                  reshape_params->shape);
+        ASSERT_EQ(interpreter->AddNodeWithParameters(
+                      {i}, {i + 1}, nullptr, 0, reshape_params,
+                      resolver.FindOp(tflite::BuiltinOperator_RESHAPE, 1)),
+                  kTfLiteOk);
+      }
+      auto* add_params =
+          reinterpret_cast<TfLiteAddParams*>(malloc(sizeof(TfLiteAddParams)));
+      memset(add_params, 0, sizeof(TfLiteAddParams));
+      ASSERT_EQ(interpreter->AddNodeWithParameters(
+                    {2, 2}, {3}, nullptr, 0, add_params,
+                    resolver.FindOp(tflite::BuiltinOperator_ADD, 1)),
+                kTfLiteOk);
+    };
+    DelegatePtr delegate = CreateDelegate();
+    auto interpreter = BuildInterpreter(model, delegate.get());
+    auto reference = BuildInterpreter(model, nullptr);
+    ASSERT_NE(interpreter, nullptr);
+    ASSERT_NE(reference, nullptr);
+    float* in = interpreter->typed_input_tensor<float>(0);
+    for (int i = 0; i < kTensorSize; i++) {
+      in[i] = static_cast<float>(i);
+    }
+    ExpectMatchesReference(interpreter.get(), reference.get(), 0);
+
+    vx::delegate::VxDelegatePartitionStats partition;
+    ASSERT_EQ(vx::delegate::VxDelegateGetPartitionStats(
+                  delegate.get(), 0, &partition),
+              kTfLiteOk);
+    EXPECT_EQ(partition.removed_reshapes, 1);
+    EXPECT_EQ(partition.aliased_reshapes, c.aliased_reshapes);
+    EXPECT_EQ(partition.nodes, 2);
+
+    // The report has the merged reshape, like removed_reshapes.
+    std::string path = ::testing::TempDir() + "/vx_reshape_coverage.json";
+    ASSERT_TRUE(vx::delegate::VxDelegateWriteCoverageReport(delegate.get(),
+                                                            path.c_str()));
+    std::vector<char> data(1 << 20);
+    FILE* file = fopen(path.c_str(), "r");
+    ASSERT_NE(file, nullptr);
+    data.resize(fread(data.data(), 1, data.size(), file));
+    fclose(file);
+    std::string json(data.begin(), data.end());
+    EXPECT_NE(
+        json.find("\"delegated_partitions\": 1, \"removed_reshapes\": 1"),
+        std::string::npos);
+    EXPECT_NE(json.find("\"removed_converts\": 0, \"removed_reshapes\": 1}"),
+              std::string::npos);
+  }
+}
+
+TEST(VxDelegateTest, CoverageReportMatchesPassesToDelegatedPartitions) {
+  // out = reshape(reshape(floor(a + a))) * 2, where FLOOR stays on the CPU
+  // and splits the model into partitions {0} and {2, 3, 4}. The first is
+  // too small to delegate, the second has a reshape merged away.
+  VxDelegateOptions options = vx::delegate::VxDelegateOptionsDefault();
+  options.min_partition_nodes = 2;
+  DelegatePtr delegate(vx::delegate::VxDelegateCreate(&options));
+  tflite::ops::builtin::BuiltinOpResolver resolver;
+  tflite::Interpreter interpreter;
+  TfLiteQuantization quantization;
+  quantization.type = kTfLiteNoQuantization;
+  quantization.params = nullptr;
+  ASSERT_EQ(interpreter.AddTensors(6), kTfLiteOk);
+  ASSERT_EQ(interpreter.SetInputs({0}), kTfLiteOk);
+  ASSERT_EQ(interpreter.SetOutputs({5}), kTfLiteOk);
+  for (int i = 0; i < 6; i++) {
+    std::vector<int> dims{1, kTensorSize};
+    if (i == 3) {
+      dims = {kTensorSize};
+    }
+    ASSERT_EQ(interpreter.SetTensorParametersReadWrite(
+                  i, kTfLiteFloat32, "", dims, quantization),
+              kTfLiteOk);
+  }
+  auto add = [&](int input, int output) {
+    auto* params =
+        reinterpret_cast<TfLiteAddParams*>(malloc(sizeof(TfLiteAddParams)));
+    memset(params, 0, sizeof(TfLiteAddParams));
+    ASSERT_EQ(interpreter.AddNodeWithParameters(
+                  {input, input}, {output}, nullptr, 0, params,
+                  resolver.FindOp(tflite::BuiltinOperator_ADD, 1)),
+              kTfLiteOk);
+  };
+  add(0, 1);
+  ASSERT_EQ(interpreter.AddNodeWithParameters(
+                {1}, {2}, nullptr, 0, nullptr,
+                resolver.FindOp(tflite::BuiltinOperator_FLOOR, 1)),
+            kTfLiteOk);
+  for (int i = 0; i < 2; i++) {
+    auto* reshape_params = reinterpret_cast<TfLiteReshapeParams*>(
+        malloc(sizeof(TfLiteReshapeParams)));
+    memset(reshape_params, 0, sizeof(TfLiteReshapeParams));
+    reshape_params->num_dimensions = i + 1;
+    reshape_params->shape[0] = i == 0 ? kTensorSize : 1;
+    reshape_params->shape[1] = kTensorSize;
+    ASSERT_EQ(interpreter.AddNodeWithParameters(
+                  {2 + i}, {3 + i}, nullptr, 0, reshape_params,
+                  resolver.FindOp(tflite::BuiltinOperator_RESHAPE, 1)),
+              kTfLiteOk);
+  }
+  add(4, 5);
+  ASSERT_EQ(interpreter.ModifyGraphWithDelegate(delegate.get()), kTfLiteOk);
+  ASSERT_EQ(interpreter.AllocateTensors(), kTfLiteOk);
+
+  float* in = interpreter.typed_input_tensor<float>(0);
+  for (int i = 0; i < kTensorSize; i++) {
+    in[i] = 0.3f * i;
+  }
+  ASSERT_EQ(interpreter.Invoke(), kTfLiteOk);
+  const float* out = interpreter.typed_output_tensor<float>(0);
+  for (int i = 0; i < kTensorSize; i++) {
+    ASSERT_EQ(out[i], 2.f * std::floor(in[i] + in[i])) << "at " << i;
+  }
+
+  std::string path = ::testing::TempDir() + "/vx_partition_coverage.json";
+  ASSERT_TRUE(vx::delegate::VxDelegateWriteCoverageReport(delegate.get(),
+                                                          path.c_str()));
+  std::vector<char> data(1 << 20);
+  FILE* file = fopen(path.c_str(), "r");
+  ASSERT_NE(file, nullptr);
+  data.resize(fread(data.data(), 1, data.size(), file));
+  fclose(file);
+  std::string json(data.begin(), data.end());
+  EXPECT_NE(json.find("\"partitions\": 2, \"delegated_partitions\": 1, "
+                      "\"removed_reshapes\": 1}"),
+            std::string::npos);
+  EXPECT_NE(json.find("{\"index\": 0, \"nodes\": [0], \"delegated\": "
+                      "false"),
+            std::string::npos);
+  // Only the delegated partition lists graph passes.
+  size_t passes = json.find("\"graph_passes\"");
+  ASSERT_NE(passes, std::string::npos);
+  EXPECT_EQ(json.find("\"graph_passes\"", passes + 1), std::string::npos);
+  EXPECT_LT(json.find("{\"index\": 1, \"nodes\": [2, 3, 4], "
+                      "\"delegated\": true"),
+            passes);
+  EXPECT_NE(json.find("\"removed_converts\": 0, \"removed_reshapes\": 1}",
+                      passes),
+            std::string::npos);
+}
+
+TEST(VxDelegateTest, TraceKeepsEventsInOrder) {
+  static const char kName[] = "TraceKeepsEventsInOrder";
+  vx::delegate::trace::Record('B', "test", kName, 1);
+  vx::delegate::trace::Record('i', "test", kName, 2);
+  vx::delegate::trace::Record('E', "test", kName, 3);
+
+  std::vector<vx::delegate::trace::Event> events;
+  for (const auto& event : vx::delegate::trace::Snapshot()) {
+    if (event.name == kName) events.push_back(event);
+  }
+  ASSERT_EQ(events.size(), 3);
+  for (int i = 0; i < 3; i++) {
+    EXPECT_EQ(events[i].arg, i + 1);
+  }
+  EXPECT_EQ(events[0].phase, 'B');
+  EXPECT_EQ(events[2].phase, 'E');
+  EXPECT_LE(events[0].timestamp_ns, events[2].timestamp_ns);
+}
+
+TEST(VxDelegateTest, ChromeTraceTagsEventsWithPartition) {
+  {
+    vx::delegate::trace::PartitionScope partition(7);
+    vx::delegate::trace::Record('B', "test", "ChromeTraceSpan", 4096);
+    vx::delegate::trace::Record('E', "test", "ChromeTraceSpan", 4096);
+  }
+  std::string path = ::testing::TempDir() + "/vx_chrome_trace.json";
+  ASSERT_TRUE(vx::delegate::VxDelegateDumpChromeTrace(path.c_str()));
+
+  std::vector<char> data(1 << 22);
+  FILE* file = fopen(path.c_str(), "r");
+  ASSERT_NE(file, nullptr);
+  data.resize(fread(data.data(), 1, data.size(), file));
+  fclose(file);
+  std::string json(data.begin(), data.end());
+  EXPECT_EQ(json.rfind("{\"traceEvents\":[", 0), 0);
+  EXPECT_NE(json.find("\"name\":\"ChromeTraceSpan\",\"cat\":\"test\","
+                      "\"ph\":\"B\""),
+            std::string::npos);
+  EXPECT_NE(json.find("\"args\":{\"partition\":7,\"arg\":4096}"),
+            std::string::npos);
+}
+
+// The pipeline's replicas are compiled when the partition is prepared, and
+// its runs complete in the order they were invoked in, each writing its own
+// frame's output buffer.
+TEST(VxDelegateTest, PipelinedInvokesCompleteInOrder) {
+  constexpr int kDepth = 3;
+  constexpr int kFrames = 4 * kDepth;
+  VxDelegateOptions options = vx::delegate::VxDelegateOptionsDefault();
+  options.async_invoke = true;
+  options.pipeline_depth = kDepth;
+  DelegatePtr delegate(vx::delegate::VxDelegateCreate(&options));
+  auto interpreter = BuildAddInterpreter(delegate.get());
+  ASSERT_NE(interpreter, nullptr);
+
+  vx::delegate::VxDelegatePartitionStats partition;
+  ASSERT_EQ(vx::delegate::VxDelegateGetPartitionStats(
+                delegate.get(), 0, &partition),
+            kTfLiteOk);
+  EXPECT_EQ(partition.compiles, kDepth);
+
+  // Run i writes outputs[i % kDepth], which must hold frame i's sums when
+  // the i-th completion comes in.
+  std::vector<std::vector<float>> outputs(kDepth,
+                                          std::vector<float>(kTensorSize));
+  int out_of_order = 0;
+  CompletionGate gate;
+  gate.on_complete = [&](int call, TfLiteStatus status) {
+    if (status != kTfLiteOk ||
+        outputs[call % kDepth] !=
+            std::vector<float>(kTensorSize, call + 1.0f)) {
+      out_of_order++;
+    }
+  };
+  vx::delegate::VxDelegateSetCompletionCallback(
+      delegate.get(), CompletionGate::Callback, &gate);
+  interpreter->SetAllowBufferHandleOutput(true);
+
+  for (int frame = 0; frame < kFrames; frame++) {
+    float* a = interpreter->typed_input_tensor<float>(0);
+    float* b = interpreter->typed_input_tensor<float>(1);
+    std::fill(a, a + kTensorSize, static_cast<float>(frame));
+    std::fill(b, b + kTensorSize, 1.0f);
+    std::vector<float>& output = outputs[frame % kDepth];
+    TfLiteBufferHandle handle = vx::delegate::VxDelegateRegisterBufferHandle(
+        delegate.get(), output.data(), output.size() * sizeof(float));
+    ASSERT_EQ(interpreter->SetBufferHandle(2, handle, delegate.get()),
+              kTfLiteOk);
+    ASSERT_EQ(interpreter->Invoke(), kTfLiteOk);
+    if (frame == kDepth - 1) {
+      // With the first run held, every replica has a run in flight.
+      ASSERT_TRUE(gate.WaitEntered(1));
+      EXPECT_EQ(gate.completed(), 0);
+      gate.Release();
+    }
+  }
+  ASSERT_EQ(vx::delegate::VxDelegateWaitForCompletion(delegate.get()),
+            kTfLiteOk);
+  EXPECT_EQ(gate.completed(), kFrames);
+  EXPECT_EQ(out_of_order, 0);
+  EXPECT_FALSE(gate.timed_out());
+
+  ASSERT_EQ(vx::delegate::VxDelegateGetPartitionStats(
+                delegate.get(), 0, &partition),
+            kTfLiteOk);
+  EXPECT_EQ(partition.compiles, kDepth);
+}
+
+// One interpreter per thread, all on one delegate, invoking concurrently.
+// Reports the throughput for each thread count so scaling can be compared.
+TEST(VxDelegateTest, ConcurrentInvokeStress) {
+  constexpr int kIterations = 200;
+  const int max_threads =
+      std::max(2u, std::min(8u, std::thread::hardware_concurrency()));
+
+  // With `async_compile`, graphs are also compiled and released on the
+  // compile threads while other partitions run theirs.
+  for (bool async_compile : {false, true}) {
+    VxDelegateOptions options = vx::delegate::VxDelegateOptionsDefault();
+    options.async_compile = async_compile;
+    DelegatePtr delegate(vx::delegate::VxDelegateCreate(&options));
+    for (int num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+      std::vector<std::unique_ptr<tflite::Interpreter>> interpreters(
+          num_threads);
+      std::atomic<int> failures{0};
+      std::atomic<int> ready{0};
+      std::atomic<bool> start{false};
+      std::vector<std::thread> workers;
+      for (int t = 0; t < num_threads; t++) {
+        workers.emplace_back([&, t]() {
+          // Building runs the delegate's Init and Prepare concurrently too.
+          interpreters[t] = BuildAddInterpreter(delegate.get());
+          ready++;
+          while (!start) {
+            std::this_thread::yield();
+          }
+          if (interpreters[t] == nullptr) {
+            failures += kIterations;
+            return;
+          }
+          failures += RunAdds(interpreters[t].get(), t, kIterations);
+        });
+      }
+      while (ready < num_threads) {
+        std::this_thread::yield();
+      }
+      auto begin = std::chrono::steady_clock::now();
+      start = true;
+      for (auto& worker : workers) {
+        worker.join();
+      }
+      double seconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - begin)
+                           .count();
+
+      EXPECT_EQ(failures, 0) << "with " << num_threads << " threads"
+                             << (async_compile ? ", async_compile" : "");
+      char property[64];
+      snprintf(property,
+               sizeof(property),
+               "invokes_per_s_%d_threads%s",
+               num_threads,
+               async_compile ? "_async_compile" : "");
+      RecordProperty(property,
+                     std::to_string(num_threads * kIterations / seconds));
+    }
+  }
+}
+
+}  // namespace